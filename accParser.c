@@ -0,0 +1,1732 @@
+#ifdef ParserInstrument
+/*clock_gettime isnt part of C89*/
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unpack12.h"
+#include "accParser.h"
+
+
+
+/***********************************************************************************************************************************
+ The parser itself. All of its state lives in a parserCtx that the caller owns, so any number of streams
+ can be decoded at the same time (one per thread, one per socket, ...) without any locking.
+
+ The way the values are decoded & stored is described at the top of binaryParser.c.
+ The short version:
+   parserInit   - pick n & the engine for the max values (linked list, sorted array, 4-ary heap or histogram)
+   parserFeed   - decode any number of bytes. A pair split across two feeds is carried over in the ctx
+   parserFeedValues - store values that were already decoded somewhere else (e.g. a range of a file)
+   parserFinish - handle the end of the stream (2 leftover bytes = one more value, 1 byte = ignored & counted)
+   parserSkip   - part of the stream is missing (a corrupt block), so dont glue its two sides together
+   parserMerge  - combine the results of two streams, e.g. two halves of a file decoded by different threads
+   parserTakeSnapshot - copy out the current max & last values at any point, without disturbing the stream
+   parserPartialTake / parserPartialMerge - the results of shards of a stream, merged in any order on any machine
+
+ The heap is an implicit 4-ary min heap in the same bytes as the list nodes (128 values fit, bigger n mallocs).
+ A new value only has to beat heap[0], so the filter kernel works the same way as for the list, but an accepted
+ value costs log4(n) levels instead of walking half the list. EngineAuto starts with the list for n <= 32 and the
+ heap for bigger n. A list that sees more than 1 in HeapSwitchRate values of a batch make it in (a rising stream,
+ where the list walk is worst) turns into a heap on the spot; a sorted list already is a valid min heap, so that's
+ just a copy. A heap that takes more than 1 in HistogramSwitchRate moves its values into the histogram, which
+ doesnt compare at all. The top n of what's left plus the rest of the stream is still the top n of everything.
+
+ The sorted array is the list without the next pointers: 2 bytes per value instead of 8, so 32 values are one cache
+ line. The spot for a new value is found by counting how many are smaller (the countBelow kernel, no branches) and
+ the ones below it move down a slot with one memmove. There is no chain of loads to follow, so for small n it beats
+ walking the list even when lots of values make it in. It only goes up to 128 values, since the memmove is O(n).
+
+ 10 & 14 bit streams (parserSetSampleBits) go through the same code in groups of 4 values in 5 or 7 bytes, with
+ the unrolled kernel for that width from unpackWidthKernel. N doesnt need a special version: the only place it shows up
+ per value is the filter threshold, and the last values are copied a batch at a time.
+
+ Interleaved channels (parserSetChannels) get a context each. Every batch is unpacked once, split into the channels'
+ own decodedValues with the splitChannels kernel (SIMD for 2 & 3 channels), and then each channel stores its part
+ exactly like a plain stream would. nextChannel carries over where the last batch stopped, since a batch (or a feed)
+ doesnt have to end on a whole frame.
+
+ parserEnableStats counts every value into a histogram of its own (on top of whatever the engine does), so min,
+ max, mean, variance & the percentiles all come out of it at the end, exactly. The mean & variance are sums over the
+ bins, not over the values, so the only cost per value is one increment. A run of the same value would make every
+ increment wait for the last one to hit memory, so there are 4 histograms & consecutive values go to different
+ ones. Their counts are 32 bits to keep all 4 of them at 64 KiB (12 bits), and they get folded into 64 bit totals
+ every 2^30 values.
+
+ A partial is what's left of a context once the stream is over: the top n sorted, the last n, the stats bins and
+ where in the whole stream it all came from. Two partials merge by keeping the top n of both tops & the last n of
+ both tails by offset, and adding the bins; all three are associative & commutative, so a reduce tree can group the
+ shards any way it likes, as long as no value is in two of them (a merge gives up if the counts say one is). The
+ tails carry a run (first offset & count) per shard they came from, so a tail that spans shards that arent next to
+ each other still sorts right against a shard that sat in the gap.
+
+ With -DParserInstrument every context also counts what the list does & times each batch of decodeBlock: the
+ unpack & last values count as decode, the list or histogram as top. That's 3 clock reads per 4096 values.
+
+ ***********************************************************************************************************************************/
+
+
+
+static void decodeBlock(parserCtx * ctx, const unsigned char * block, int length);
+static void decodeTail(parserCtx * ctx, const unsigned char * tail, int length);
+static void storeChannelValues(parserCtx * ctx, const unsigned short int * values, int count);
+static void countValues(parserCtx * ctx, const unsigned short int * values, int count);
+static void foldStats(parserCtx * ctx);
+static void summarizeBins(const unsigned long * totals, const unsigned int * stripes, unsigned long bins, parserSummary * summary);
+static unsigned long binCount(const unsigned long * totals, const unsigned int * stripes, unsigned long bins, unsigned long value);
+static unsigned short int summaryPercentile(const unsigned long * totals, const unsigned int * stripes, unsigned long bins,
+                                            unsigned long count, unsigned long perMille);
+#ifdef ParserInstrument
+static void mergeCounters(parserCtx * ctx, const parserCtx * other);
+#endif
+static void storeValue(parserCtx * ctx, unsigned short int value);
+static void storeLastValues(parserCtx * ctx, const unsigned short int * values, int count);
+static void insertValues(parserCtx * ctx, const unsigned short int * values, int count);
+static void insertValue(parserCtx * ctx, unsigned short int value);
+static void listInsert(parserCtx * ctx, unsigned short int value);
+static int listRemove(parserCtx * ctx);
+static unsigned short int listPeek(const parserCtx * ctx);
+static void heapInsert(parserCtx * ctx, unsigned short int value);
+static void arrayInsert(parserCtx * ctx, unsigned short int value);
+static void listToHeap(parserCtx * ctx);
+#ifndef ParserStaticOnly
+static void heapToHistogram(parserCtx * ctx);
+#endif
+static int compareValues(const void * a, const void * b);
+static int nextLastValuesIdx(const parserCtx * ctx, int index);
+static int histogramMaxValues(const parserCtx * ctx, unsigned short int * values);
+
+
+/*This function gets a context ready for a new stream*/
+int parserInit(parserCtx * ctx, int valuesToPrint, maxValueEngine engine){
+
+	if(valuesToPrint <= 0 || valuesToPrint > MaxValuesToPrint){
+		return -1;
+	}
+
+	/*The list is O(n) per insert and statically allocated, so it only makes sense for small n*/
+	ctx->requestedEngine = engine;
+	if(engine == EngineAuto){
+		engine = (valuesToPrint <= NumberOfValuesToPrint) ? EngineList : EngineHeap;
+	}
+	if(engine == EngineList && valuesToPrint > NumberOfValuesToPrint){
+		return -1;
+	}
+	/*The array never mallocs, it only ever uses the list's bytes*/
+	if(engine == EngineArray && valuesToPrint > (int)TopStaticValues){
+		return -1;
+	}
+
+	/*Small heaps live in the list's bytes*/
+	ctx->topValues = &ctx->top.heap[0];
+
+#ifdef ParserStaticOnly
+	/*The embedded build has no histogram & never mallocs*/
+	if(engine == EngineHistogram){
+		return -1;
+	}
+	ctx->lastValuesBuffer = &ctx->lastValuesStatic[0];
+#else
+	if(engine == EngineHeap && valuesToPrint > (int)TopStaticValues){
+		ctx->topValues = malloc(valuesToPrint * sizeof(unsigned short int));
+		if(ctx->topValues == NULL){
+			return -1;
+		}
+	}
+
+	/*Anything that fits uses the statically allocated buffer, so the default never mallocs*/
+	if(valuesToPrint <= NumberOfValuesToPrint){
+		ctx->lastValuesBuffer = &ctx->lastValuesStatic[0];
+	}
+	else{
+		ctx->lastValuesBuffer = malloc(valuesToPrint * sizeof(unsigned short int));
+		if(ctx->lastValuesBuffer == NULL){
+			if(ctx->topValues != &ctx->top.heap[0]){
+				free(ctx->topValues);
+			}
+			return -1;
+		}
+	}
+#endif
+
+	ctx->valuesToPrint = valuesToPrint;
+	ctx->engine = engine;
+
+	/*12 bit pairs until somebody says otherwise*/
+	ctx->sampleBits = DefaultSampleBits;
+	ctx->groupValues = 2;
+	ctx->groupBytes = 3;
+	ctx->unpackGroups = NULL;
+
+	/*One channel & no stats until somebody says otherwise*/
+	ctx->channels = NULL;
+	ctx->channelCount = 1;
+	ctx->statsStripes = NULL;
+	ctx->statsTotals = NULL;
+
+	/*Powers of two get wrapped with a mask, everything else with a compare*/
+	ctx->lastValuesMask = ((valuesToPrint & (valuesToPrint - 1)) == 0) ? valuesToPrint - 1 : -1;
+
+	parserReset(ctx);
+
+	return 0;
+
+}
+
+
+/*This function clears out everything we've read*/
+void parserReset(parserCtx * ctx){
+
+	int i;
+
+	memset(&ctx->top, 0x00, sizeof(ctx->top));
+	memset(ctx->lastValuesBuffer, 0x00, ctx->valuesToPrint * sizeof(unsigned short int));
+#ifndef ParserStaticOnly
+	memset(&ctx->valueHistogram[0], 0x00, ValueRange * sizeof(unsigned long));
+#endif
+	ctx->lastValuesWriteIdx = 0;
+	ctx->totalValueCount = 0;
+	ctx->listSize = 0;
+	ctx->listHead = 0;
+	ctx->carryLength = 0;
+	ctx->truncatedBytes = 0;
+	ctx->nextChannel = 0;
+	for(i = 0; i < ctx->channelCount && ctx->channels != NULL; i++){
+		parserReset(&ctx->channels[i]);
+	}
+	ctx->statsPending = 0;
+	if(ctx->statsStripes != NULL){
+		memset(ctx->statsStripes, 0x00, StatsStripes * ((size_t)1 << ctx->sampleBits) * sizeof(unsigned int));
+		memset(ctx->statsTotals, 0x00, ((size_t)1 << ctx->sampleBits) * sizeof(unsigned long));
+	}
+
+	/*Whatever the engine turned into, it starts over with the one it was picked from n*/
+	ctx->adaptive = (ctx->requestedEngine == EngineAuto);
+	if(ctx->adaptive){
+		ctx->engine = (ctx->valuesToPrint <= NumberOfValuesToPrint) ? EngineList : EngineHeap;
+	}
+#ifdef ParserInstrument
+	memset(&ctx->counters, 0x00, sizeof(ctx->counters));
+#endif
+
+	/*We need an invalid value for each of the next pointers, as 0 is a valid value*/
+	for(i = 0; i < NumberOfValuesToPrint; i++){
+		ctx->top.list[i].next = -1;
+	}
+
+}
+
+
+/*This function frees the circular buffer (& heap) if parserInit had to malloc them*/
+void parserDestroy(parserCtx * ctx){
+
+	int i;
+
+	for(i = 0; i < ctx->channelCount && ctx->channels != NULL; i++){
+		parserDestroy(&ctx->channels[i]);
+	}
+	free(ctx->channels);
+	ctx->channels = NULL;
+	ctx->channelCount = 1;
+	free(ctx->statsStripes);
+	free(ctx->statsTotals);
+	ctx->statsStripes = NULL;
+	ctx->statsTotals = NULL;
+
+	if(ctx->lastValuesBuffer != &ctx->lastValuesStatic[0]){
+		free(ctx->lastValuesBuffer);
+	}
+	if(ctx->topValues != &ctx->top.heap[0]){
+		free(ctx->topValues);
+	}
+	ctx->lastValuesBuffer = &ctx->lastValuesStatic[0];
+	ctx->topValues = &ctx->top.heap[0];
+	ctx->valuesToPrint = 0;
+
+}
+
+
+/*This function picks the kernel & group size for the sample width*/
+int parserSetSampleBits(parserCtx * ctx, int bits){
+
+	void (*kernel)(const unsigned char * in, int groupCount, unsigned short int * out);
+	int groupValues, groupBytes;
+
+	kernel = unpackWidthKernel(bits, &groupValues, &groupBytes);
+	/*The stats histogram already has its bins*/
+	if(kernel == NULL || (bits > DefaultSampleBits && ctx->engine == EngineHistogram) || ctx->statsStripes != NULL){
+		return -1;
+	}
+
+	ctx->sampleBits = bits;
+	ctx->groupValues = groupValues;
+	ctx->groupBytes = groupBytes;
+	/*12 bits keeps the SIMD kernels*/
+	ctx->unpackGroups = (bits == DefaultSampleBits) ? NULL : kernel;
+	ctx->carryLength = 0;
+
+	return 0;
+
+}
+
+
+/*This function sets up a context the same way as another one, e.g. for a worker thread*/
+int parserInitLike(parserCtx * ctx, const parserCtx * model){
+
+	if(parserInit(ctx, model->valuesToPrint, model->requestedEngine) != 0){
+		return -1;
+	}
+
+	/*Cant fail, model already took the same width with the same engine*/
+	parserSetSampleBits(ctx, model->sampleBits);
+
+	if((model->statsStripes != NULL && parserEnableStats(ctx) != 0) || parserSetChannels(ctx, model->channelCount) != 0){
+		parserDestroy(ctx);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/*This function turns on the stats histogram*/
+int parserEnableStats(parserCtx * ctx){
+
+#ifdef ParserStaticOnly
+	(void)ctx;
+	return -1;
+#else
+	size_t bins;
+
+	bins = (size_t)1 << ctx->sampleBits;
+	if(ctx->statsStripes == NULL){
+		ctx->statsStripes = calloc(StatsStripes * bins, sizeof(unsigned int));
+		ctx->statsTotals = calloc(bins, sizeof(unsigned long));
+		if(ctx->statsStripes == NULL || ctx->statsTotals == NULL){
+			free(ctx->statsStripes);
+			free(ctx->statsTotals);
+			ctx->statsStripes = NULL;
+			ctx->statsTotals = NULL;
+			return -1;
+		}
+		ctx->statsPending = 0;
+	}
+
+	return 0;
+#endif
+
+}
+
+
+/*This function gives every channel a context of its own with the same settings as ctx*/
+int parserSetChannels(parserCtx * ctx, int channelCount){
+
+#ifdef ParserStaticOnly
+	/*No malloc, so no channels*/
+	(void)ctx;
+	return (channelCount == 1) ? 0 : -1;
+#else
+	parserCtx * channels;
+	int i;
+
+	if(channelCount < 1 || channelCount > MaxChannels || ctx->channels != NULL){
+		return -1;
+	}
+	if(channelCount == 1){
+		return 0;
+	}
+
+	channels = malloc(channelCount * sizeof(parserCtx));
+	if(channels == NULL){
+		return -1;
+	}
+	/*ctx only has the one channel so far, so they dont get channels of their own*/
+	for(i = 0; i < channelCount; i++){
+		if(parserInitLike(&channels[i], ctx) != 0){
+			while(i-- > 0){
+				parserDestroy(&channels[i]);
+			}
+			free(channels);
+			return -1;
+		}
+	}
+
+	ctx->channels = channels;
+	ctx->channelCount = channelCount;
+	ctx->nextChannel = 0;
+
+	return 0;
+#endif
+
+}
+
+
+/*This function decodes the next piece of the stream*/
+void parserFeed(parserCtx * ctx, const unsigned char * bytes, size_t length){
+
+	size_t blockEnd, offset, blockSize, blockLimit;
+
+	/*First finish off the pair that was split across the last feed (if there is one)*/
+	if(ctx->carryLength > 0){
+
+		while(ctx->carryLength < ctx->groupBytes && length > 0){
+			ctx->carry[ctx->carryLength++] = *bytes++;
+			length--;
+		}
+
+		if(ctx->carryLength < ctx->groupBytes){
+			return;
+		}
+
+		decodeBlock(ctx, &ctx->carry[0], ctx->groupBytes);
+		ctx->carryLength = 0;
+
+	}
+
+	/*Decode all of the complete pairs. decodeBlock takes an int, so big feeds go in pieces of whole groups*/
+	blockEnd = length - (length % ctx->groupBytes);
+	blockLimit = MaxDecodeBlockSize - (MaxDecodeBlockSize % ctx->groupBytes);
+	for(offset = 0; offset < blockEnd; offset += blockSize){
+		blockSize = blockEnd - offset;
+		if(blockSize > blockLimit){
+			blockSize = blockLimit;
+		}
+		decodeBlock(ctx, &bytes[offset], (int)blockSize);
+	}
+
+	/*Hang on to the 0-2 (or up to 6) leftover bytes until the next feed completes the pair*/
+	for(; blockEnd < length; blockEnd++){
+		ctx->carry[ctx->carryLength++] = bytes[blockEnd];
+	}
+
+}
+
+
+/*This function stores values somebody else already decoded, exactly like decodeBlock would*/
+void parserFeedValues(parserCtx * ctx, const unsigned short int * values, int count){
+
+	int batch;
+
+	/*The channels split a batch at a time into their decodedValues, so they cant take more than that at once*/
+	if(ctx->channels != NULL){
+		for(; count > 0; count -= batch, values += batch){
+			batch = (count > DecodeBatchPairs * 2) ? DecodeBatchPairs * 2 : count;
+			storeChannelValues(ctx, values, batch);
+			ctx->totalValueCount += batch;
+		}
+		return;
+	}
+
+	storeLastValues(ctx, values, count);
+	insertValues(ctx, values, count);
+	countValues(ctx, values, count);
+
+	ctx->totalValueCount += count;
+
+}
+
+
+/*This function handles the end of the stream*/
+void parserFinish(parserCtx * ctx){
+
+	decodeTail(ctx, &ctx->carry[0], ctx->carryLength);
+	ctx->carryLength = 0;
+
+}
+
+
+/*This function forgets the partial pair & keeps the channels lined up across a gap in the stream*/
+void parserSkip(parserCtx * ctx, unsigned long valueCount){
+
+	ctx->carryLength = 0;
+	if(ctx->channels != NULL){
+		ctx->nextChannel = (int)((ctx->nextChannel + valueCount) % ctx->channelCount);
+	}
+
+}
+
+
+/*This function combines two sets of results. other's values count as the newer ones*/
+void parserMerge(parserCtx * ctx, const parserCtx * other){
+
+	int i, count, readIdx, listIndex;
+	unsigned long bins, j;
+#ifndef ParserStaticOnly
+	unsigned long remaining;
+	int value;
+#endif
+
+	/*Channels merge one by one. other has to have started on the channel we stopped on, so we end up where it did*/
+	if(ctx->channels != NULL && other->channels != NULL){
+		for(i = 0; i < ctx->channelCount; i++){
+			parserMerge(&ctx->channels[i], &other->channels[i]);
+		}
+		ctx->totalValueCount += other->totalValueCount;
+		ctx->truncatedBytes = other->truncatedBytes;
+		ctx->nextChannel = other->nextChannel;
+#ifdef ParserInstrument
+		mergeCounters(ctx, other);
+#endif
+		return;
+	}
+
+	/*The max values - two histograms just add up, otherwise we insert the other side's max values one by one*/
+#ifndef ParserStaticOnly
+	if(other->engine == EngineHistogram){
+		if(ctx->engine == EngineHistogram){
+			for(i = 0; i < ValueRange; i++){
+				ctx->valueHistogram[i] += other->valueHistogram[i];
+			}
+		}
+		else{
+			/*The list cant hold more than n anyway, so only the top n of the histogram matter*/
+			remaining = ctx->valuesToPrint;
+			for(value = ValueRange - 1; value >= 0 && remaining > 0; value--){
+				for(j = 0; j < other->valueHistogram[value] && remaining > 0; j++){
+					insertValue(ctx, (unsigned short int)value);
+					remaining--;
+				}
+			}
+		}
+	}
+	else
+#endif
+	if(other->engine == EngineHeap || other->engine == EngineArray){
+		/*The heap isnt sorted, but the order doesnt matter to insertValue*/
+		for(i = 0; i < other->listSize; i++){
+			insertValue(ctx, other->topValues[i]);
+		}
+	}
+	else{
+		listIndex = other->listHead;
+		for(i = 0; i < other->listSize; i++){
+			insertValue(ctx, other->top.list[listIndex].value);
+			listIndex = other->top.list[listIndex].next;
+		}
+	}
+
+	/*The last values - other's come after ours, so append them in order*/
+	if(other->totalValueCount >= (unsigned long)other->valuesToPrint){
+		readIdx = other->lastValuesWriteIdx;
+		count = other->valuesToPrint;
+	}
+	else{
+		readIdx = 0;
+		count = (int)other->totalValueCount;
+	}
+
+	/*Oldest values first: from readIdx up to the end of other's buffer, then from the front*/
+	if(readIdx + count > other->valuesToPrint){
+		storeLastValues(ctx, &other->lastValuesBuffer[readIdx], other->valuesToPrint - readIdx);
+		storeLastValues(ctx, &other->lastValuesBuffer[0], count - (other->valuesToPrint - readIdx));
+	}
+	else{
+		storeLastValues(ctx, &other->lastValuesBuffer[readIdx], count);
+	}
+
+	/*The stats histograms just add up. Ours gets folded first, so the stripes have all of the 32 bits left for other's*/
+	if(ctx->statsStripes != NULL && other->statsStripes != NULL){
+		foldStats(ctx);
+		bins = 1UL << ctx->sampleBits;
+		for(j = 0; j < bins; j++){
+			ctx->statsTotals[j] += other->statsTotals[j];
+			for(i = 0; i < StatsStripes; i++){
+				ctx->statsTotals[j] += other->statsStripes[i * bins + j];
+			}
+		}
+	}
+
+	ctx->totalValueCount += other->totalValueCount;
+	ctx->truncatedBytes = other->truncatedBytes;
+
+#ifdef ParserInstrument
+	/*Other's counts just add up with ours, including the inserts the merge itself did above*/
+	mergeCounters(ctx, other);
+#endif
+
+}
+
+
+#ifdef ParserInstrument
+/*This function adds other's counters to ctx's*/
+static void mergeCounters(parserCtx * ctx, const parserCtx * other){
+
+	ctx->counters.decodeSeconds += other->counters.decodeSeconds;
+	ctx->counters.topSeconds += other->counters.topSeconds;
+	ctx->counters.listAccepts += other->counters.listAccepts;
+	ctx->counters.listRejects += other->counters.listRejects;
+	ctx->counters.listSteps += other->counters.listSteps;
+	ctx->counters.filterSkips += other->counters.filterSkips;
+
+}
+#endif
+
+
+/*This function decodes a block of complete 24 bit pairs*/
+static void decodeBlock(parserCtx * ctx, const unsigned char * block, int length){
+
+	int groupCount, groupLimit, valueCount, i;
+#ifdef ParserInstrument
+	double start, decoded, stored;
+#endif
+
+	/*Every batch is the same number of values, whatever the width*/
+	groupLimit = (DecodeBatchPairs * 2) / ctx->groupValues;
+
+	/*Unpack a batch of pairs at a time with whichever kernel the cpu supports, then store the values*/
+	for(i = 0; i < length; i += groupCount * ctx->groupBytes){
+
+		groupCount = (length - i) / ctx->groupBytes;
+		if(groupCount > groupLimit){
+			groupCount = groupLimit;
+		}
+		valueCount = groupCount * ctx->groupValues;
+
+#ifdef ParserInstrument
+		start = parserClock();
+#endif
+		if(ctx->unpackGroups == NULL){
+			unpack12Pairs(&block[i], groupCount, &ctx->decodedValues[0]);
+		}
+		else{
+			ctx->unpackGroups(&block[i], groupCount, &ctx->decodedValues[0]);
+		}
+
+		if(ctx->channels != NULL){
+			storeChannelValues(ctx, &ctx->decodedValues[0], valueCount);
+		}
+		else{
+			storeLastValues(ctx, &ctx->decodedValues[0], valueCount);
+		}
+#ifdef ParserInstrument
+		decoded = parserClock();
+#endif
+		if(ctx->channels == NULL){
+			insertValues(ctx, &ctx->decodedValues[0], valueCount);
+			countValues(ctx, &ctx->decodedValues[0], valueCount);
+		}
+#ifdef ParserInstrument
+		stored = parserClock();
+		ctx->counters.decodeSeconds += decoded - start;
+		ctx->counters.topSeconds += stored - decoded;
+#endif
+
+		/*Counted as we go, since insertValues looks at it to decide if the engine should change*/
+		ctx->totalValueCount += valueCount;
+
+	}
+
+}
+
+
+/*This function handles the end of the file*/
+static void decodeTail(parserCtx * ctx, const unsigned char * tail, int length){
+
+	unsigned char group[MaxGroupBytes];
+	int count, i;
+
+	/*We need to take care of the case where we have an odd # of values in the file*/
+	/*Whatever whole values fit in the leftover bits count, e.g. 2 bytes = 1 value for 12 bits*/
+	count = (length * 8) / ctx->sampleBits;
+
+	if(count > 0){
+
+		/*Pad it out to a whole group & decode that. The padding only ends up in values we dont keep*/
+		memset(&group[0], 0x00, sizeof(group));
+		memcpy(&group[0], tail, length);
+		if(ctx->unpackGroups == NULL){
+			unpack12Pairs(&group[0], 1, &ctx->decodedValues[0]);
+		}
+		else{
+			ctx->unpackGroups(&group[0], 1, &ctx->decodedValues[0]);
+		}
+
+		if(ctx->channels != NULL){
+			storeChannelValues(ctx, &ctx->decodedValues[0], count);
+		}
+		for(i = 0; i < count && ctx->channels == NULL; i++){
+			storeValue(ctx, ctx->decodedValues[i]);
+		}
+		if(ctx->channels == NULL){
+			countValues(ctx, &ctx->decodedValues[0], count);
+		}
+		ctx->totalValueCount += count;
+
+	}
+
+	/*
+	 * Length = 1 indicates that for whatever reason, there are 8 bits at the end of the file.
+	 * These clearly can't contain another 12 bit value, so we ignore them, but say how many there were.
+	 * Bits that only pad out the last value (e.g. 4 of 2 bytes for 12 bits) arent missing anything.
+	 */
+	ctx->truncatedBytes = length - (count * ctx->sampleBits + 7) / 8;
+
+}
+
+
+/*This function puts the value in the circular buffer & the list*/
+static void storeValue(parserCtx * ctx, unsigned short int value){
+
+	/*Store the value in the circular buffer*/
+	ctx->lastValuesBuffer[ctx->lastValuesWriteIdx] = value;
+	/*Incriment the write index and wrap around if necessary*/
+	ctx->lastValuesWriteIdx = nextLastValuesIdx(ctx, ctx->lastValuesWriteIdx);
+	/*populate list (or histogram) with the value*/
+	insertValue(ctx, value);
+
+}
+
+
+/*This function splits up to a batch of interleaved values between the channels & stores each channel's share*/
+static void storeChannelValues(parserCtx * ctx, const unsigned short int * values, int count){
+
+	unsigned short int * out[MaxChannels];
+	int counts[MaxChannels];
+	int frameCount, channel;
+	parserCtx * target;
+
+	for(channel = 0; channel < ctx->channelCount; channel++){
+		counts[channel] = 0;
+	}
+
+	/*Finish the frame the last batch stopped in the middle of*/
+	for(; count > 0 && ctx->nextChannel != 0; count--){
+		target = &ctx->channels[ctx->nextChannel];
+		target->decodedValues[counts[ctx->nextChannel]++] = *values++;
+		ctx->nextChannel = (ctx->nextChannel + 1) % ctx->channelCount;
+	}
+
+	/*Then the whole frames in one go*/
+	frameCount = count / ctx->channelCount;
+	for(channel = 0; channel < ctx->channelCount; channel++){
+		out[channel] = &ctx->channels[channel].decodedValues[counts[channel]];
+		counts[channel] += frameCount;
+	}
+	splitChannels(values, frameCount, ctx->channelCount, out);
+	values += frameCount * ctx->channelCount;
+	count -= frameCount * ctx->channelCount;
+
+	/*And the start of the next frame*/
+	for(; count > 0; count--){
+		target = &ctx->channels[ctx->nextChannel];
+		target->decodedValues[counts[ctx->nextChannel]++] = *values++;
+		ctx->nextChannel++;
+	}
+
+	/*Now every channel is a plain stream*/
+	for(channel = 0; channel < ctx->channelCount; channel++){
+		target = &ctx->channels[channel];
+		if(counts[channel] > 0){
+			storeLastValues(target, &target->decodedValues[0], counts[channel]);
+			insertValues(target, &target->decodedValues[0], counts[channel]);
+			countValues(target, &target->decodedValues[0], counts[channel]);
+			target->totalValueCount += counts[channel];
+		}
+#ifdef ParserInstrument
+		/*The list counts go to ctx, so one context still has all of them. Its timers already cover the channels*/
+		mergeCounters(ctx, target);
+		memset(&target->counters, 0x00, sizeof(target->counters));
+#endif
+	}
+
+}
+
+
+/*This function counts a batch of values into the stats histogram, if there is one*/
+static void countValues(parserCtx * ctx, const unsigned short int * values, int count){
+
+	unsigned int * stripes;
+	size_t bins;
+	int i;
+
+	if(ctx->statsStripes == NULL){
+		return;
+	}
+
+	/*Consecutive values go to different stripes, so a run of the same value doesnt wait on itself*/
+	stripes = ctx->statsStripes;
+	bins = (size_t)1 << ctx->sampleBits;
+	for(i = 0; i + StatsStripes <= count; i += StatsStripes){
+		stripes[values[i]]++;
+		stripes[bins + values[i + 1]]++;
+		stripes[2 * bins + values[i + 2]]++;
+		stripes[3 * bins + values[i + 3]]++;
+	}
+	for(; i < count; i++){
+		stripes[values[i]]++;
+	}
+
+	/*Fold them before any 32 bit count could wrap around*/
+	ctx->statsPending += count;
+	if(ctx->statsPending >= StatsFlushValues){
+		foldStats(ctx);
+	}
+
+}
+
+
+/*This function moves the stripe counts into the 64 bit totals*/
+static void foldStats(parserCtx * ctx){
+
+	size_t bins, i;
+	int stripe;
+
+	bins = (size_t)1 << ctx->sampleBits;
+	for(i = 0; i < bins; i++){
+		for(stripe = 0; stripe < StatsStripes; stripe++){
+			ctx->statsTotals[i] += ctx->statsStripes[stripe * bins + i];
+			ctx->statsStripes[stripe * bins + i] = 0;
+		}
+	}
+	ctx->statsPending = 0;
+
+}
+
+
+/*This function works out the summary stats, walking the bins instead of the values*/
+void parserGetSummary(const parserCtx * ctx, parserSummary * summary){
+
+	memset(summary, 0x00, sizeof(parserSummary));
+	if(ctx->statsStripes == NULL){
+		return;
+	}
+
+	summarizeBins(ctx->statsTotals, ctx->statsStripes, 1UL << ctx->sampleBits, summary);
+
+}
+
+
+/*This function works out the summary of a histogram: totals plus the stripes (if there are any) for every value*/
+static void summarizeBins(const unsigned long * totals, const unsigned int * stripes, unsigned long bins, parserSummary * summary){
+
+	unsigned long value, count;
+	double sum, squares;
+
+	/*First pass: count, min, max & the mean*/
+	sum = 0.0;
+	for(value = 0; value < bins; value++){
+		count = binCount(totals, stripes, bins, value);
+		if(count > 0){
+			if(summary->count == 0){
+				summary->min = (unsigned short int)value;
+			}
+			summary->max = (unsigned short int)value;
+			summary->count += count;
+			sum += (double)value * count;
+		}
+	}
+	if(summary->count == 0){
+		return;
+	}
+	summary->mean = sum / summary->count;
+
+	/*Second pass: the variance around the mean, so it doesnt lose precision like sum of squares - mean^2 would*/
+	squares = 0.0;
+	for(value = summary->min; value <= summary->max; value++){
+		count = binCount(totals, stripes, bins, value);
+		squares += ((double)value - summary->mean) * ((double)value - summary->mean) * count;
+	}
+	summary->variance = squares / summary->count;
+
+	summary->p50 = summaryPercentile(totals, stripes, bins, summary->count, 500);
+	summary->p99 = summaryPercentile(totals, stripes, bins, summary->count, 990);
+	summary->p999 = summaryPercentile(totals, stripes, bins, summary->count, 999);
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+static unsigned long binCount(const unsigned long * totals, const unsigned int * stripes, unsigned long bins, unsigned long value){
+
+	unsigned long count;
+	int stripe;
+
+	count = totals[value];
+	if(stripes != NULL){
+		for(stripe = 0; stripe < StatsStripes; stripe++){
+			count += stripes[stripe * bins + value];
+		}
+	}
+
+	return count;
+
+}
+
+
+/*This function finds the smallest value that at least perMille / 1000 of the count are <= to (nearest rank)*/
+static unsigned short int summaryPercentile(const unsigned long * totals, const unsigned int * stripes, unsigned long bins,
+                                            unsigned long count, unsigned long perMille){
+
+	unsigned long value, rank, seen;
+
+	/*ceil(count * perMille / 1000), without count * perMille overflowing*/
+	rank = (count / 1000) * perMille + ((count % 1000) * perMille + 999) / 1000;
+	if(rank == 0){
+		rank = 1;
+	}
+
+	seen = 0;
+	for(value = 0; value < bins; value++){
+		seen += binCount(totals, stripes, bins, value);
+		if(seen >= rank){
+			break;
+		}
+	}
+
+	return (unsigned short int)value;
+
+}
+
+
+/*This function puts a whole batch of values in the circular buffer*/
+static void storeLastValues(parserCtx * ctx, const unsigned short int * values, int count){
+
+	int firstPart;
+
+	/*Anything before the last n values would just be overwritten, so skip it*/
+	if(count > ctx->valuesToPrint){
+		values += count - ctx->valuesToPrint;
+		count = ctx->valuesToPrint;
+	}
+
+	/*Copy up to the end of the buffer, then wrap around and copy the rest to the front*/
+	firstPart = ctx->valuesToPrint - ctx->lastValuesWriteIdx;
+	if(firstPart > count){
+		firstPart = count;
+	}
+	memcpy(&ctx->lastValuesBuffer[ctx->lastValuesWriteIdx], values, firstPart * sizeof(unsigned short int));
+	memcpy(&ctx->lastValuesBuffer[0], &values[firstPart], (count - firstPart) * sizeof(unsigned short int));
+
+	if(ctx->lastValuesMask >= 0){
+		ctx->lastValuesWriteIdx = (ctx->lastValuesWriteIdx + count) & ctx->lastValuesMask;
+	}
+	else{
+		ctx->lastValuesWriteIdx += count;
+		if(ctx->lastValuesWriteIdx >= ctx->valuesToPrint){
+			ctx->lastValuesWriteIdx -= ctx->valuesToPrint;
+		}
+	}
+
+}
+
+
+/*This function hands a whole batch of values to the list, skipping the ones it would reject anyway*/
+static void insertValues(parserCtx * ctx, const unsigned short int * values, int count){
+
+	int i, accepted;
+#ifdef ParserInstrument
+	int skipped;
+#endif
+
+#ifndef ParserStaticOnly
+	/*The histogram engine just counts every value. No compares at all*/
+	if(ctx->engine == EngineHistogram){
+		for(i = 0; i < count; i++){
+			ctx->valueHistogram[values[i]]++;
+		}
+		return;
+	}
+#endif
+
+	/*Until the list (or heap) is full every value goes in*/
+	for(i = 0; i < count && ctx->listSize < ctx->valuesToPrint; i++){
+		insertValue(ctx, values[i]);
+	}
+
+	/*
+	 * From here on a value only goes in if it is bigger than the smallest value in the list.
+	 * The filter kernel skips everything that isnt, 16 values per compare.
+	 * The smallest value only ever goes up, so anything skipped would have been rejected by listInsert() too.
+	 */
+	accepted = 0;
+	while(i < count){
+#ifdef ParserInstrument
+		skipped = firstAboveThreshold(&values[i], count - i, listPeek(ctx));
+		ctx->counters.filterSkips += skipped;
+		i += skipped;
+#else
+		i += firstAboveThreshold(&values[i], count - i, listPeek(ctx));
+#endif
+		if(i < count){
+			if(ctx->engine == EngineArray){
+				arrayInsert(ctx, values[i]);
+			}
+			else if(ctx->engine == EngineHeap){
+				heapInsert(ctx, values[i]);
+			}
+			else{
+				listInsert(ctx, values[i]);
+			}
+			accepted++;
+			i++;
+		}
+	}
+
+	/*
+	 * Too many values made it in for the list walk to be cheap, so switch to the heap for the rest of the stream.
+	 * If even that is too slow, just count everything.
+	 * Even random data gets about n of every k values in after reading k, so the first 2 * rate * n values dont count.
+	 */
+	if(ctx->adaptive && accepted * HeapSwitchRate > count){
+		if(ctx->engine == EngineList){
+			if(ctx->totalValueCount >= (unsigned long)ctx->valuesToPrint * 2 * HeapSwitchRate){
+				listToHeap(ctx);
+			}
+		}
+#ifndef ParserStaticOnly
+		else if(accepted * HistogramSwitchRate > count && ctx->totalValueCount >= (unsigned long)ctx->valuesToPrint * 2 * HistogramSwitchRate
+		        && ctx->sampleBits <= DefaultSampleBits){
+			heapToHistogram(ctx);
+		}
+#endif
+	}
+
+}
+
+
+/*This function hands a single value to whichever engine we use*/
+static void insertValue(parserCtx * ctx, unsigned short int value){
+
+#ifndef ParserStaticOnly
+	if(ctx->engine == EngineHistogram){
+		ctx->valueHistogram[value]++;
+		return;
+	}
+#endif
+	if(ctx->engine == EngineHeap){
+		heapInsert(ctx, value);
+		return;
+	}
+	if(ctx->engine == EngineArray){
+		arrayInsert(ctx, value);
+		return;
+	}
+
+	listInsert(ctx, value);
+
+}
+
+
+/*This function inserts the value passed to it only if it is necessary*/
+static void listInsert(parserCtx * ctx, unsigned short int value){
+
+	/*We keep track of 2 indexes here.
+	  1) The index of the struct we will clear and use for our new value
+	  2) A temp index used while we traverse the list
+	  3) A previous index that points to the node before nodeIdx (most of the time)
+	  using a prevIdx pointer makes the code easier to read
+	 */
+	unsigned short int smallestValue;
+	int index, nodeIdx, prevIdx;
+	listNode * maxList;
+
+	maxList = &ctx->top.list[0];
+	smallestValue = listPeek(ctx);
+
+	/*First check to see if we need to add the value to the heap*/
+	/*WE will add the value under either of two conditions
+	  1) The value is greater than the minimum value
+	  2) The list is not yet full
+	  otherwise, return
+	 */
+	if(value <= smallestValue && ctx->listSize == ctx->valuesToPrint){
+#ifdef ParserInstrument
+		ctx->counters.listRejects++;
+#endif
+		return;
+	}
+#ifdef ParserInstrument
+	ctx->counters.listAccepts++;
+#endif
+
+	/*If the list is already full we need to remove the min;*/
+	if(ctx->listSize == ctx->valuesToPrint){
+		index = listRemove(ctx);
+	}
+	else{
+		/*When we first populate the list we use the array indicies in order*/
+		index = ctx->listSize;
+	}
+
+	/*We now know where to store the value*/
+	maxList[index].value = value;
+
+	/*now we figure out where to put it in the list*/
+	nodeIdx = ctx->listHead;
+	prevIdx = nodeIdx;
+	while(nodeIdx != -1){
+		/*Check if the value in the next largest node is greater than or equal to ours*/
+		/*If so, we place the node there*/
+		if(maxList[nodeIdx].value >= value){
+			break;
+		}
+		/*Update our trailing pointer and move along*/
+		prevIdx = nodeIdx;
+		nodeIdx = maxList[nodeIdx].next;
+#ifdef ParserInstrument
+		ctx->counters.listSteps++;
+#endif
+	}
+
+
+	/*We found the correct location in the list!*/
+	/*Need to handle the insert at head case separately*/
+	if(nodeIdx == ctx->listHead && ctx->listSize != 0){
+		maxList[index].next = ctx->listHead;
+		ctx->listHead = index;
+	}
+	else{
+		maxList[index].next = maxList[prevIdx].next;
+		/*For the first one, the two indicies are the same. We dont want a node that points to itself*/
+		if(ctx->listSize!=0){
+			maxList[prevIdx].next = index;
+		}
+	}
+
+	ctx->listSize++;
+
+	/*Whew!*/
+	return;
+
+}
+
+
+/*Move one index along the circular buffer, wrapping around at the end*/
+static int nextLastValuesIdx(const parserCtx * ctx, int index){
+
+	if(ctx->lastValuesMask >= 0){
+		return (index + 1) & ctx->lastValuesMask;
+	}
+
+	index++;
+	return (index == ctx->valuesToPrint) ? 0 : index;
+
+}
+
+
+/*Read the circular buffer and copy out the last values read (should be <= n values)*/
+int parserLastValues(const parserCtx * ctx, unsigned short int * values){
+
+	int i, j,readIdx;
+
+
+	/* j is how many values we copy. If we read more than n (32 by default), we copy n.
+	 * Otherwise, we copy the number of values that we read.
+	 *
+	 * readIdx is the location from where we start reading. If we read less than n,
+	 * then the circular buffer has not yet looped and we read from index 0
+	 * Otherwise, we read from where the write index is
+	 */
+	if(ctx->totalValueCount >= (unsigned long)ctx->valuesToPrint)
+	{
+		readIdx = ctx->lastValuesWriteIdx;
+		j = ctx->valuesToPrint;
+	}
+	else
+	{
+		readIdx = 0;
+		j = ctx->totalValueCount;
+	}
+
+	for(i = 0; i<j; i++)
+	{
+		values[i] = ctx->lastValuesBuffer[readIdx];
+		readIdx = nextLastValuesIdx(ctx, readIdx);
+	}
+
+	return j;
+
+}
+
+
+/*Iterate through the linked list (or histogram) and copy out the values*/
+int parserMaxValues(const parserCtx * ctx, unsigned short int * values){
+
+	int listIndex, i;
+
+	if(ctx->engine == EngineHistogram){
+		return histogramMaxValues(ctx, values);
+	}
+
+	/*The array already is in the right order*/
+	if(ctx->engine == EngineArray){
+		memcpy(values, ctx->topValues, ctx->listSize * sizeof(unsigned short int));
+		return ctx->listSize;
+	}
+
+	/*The heap only knows its smallest value, so sort a copy*/
+	if(ctx->engine == EngineHeap){
+		memcpy(values, ctx->topValues, ctx->listSize * sizeof(unsigned short int));
+		qsort(values, ctx->listSize, sizeof(unsigned short int), compareValues);
+		return ctx->listSize;
+	}
+
+	listIndex = ctx->listHead;
+	for(i = 0; i < ctx->listSize; i++){
+		values[i] = ctx->top.list[listIndex].value;
+		listIndex = ctx->top.list[listIndex].next;
+	}
+
+	return ctx->listSize;
+
+}
+
+
+/*This function finds the smallest value that is still in the running for the largest values*/
+int parserMaxThreshold(const parserCtx * ctx){
+
+#ifndef ParserStaticOnly
+	unsigned long seen;
+	int value;
+#endif
+
+	if(ctx->totalValueCount < (unsigned long)ctx->valuesToPrint){
+		return -1;
+	}
+
+#ifndef ParserStaticOnly
+	if(ctx->engine == EngineHistogram){
+		/*Walk down from the top until we have n values, same as histogramMaxValues*/
+		seen = 0;
+		value = ValueRange;
+		while(seen < (unsigned long)ctx->valuesToPrint){
+			value--;
+			seen += ctx->valueHistogram[value];
+		}
+		return value;
+	}
+#endif
+
+	return listPeek(ctx);
+
+}
+
+
+/*Copy the largest values out of the histogram, smallest to largest, exactly like the list would*/
+static int histogramMaxValues(const parserCtx * ctx, unsigned short int * values){
+
+	int count;
+#ifndef ParserStaticOnly
+	unsigned long wanted, seen, binCount, j;
+	int value;
+
+	/*If we read less than n values, we copy all of them*/
+	wanted = ctx->valuesToPrint;
+	if(ctx->totalValueCount < wanted){
+		wanted = ctx->totalValueCount;
+	}
+
+	/*Walk down from the top until we have seen enough values. value ends up at the smallest bin we need*/
+	seen = 0;
+	value = ValueRange;
+	while(seen < wanted){
+		value--;
+		seen += ctx->valueHistogram[value];
+	}
+
+	/*Only part of the smallest bin might make the cut*/
+	count = 0;
+	if(wanted > 0){
+		binCount = ctx->valueHistogram[value] - (seen - wanted);
+		for(j = 0; j < binCount; j++){
+			values[count++] = (unsigned short int)value;
+		}
+		value++;
+	}
+
+	/*Everything above it goes out in full*/
+	for(; value < ValueRange; value++){
+		for(j = 0; j < ctx->valueHistogram[value]; j++){
+			values[count++] = (unsigned short int)value;
+		}
+	}
+#else
+	(void)ctx;
+	(void)values;
+	count = 0;
+#endif
+
+	return count;
+
+}
+
+
+/*This function gets a snapshot ready to hold the results of ctx*/
+int parserSnapshotInit(parserSnapshot * snapshot, const parserCtx * ctx){
+	return parserSnapshotInitValues(snapshot, ctx->valuesToPrint);
+}
+
+
+/*This function gets a snapshot ready for any n values*/
+int parserSnapshotInitValues(parserSnapshot * snapshot, int valuesToPrint){
+
+	snapshot->valuesToPrint = valuesToPrint;
+	snapshot->totalValueCount = 0;
+	snapshot->maxCount = 0;
+	snapshot->lastCount = 0;
+	snapshot->hasSummary = 0;
+
+#ifdef ParserStaticOnly
+	snapshot->maxValues = &snapshot->maxStatic[0];
+	snapshot->lastValues = &snapshot->lastStatic[0];
+#else
+	/*Same deal as the circular buffer, small snapshots dont malloc*/
+	if(valuesToPrint <= NumberOfValuesToPrint){
+		snapshot->maxValues = &snapshot->maxStatic[0];
+		snapshot->lastValues = &snapshot->lastStatic[0];
+	}
+	else{
+		snapshot->maxValues = malloc(valuesToPrint * sizeof(unsigned short int));
+		snapshot->lastValues = malloc(valuesToPrint * sizeof(unsigned short int));
+		if(snapshot->maxValues == NULL || snapshot->lastValues == NULL){
+			free(snapshot->maxValues);
+			free(snapshot->lastValues);
+			snapshot->maxValues = &snapshot->maxStatic[0];
+			snapshot->lastValues = &snapshot->lastStatic[0];
+			return -1;
+		}
+	}
+#endif
+
+	return 0;
+
+}
+
+
+/*This function copies the current results out of ctx. ctx isnt touched, so feeding can carry on right after*/
+void parserTakeSnapshot(const parserCtx * ctx, parserSnapshot * snapshot){
+
+	snapshot->totalValueCount = ctx->totalValueCount;
+	snapshot->maxCount = parserMaxValues(ctx, snapshot->maxValues);
+	snapshot->lastCount = parserLastValues(ctx, snapshot->lastValues);
+	snapshot->hasSummary = (ctx->statsStripes != NULL);
+	parserGetSummary(ctx, &snapshot->summary);
+
+}
+
+
+/*This function frees anything parserSnapshotInit allocated*/
+void parserSnapshotFree(parserSnapshot * snapshot){
+
+	if(snapshot->maxValues != &snapshot->maxStatic[0]){
+		free(snapshot->maxValues);
+		free(snapshot->lastValues);
+	}
+	snapshot->maxValues = &snapshot->maxStatic[0];
+	snapshot->lastValues = &snapshot->lastStatic[0];
+
+}
+
+
+/*This function gets an empty partial ready. The embedded build doesnt have them, since they always malloc*/
+int parserPartialInit(parserPartial * partial, int valuesToPrint, int sampleBits, int hasStats){
+
+	memset(partial, 0x00, sizeof(parserPartial));
+	partial->valuesToPrint = valuesToPrint;
+	partial->sampleBits = sampleBits;
+
+#ifdef ParserStaticOnly
+	(void)hasStats;
+	return -1;
+#else
+	partial->maxValues = malloc(valuesToPrint * sizeof(unsigned short int));
+	partial->lastValues = malloc(valuesToPrint * sizeof(unsigned short int));
+	partial->scratchValues = malloc(valuesToPrint * sizeof(unsigned short int));
+	/*Every run has at least one value, so there cant be more runs than values*/
+	partial->runs = malloc(valuesToPrint * sizeof(parserTailRun));
+	partial->scratchRuns = malloc(valuesToPrint * sizeof(parserTailRun));
+	if(hasStats){
+		partial->statsBins = calloc(1UL << sampleBits, sizeof(unsigned long));
+	}
+	if(partial->maxValues == NULL || partial->lastValues == NULL || partial->scratchValues == NULL || partial->runs == NULL
+	   || partial->scratchRuns == NULL || (hasStats && partial->statsBins == NULL)){
+		parserPartialFree(partial);
+		return -1;
+	}
+
+	return 0;
+#endif
+
+}
+
+
+/*This function copies the results of ctx into the partial. The last values are one run at the end of the shard*/
+int parserPartialTake(const parserCtx * ctx, unsigned long firstValue, parserPartial * partial){
+
+	unsigned long bins, value;
+
+	if(ctx->channels != NULL || ctx->valuesToPrint != partial->valuesToPrint || ctx->sampleBits != partial->sampleBits
+	   || (ctx->statsStripes != NULL) != (partial->statsBins != NULL)){
+		return -1;
+	}
+
+	partial->firstValue = firstValue;
+	partial->endValue = firstValue + ctx->totalValueCount;
+	partial->totalValueCount = ctx->totalValueCount;
+	partial->maxCount = parserMaxValues(ctx, partial->maxValues);
+	partial->lastCount = parserLastValues(ctx, partial->lastValues);
+	partial->runCount = 0;
+	if(partial->lastCount > 0){
+		partial->runs[0].first = partial->endValue - partial->lastCount;
+		partial->runs[0].count = partial->lastCount;
+		partial->runCount = 1;
+	}
+
+	if(partial->statsBins != NULL){
+		bins = 1UL << ctx->sampleBits;
+		for(value = 0; value < bins; value++){
+			partial->statsBins[value] = binCount(ctx->statsTotals, ctx->statsStripes, bins, value);
+		}
+	}
+
+	return 0;
+
+}
+
+
+/*This function folds other into partial. Both sides are already sorted, so it's two merges from the top down*/
+int parserPartialMerge(parserPartial * partial, const parserPartial * other){
+
+	int count, taken, runCount, fromOther, a, b, aValues, bValues;
+	const parserTailRun * run;
+	const unsigned short int * values;
+	unsigned long bins, value, first, spanFirst, spanEnd;
+
+	if(other->valuesToPrint != partial->valuesToPrint || other->sampleBits != partial->sampleBits){
+		return -1;
+	}
+
+	/*Sides that dont share a value both fit in the stretch of the stream they cover together. A side that's one*/
+	/*shard has no gaps, so for two of those this catches every overlap, the same shard twice included*/
+	if(partial->totalValueCount > 0 && other->totalValueCount > 0){
+		spanFirst = (other->firstValue < partial->firstValue) ? other->firstValue : partial->firstValue;
+		spanEnd = (other->endValue > partial->endValue) ? other->endValue : partial->endValue;
+		if(partial->totalValueCount + other->totalValueCount > spanEnd - spanFirst){
+			return -2;
+		}
+	}
+
+	/*The max values: the largest of both, built from the back of the scratch. n of each side is plenty*/
+	count = partial->maxCount + other->maxCount;
+	if(count > partial->valuesToPrint){
+		count = partial->valuesToPrint;
+	}
+	a = partial->maxCount - 1;
+	b = other->maxCount - 1;
+	for(taken = count - 1; taken >= 0; taken--){
+		if(b < 0 || (a >= 0 && partial->maxValues[a] >= other->maxValues[b])){
+			partial->scratchValues[taken] = partial->maxValues[a--];
+		}
+		else{
+			partial->scratchValues[taken] = other->maxValues[b--];
+		}
+	}
+	memcpy(partial->maxValues, partial->scratchValues, count * sizeof(unsigned short int));
+	partial->maxCount = count;
+
+	/*The last values: whole runs from the newest down, whichever side's is further into the stream, until there are*/
+	/*n values. The oldest run taken might only be partly needed. Runs that end up touching become one*/
+	a = partial->runCount - 1;
+	b = other->runCount - 1;
+	aValues = partial->lastCount;
+	bValues = other->lastCount;
+	taken = 0;
+	runCount = 0;
+	while(taken < partial->valuesToPrint && (a >= 0 || b >= 0)){
+		fromOther = (a < 0 || (b >= 0 && other->runs[b].first > partial->runs[a].first));
+		if(fromOther){
+			run = &other->runs[b--];
+			values = &other->lastValues[bValues - run->count];
+			bValues -= run->count;
+		}
+		else{
+			run = &partial->runs[a--];
+			values = &partial->lastValues[aValues - run->count];
+			aValues -= run->count;
+		}
+
+		count = run->count;
+		if(count > partial->valuesToPrint - taken){
+			count = partial->valuesToPrint - taken;
+		}
+		first = run->first + (run->count - count);
+		taken += count;
+		memcpy(&partial->scratchValues[partial->valuesToPrint - taken], &values[run->count - count], count * sizeof(unsigned short int));
+
+		/*The runs get built from the back of the scratch too*/
+		if(runCount > 0 && first + count == partial->scratchRuns[partial->valuesToPrint - runCount].first){
+			partial->scratchRuns[partial->valuesToPrint - runCount].first = first;
+			partial->scratchRuns[partial->valuesToPrint - runCount].count += count;
+		}
+		else{
+			runCount++;
+			partial->scratchRuns[partial->valuesToPrint - runCount].first = first;
+			partial->scratchRuns[partial->valuesToPrint - runCount].count = count;
+		}
+	}
+	memcpy(partial->lastValues, &partial->scratchValues[partial->valuesToPrint - taken], taken * sizeof(unsigned short int));
+	memcpy(partial->runs, &partial->scratchRuns[partial->valuesToPrint - runCount], runCount * sizeof(parserTailRun));
+	partial->lastCount = taken;
+	partial->runCount = runCount;
+
+	/*The stats just add up. Without them on both sides there arent any*/
+	if(partial->statsBins != NULL && other->statsBins != NULL){
+		bins = 1UL << partial->sampleBits;
+		for(value = 0; value < bins; value++){
+			partial->statsBins[value] += other->statsBins[value];
+		}
+	}
+	else{
+		free(partial->statsBins);
+		partial->statsBins = NULL;
+	}
+
+	/*An empty side doesnt change where the stream starts or ends*/
+	if(other->totalValueCount > 0){
+		if(partial->totalValueCount == 0 || other->firstValue < partial->firstValue){
+			partial->firstValue = other->firstValue;
+		}
+		if(partial->totalValueCount == 0 || other->endValue > partial->endValue){
+			partial->endValue = other->endValue;
+		}
+	}
+	partial->totalValueCount += other->totalValueCount;
+
+	return 0;
+
+}
+
+
+/*This function copies the results of the partial into the snapshot*/
+void parserPartialSnapshot(const parserPartial * partial, parserSnapshot * snapshot){
+
+	snapshot->totalValueCount = partial->totalValueCount;
+	snapshot->maxCount = partial->maxCount;
+	memcpy(snapshot->maxValues, partial->maxValues, partial->maxCount * sizeof(unsigned short int));
+	snapshot->lastCount = partial->lastCount;
+	memcpy(snapshot->lastValues, partial->lastValues, partial->lastCount * sizeof(unsigned short int));
+
+	memset(&snapshot->summary, 0x00, sizeof(parserSummary));
+	snapshot->hasSummary = (partial->statsBins != NULL);
+	if(partial->statsBins != NULL){
+		summarizeBins(partial->statsBins, NULL, 1UL << partial->sampleBits, &snapshot->summary);
+	}
+
+}
+
+
+/*This function frees anything parserPartialInit allocated*/
+void parserPartialFree(parserPartial * partial){
+
+	free(partial->maxValues);
+	free(partial->lastValues);
+	free(partial->scratchValues);
+	free(partial->runs);
+	free(partial->scratchRuns);
+	free(partial->statsBins);
+	partial->maxValues = NULL;
+	partial->lastValues = NULL;
+	partial->scratchValues = NULL;
+	partial->runs = NULL;
+	partial->scratchRuns = NULL;
+	partial->statsBins = NULL;
+
+}
+
+
+/*This function removes the value at the head of the list.*/
+static int listRemove(parserCtx * ctx){
+
+	int index;
+	/*Store it so we can return it*/
+	index = ctx->listHead;
+	/*Update the new list head, which is the second smallest value in the list*/
+	ctx->listHead = ctx->top.list[ctx->listHead].next;
+	/*Clean up the struct at the old index*/
+	ctx->top.list[index].next = -1;
+	ctx->listSize--;
+
+	/*With n = 1 the list is now empty. Point the head at the free node so the insert treats it like the first one*/
+	if(ctx->listHead == -1){
+		ctx->listHead = index;
+	}
+
+	return index;
+
+}
+
+
+/*Simple helper function to keep the code clean. The smallest value is at the front of the heap & the array too*/
+static unsigned short int listPeek(const parserCtx * ctx){
+	return (ctx->engine == EngineList) ? ctx->top.list[ctx->listHead].value : ctx->topValues[0];
+}
+
+
+/*This function inserts the value into the sorted array only if it is necessary, just like listInsert*/
+static void arrayInsert(parserCtx * ctx, unsigned short int value){
+
+	unsigned short int * sorted;
+	int below;
+
+	sorted = ctx->topValues;
+
+	/*Same rule as the list: once it's full, it has to beat the smallest value*/
+	if(ctx->listSize == ctx->valuesToPrint && value <= sorted[0]){
+#ifdef ParserInstrument
+		ctx->counters.listRejects++;
+#endif
+		return;
+	}
+
+	/*Everything smaller than the new value comes before it, so it goes in front of any equal values. They're all the same number, so that never shows*/
+	below = countBelow(sorted, ctx->listSize, value);
+
+	if(ctx->listSize == ctx->valuesToPrint){
+		/*The smallest value falls off the front & the ones below the new value move down a slot to make room*/
+		/*It beat sorted[0], so below is at least 1*/
+		memmove(&sorted[0], &sorted[1], (below - 1) * sizeof(unsigned short int));
+		sorted[below - 1] = value;
+	}
+	else{
+		/*Still filling up: the bigger ones move up a slot instead*/
+		memmove(&sorted[below + 1], &sorted[below], (ctx->listSize - below) * sizeof(unsigned short int));
+		sorted[below] = value;
+		ctx->listSize++;
+	}
+
+#ifdef ParserInstrument
+	ctx->counters.listAccepts++;
+	ctx->counters.listSteps += below;
+#endif
+
+}
+
+
+/*This function inserts the value into the heap only if it is necessary, just like listInsert*/
+static void heapInsert(parserCtx * ctx, unsigned short int value){
+
+	unsigned short int * heap;
+	int index, parent, child, last, smallest;
+
+	heap = ctx->topValues;
+
+	/*Not full yet: put it at the bottom & move it up past anything bigger*/
+	if(ctx->listSize < ctx->valuesToPrint){
+		index = ctx->listSize++;
+		while(index > 0){
+			parent = (index - 1) / HeapArity;
+			if(heap[parent] <= value){
+				break;
+			}
+			heap[index] = heap[parent];
+			index = parent;
+		}
+		heap[index] = value;
+#ifdef ParserInstrument
+		ctx->counters.listAccepts++;
+#endif
+		return;
+	}
+
+	/*Same rule as the list: it has to beat the smallest value*/
+	if(value <= heap[0]){
+#ifdef ParserInstrument
+		ctx->counters.listRejects++;
+#endif
+		return;
+	}
+#ifdef ParserInstrument
+	ctx->counters.listAccepts++;
+#endif
+
+	/*Throw out the smallest value & move the new one down until none of its children are smaller*/
+	index = 0;
+	for(;;){
+
+		child = index * HeapArity + 1;
+		if(child >= ctx->listSize){
+			break;
+		}
+		last = child + HeapArity;
+		if(last > ctx->listSize){
+			last = ctx->listSize;
+		}
+
+		/*All of the children are next to each other, so this is one short scan*/
+		for(smallest = child++; child < last; child++){
+			if(heap[child] < heap[smallest]){
+				smallest = child;
+			}
+		}
+		if(heap[smallest] >= value){
+			break;
+		}
+
+		heap[index] = heap[smallest];
+		index = smallest;
+#ifdef ParserInstrument
+		ctx->counters.listSteps++;
+#endif
+
+	}
+	heap[index] = value;
+
+}
+
+
+/*This function turns the list into a heap. The list shares its bytes with the heap, so it goes through a copy*/
+static void listToHeap(parserCtx * ctx){
+
+	unsigned short int sorted[NumberOfValuesToPrint];
+	int count;
+
+	count = parserMaxValues(ctx, &sorted[0]);
+
+	/*Smallest to largest is already a valid min heap*/
+	ctx->engine = EngineHeap;
+	memcpy(ctx->topValues, &sorted[0], count * sizeof(unsigned short int));
+	ctx->listSize = count;
+
+}
+
+
+#ifndef ParserStaticOnly
+/*This function moves the heap into the histogram. Nothing that was thrown out could still make the cut, so the*/
+/*histogram only needs the n values in the heap to give the same results from here on*/
+static void heapToHistogram(parserCtx * ctx){
+
+	int i;
+
+	for(i = 0; i < ctx->listSize; i++){
+		ctx->valueHistogram[ctx->topValues[i]]++;
+	}
+
+	ctx->engine = EngineHistogram;
+	ctx->adaptive = 0;
+	ctx->listSize = 0;
+
+}
+#endif
+
+
+/*qsort helper for sorting the heap*/
+static int compareValues(const void * a, const void * b){
+	return (int)*(const unsigned short int *)a - (int)*(const unsigned short int *)b;
+}
+
+
+#ifdef ParserInstrument
+/*Simple helper function to keep the code clean*/
+double parserClock(void){
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+
+}
+#endif
@@ -0,0 +1,317 @@
+/* ##################################
+   Data Structures
+   ################################## */
+
+/*size_t*/
+#include <stddef.h>
+
+#define Lower12BitMask 0xFFF
+/*Number of different values a 12 bit sample can have*/
+#define ValueRange 4096
+/*Default for how many values we print. Also the size of the statically allocated list & buffer*/
+#define NumberOfValuesToPrint 32
+/*Upper limit for the number of values, so the buffer size cant overflow an int*/
+#define MaxValuesToPrint (1 << 24)
+/*How many 24 bit pairs get unpacked at once before the values are stored*/
+#define DecodeBatchPairs 2048
+/*Biggest piece of input decodeBlock gets at once. A multiple of 3, and trimmed to whole groups for other widths*/
+#define MaxDecodeBlockSize (3 * 1048576)
+/*Samples are 12 bits unless parserSetSampleBits says otherwise (10 or 14)*/
+#define DefaultSampleBits 12
+/*Biggest group of whole bytes holding whole samples: 4 x 14 bits = 7 bytes*/
+#define MaxGroupBytes 7
+/*Most interleaved channels one stream can have (parserSetChannels)*/
+#define MaxChannels 16
+/*The stats histogram (parserEnableStats) is this many histograms side by side, value i of a batch going to i % 4*/
+#define StatsStripes 4
+/*...with 32 bit counts, which get folded into the 64 bit totals at least this often*/
+#define StatsFlushValues (1UL << 30)
+
+/*
+ * Build with -DParserStaticOnly for the embedded version: no histogram (saves 32 KiB per context),
+ * no malloc, and at most NumberOfValuesToPrint values. Everything then lives inside the parserCtx.
+ */
+
+/*
+ * Build with -DParserInstrument to count & time what the parser does (see parserCounters).
+ * Without it none of the counting code is even compiled in.
+ */
+
+#ifdef ParserInstrument
+/*What one context has done so far. Merged contexts add up, so the times are the sum over all threads*/
+typedef struct{
+	/*Seconds spent unpacking & storing the last values, and keeping track of the largest values*/
+	double decodeSeconds;
+	double topSeconds;
+	/*listInsert calls that changed the list, and ones that returned right away*/
+	unsigned long listAccepts;
+	unsigned long listRejects;
+	/*Nodes walked to find the spot for every accepted value*/
+	unsigned long listSteps;
+	/*Values the filter kernel skipped without calling listInsert at all*/
+	unsigned long filterSkips;
+}parserCounters;
+#endif
+
+/*This is the node for the statically allocated linked list*/
+/*The next ptr is actually just the index of the next node, since they're all in an array*/
+typedef struct{
+	unsigned short int value;
+	int next;
+}listNode;
+
+/*Which data structure keeps track of the largest values*/
+typedef enum{
+	EngineAuto = 0,
+	EngineList,
+	EngineHistogram,
+	EngineHeap,
+	EngineArray
+}maxValueEngine;
+
+/*The heap & the sorted array keep bare values in the same bytes as the list nodes, so that many fit without a malloc*/
+#define TopStaticValues (NumberOfValuesToPrint * sizeof(listNode) / sizeof(unsigned short int))
+/*Children per heap node. 4 uint16s are only 8 bytes, so the children of a node (nearly always) share a cache line*/
+#define HeapArity 4
+/*With EngineAuto the list turns into a heap once more than 1 in this many values of a batch make it in*/
+#define HeapSwitchRate 64
+/*...and the heap turns into the histogram once more than 1 in this many do*/
+#define HistogramSwitchRate 16
+
+/*Everything we know about one stream of values. Nothing is shared between contexts*/
+typedef struct parserCtx{
+
+	/*How many values we print & which engine keeps track of the largest ones*/
+	int valuesToPrint;
+	maxValueEngine engine;
+	/*What parserInit was asked for, so other contexts for the same stream can be set up the same way*/
+	maxValueEngine requestedEngine;
+	/*Set if the list (or heap) should change engines when too many values make it in (EngineAuto)*/
+	int adaptive;
+
+	/*List for storing the 32 largest values*/
+	/*We will maintain it from smallest to largest. (Head pointer is always the smallest value.)*/
+	/*The heap engine uses the same bytes as an implicit 4-ary min heap, smallest value at heap[0]*/
+	/*The array engine uses them as a plain sorted array, smallest to largest*/
+	union{
+		listNode list[NumberOfValuesToPrint];
+		unsigned short int heap[TopStaticValues];
+	}top;
+	/*The heap or the array. Points at top.heap, unless valuesToPrint is too big for it and we had to malloc a bigger heap*/
+	unsigned short int * topValues;
+	/*Keep track of the size of the list (or heap) so we know if it is full or not*/
+	int listSize;
+	/*Keep track of the index of the head of the list.*/
+	int listHead;
+
+#ifndef ParserStaticOnly
+	/*Count of every value that we have read. Only used by the histogram engine*/
+	unsigned long valueHistogram[ValueRange];
+#endif
+
+	/*Circular buffer for maintaining last 32 values*/
+	unsigned short int lastValuesStatic[NumberOfValuesToPrint];
+	/*Points at lastValuesStatic, unless valuesToPrint is too big for it and we had to malloc a bigger one*/
+	unsigned short int * lastValuesBuffer;
+	/*Write ptr for the circular buffer*/
+	int lastValuesWriteIdx;
+	/*valuesToPrint - 1 if valuesToPrint is a power of two, so we can wrap with a mask. -1 otherwise*/
+	int lastValuesMask;
+
+	/*Total # of values that we have read. Multi-GB files overflow an int, so this is a long*/
+	unsigned long totalValueCount;
+
+	/*How wide the samples are & how they're grouped: groupValues values in groupBytes bytes (2 in 3 for 12 bits)*/
+	int sampleBits;
+	int groupValues;
+	int groupBytes;
+	/*The unrolled kernel for other widths (see unpackWidthKernel). NULL for 12 bits, which uses unpack12Pairs*/
+	void (*unpackGroups)(const unsigned char * in, int groupCount, unsigned short int * out);
+
+	/*Interleaved streams: value i goes to channels[i % channelCount], each with its own results. NULL for one channel*/
+	struct parserCtx * channels;
+	int channelCount;
+	/*Which channel the next value goes to*/
+	int nextChannel;
+
+	/*Every value we have read, counted by value (parserEnableStats). NULL unless somebody asked for the stats*/
+	/*statsStripes are StatsStripes histograms of 1 << sampleBits bins each, statsTotals what was folded out of them*/
+	unsigned int * statsStripes;
+	unsigned long * statsTotals;
+	/*Values counted in the stripes since they were last folded into the totals*/
+	unsigned long statsPending;
+
+	/*The start of a 24 bit pair (or group) that was split across two calls to parserFeed*/
+	unsigned char carry[MaxGroupBytes];
+	int carryLength;
+	/*Bytes at the end of the stream that didnt hold a whole value, so parserFinish had to drop them (1 for 12 bits)*/
+	int truncatedBytes;
+
+	/*The unpack kernel writes a batch of values here*/
+	unsigned short int decodedValues[DecodeBatchPairs * 2];
+
+#ifdef ParserInstrument
+	parserCounters counters;
+#endif
+
+}parserCtx;
+
+/*Summary stats of every value read, worked out of the stats histogram. The percentiles are exact (nearest rank)*/
+typedef struct{
+	unsigned long count;
+	unsigned short int min;
+	unsigned short int max;
+	double mean;
+	/*Population variance*/
+	double variance;
+	unsigned short int p50;
+	unsigned short int p99;
+	unsigned short int p999;
+}parserSummary;
+
+/*A copy of the results of a context at some point in the stream*/
+typedef struct{
+	int valuesToPrint;
+	unsigned long totalValueCount;
+	/*Largest values, smallest to largest*/
+	int maxCount;
+	unsigned short int * maxValues;
+	/*Last values, oldest to newest*/
+	int lastCount;
+	unsigned short int * lastValues;
+	/*Set (& summary filled in) if the context keeps stats*/
+	int hasSummary;
+	parserSummary summary;
+	/*Small snapshots dont need to malloc*/
+	unsigned short int maxStatic[NumberOfValuesToPrint];
+	unsigned short int lastStatic[NumberOfValuesToPrint];
+}parserSnapshot;
+
+/*Values first ... first + count - 1 of the whole stream, all in a row*/
+typedef struct{
+	unsigned long first;
+	int count;
+}parserTailRun;
+
+/*
+ * The results of one shard of a stream (parserPartialTake), which can be merged with the results of any other
+ * shards in any order (parserPartialMerge). Offsets are value positions in the whole stream, so the last values
+ * come out right however the shards were grouped. The shards just cant overlap.
+ */
+typedef struct{
+	int valuesToPrint;
+	int sampleBits;
+	/*Offset of the first value, one past the last value & how many values there were in between*/
+	unsigned long firstValue;
+	unsigned long endValue;
+	unsigned long totalValueCount;
+	/*Largest values, smallest to largest*/
+	int maxCount;
+	unsigned short int * maxValues;
+	/*Last values, oldest to newest, and which offsets they came from (a run per shard they span)*/
+	int lastCount;
+	unsigned short int * lastValues;
+	int runCount;
+	parserTailRun * runs;
+	/*Count of every value, 1 << sampleBits bins. NULL if any of the shards didnt keep stats*/
+	unsigned long * statsBins;
+	/*Room for parserPartialMerge to build the results in*/
+	unsigned short int * scratchValues;
+	parserTailRun * scratchRuns;
+}parserPartial;
+
+/* ###################
+   Function Prototypes
+   ################### */
+
+/*Get a context ready for a new stream. EngineAuto picks the list for small counts & the heap otherwise*/
+/*Those get swapped for the heap (or the histogram) on the fly if it turns out too many values make it in*/
+/*Returns -1 if the engine cant handle that many values or the buffer cant be allocated*/
+int parserInit(parserCtx * ctx, int valuesToPrint, maxValueEngine engine);
+
+/*Switch to bits wide samples (10, 12 or 14) before the first feed. Returns -1 for other widths, for more than*/
+/*12 bits with the histogram engine, which only has a bin for every 12 bit value, and once the stats are on*/
+int parserSetSampleBits(parserCtx * ctx, int bits);
+
+/*Get ctx ready for a new stream with exactly the settings of model (n, engine, width, stats & channels)*/
+/*Returns -1 if anything cant be allocated*/
+int parserInitLike(parserCtx * ctx, const parserCtx * model);
+
+/*Count every value by value from now on, for parserGetSummary (after parserSetSampleBits & before parserSetChannels)*/
+/*Returns -1 if the histogram cant be allocated (the embedded build never mallocs, so always there)*/
+int parserEnableStats(parserCtx * ctx);
+
+/*Work out min, max, mean, variance & the percentiles of every value so far. All zero if stats arent on*/
+void parserGetSummary(const parserCtx * ctx, parserSummary * summary);
+
+/*Split the stream into channelCount interleaved channels (after parserSetSampleBits). Their results are in*/
+/*ctx->channels[0 .. channelCount - 1], ctx itself only counts the values. Returns -1 if they cant be allocated*/
+/*(the embedded build never mallocs, so it only takes 1)*/
+int parserSetChannels(parserCtx * ctx, int channelCount);
+
+/*Decode the next length bytes of the stream. They dont have to end on a pair boundary*/
+void parserFeed(parserCtx * ctx, const unsigned char * bytes, size_t length);
+
+/*Part of the stream is missing, e.g. a block that failed its checksum. Drops any partial pair carried over, so*/
+/*the bytes after the gap dont get glued to the ones before it, and moves the channels on past valueCount values*/
+void parserSkip(parserCtx * ctx, unsigned long valueCount);
+
+/*Store count already decoded values (each less than ValueRange), as if they had come out of the stream*/
+void parserFeedValues(parserCtx * ctx, const unsigned short int * values, int count);
+
+/*The stream is over. Decodes whatever partial pair is left, exactly like the end of a file*/
+void parserFinish(parserCtx * ctx);
+
+/*Forget everything we've read, but keep the settings (and the buffer) for the next stream*/
+void parserReset(parserCtx * ctx);
+
+/*Free anything parserInit allocated*/
+void parserDestroy(parserCtx * ctx);
+
+/*Fold the results of other into ctx, as if other's stream came right after ctx's*/
+void parserMerge(parserCtx * ctx, const parserCtx * other);
+
+/*Copy the last values read into values (room for n), oldest first. Returns how many there were*/
+int parserLastValues(const parserCtx * ctx, unsigned short int * values);
+
+/*Copy the largest values into values (room for n), smallest first. Returns how many there were*/
+int parserMaxValues(const parserCtx * ctx, unsigned short int * values);
+
+/*The smallest of the largest values, i.e. what a new value has to beat to make the cut*/
+/*Returns -1 while fewer than n values have been stored, since then everything makes it*/
+int parserMaxThreshold(const parserCtx * ctx);
+
+/*Get a snapshot ready to hold the results of ctx. Returns -1 if it cant be allocated*/
+int parserSnapshotInit(parserSnapshot * snapshot, const parserCtx * ctx);
+
+/*Same, for n values without a context, e.g. for the results of a partial*/
+int parserSnapshotInitValues(parserSnapshot * snapshot, int valuesToPrint);
+
+/*Copy the current results of ctx into the snapshot. Feeding can carry on right after*/
+void parserTakeSnapshot(const parserCtx * ctx, parserSnapshot * snapshot);
+
+/*Free anything parserSnapshotInit allocated*/
+void parserSnapshotFree(parserSnapshot * snapshot);
+
+/*Get a partial ready for the results of a stream of bits wide samples, with or without the stats histogram*/
+/*Returns -1 if it cant be allocated (the embedded build never mallocs, so always)*/
+int parserPartialInit(parserPartial * partial, int valuesToPrint, int sampleBits, int hasStats);
+
+/*Copy the results of ctx into a partial from parserPartialInit with the same n, width & stats, as a shard that*/
+/*starts at value firstValue of the whole stream. Returns -1 if ctx has channels or the settings dont match*/
+int parserPartialTake(const parserCtx * ctx, unsigned long firstValue, parserPartial * partial);
+
+/*Fold other into partial. The order doesnt matter, and neither does how the earlier merges were grouped*/
+/*Returns -1 (and leaves partial alone) if n or the sample width dont match, -2 if the two cover some of the same values*/
+int parserPartialMerge(parserPartial * partial, const parserPartial * other);
+
+/*Copy the results of a partial into a snapshot from parserSnapshotInit, for writing them out*/
+void parserPartialSnapshot(const parserPartial * partial, parserSnapshot * snapshot);
+
+/*Free anything parserPartialInit allocated*/
+void parserPartialFree(parserPartial * partial);
+
+#ifdef ParserInstrument
+/*Seconds since some fixed point, for the stage timers*/
+double parserClock(void);
+#endif
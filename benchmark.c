@@ -0,0 +1,584 @@
+/*clock_gettime & getopt arent part of C89*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "unpack12.h"
+#include "accParser.h"
+#include "bufferRing.h"
+#include "benchmark.h"
+
+
+
+/***********************************************************************************************************************************
+ Benchmark for the decode kernels & the max value engines.
+
+ The notes at the top of binaryParser.c argue about linked list vs heap, histograms & read sizes, but none of that
+ means much without numbers. This makes a synthetic packed 12 bit input in memory (so the disk isnt part of it) &
+ times every piece of the parser on it:
+
+   decode - unpack12Pairs over the whole input, for every kernel this cpu has
+   filter - firstAboveThreshold scanning the decoded values against the final threshold of the list, i.e. what the
+            list engine does for almost every value once it's full
+   list   - a whole parse with the linked list (only up to 32 values)
+   hist   - a whole parse with the histogram
+   heap   - a whole parse with the 4-ary heap
+   array  - a whole parse with the sorted array (only up to 128 values)
+   auto   - a whole parse with EngineAuto (the list, turning into the heap if too many values make it in)
+   spsc   - descriptors through the -a pipeline's SPSC ring, 1 producer & 1 consumer
+   mpmc   - descriptors through the MPMC ring, several producers (fan in) & several consumers. Besides the time,
+            this checks every descriptor came out exactly once & in order per producer, which is the only thing
+            that runs the CAS & sequence # logic with more than one thread on a side. A failed check fails the run
+
+ Every measurement runs -r times & the fastest run is reported as MB/s of packed input & ns per value.
+ The data is made from a fixed seed, so runs on different builds see exactly the same values.
+ -o also writes the packed data to a file, so the same input can be fed to binaryParser.
+
+ Build:
+   gcc -O2 -ansi -pedantic -Wall -o benchmark benchmark.c accParser.c unpack12.c bufferRing.c -I ./ -pthread
+
+ ***********************************************************************************************************************************/
+
+
+
+static const char * distributionNames[DistributionCount] = {"uniform", "asc", "desc", "spiky"};
+
+
+int main(int argc, char * argv[]){
+
+	benchData data;
+	unsigned long megabytes, checksum;
+	int option, repeats, valuesToPrint, kernel, threshold, distribution, ring, failed;
+	double seconds;
+	const char * outputPath;
+	FILE * outputFile;
+
+	megabytes = BenchDefaultMegabytes;
+	repeats = BenchDefaultRepeats;
+	valuesToPrint = NumberOfValuesToPrint;
+	distribution = DistributionUniform;
+	outputPath = NULL;
+
+	while((option = getopt(argc, argv, "m:d:n:r:o:")) != -1){
+		switch(option){
+			case 'm':
+				megabytes = strtoul(optarg, NULL, 10);
+				if(megabytes == 0){
+					printf("-m needs a size in MiB bigger than 0.\n");
+					return -1;
+				}
+				break;
+			case 'd':
+				distribution = benchDistributionByName(optarg);
+				if(distribution < 0){
+					printf("Unknown distribution %s. Use uniform, asc, desc or spiky.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'n':
+				valuesToPrint = atoi(optarg);
+				if(valuesToPrint <= 0 || valuesToPrint > MaxValuesToPrint){
+					printf("-n has to be between 1 and %d.\n", MaxValuesToPrint);
+					return -1;
+				}
+				break;
+			case 'r':
+				repeats = atoi(optarg);
+				if(repeats <= 0){
+					printf("-r has to be at least 1.\n");
+					return -1;
+				}
+				break;
+			case 'o':
+				outputPath = optarg;
+				break;
+			default:
+				printf("Usage: %s [-m <MiB>] [-d <uniform|asc|desc|spiky>] [-n <values>] [-r <repeats>] [-o <packed output>]\n", argv[0]);
+				return -1;
+		}
+	}
+
+	/*Two values per 3 bytes*/
+	if(benchGenerate(&data, (size_t)megabytes * 1048576 / 3 * 2, (benchDistribution)distribution, 12345) != 0){
+		printf("Couldnt allocate %lu MiB of test data.\n", megabytes);
+		return -1;
+	}
+
+	if(outputPath != NULL){
+		outputFile = fopen(outputPath, "wb");
+		if(outputFile == NULL || fwrite(data.packed, 1, data.packedLength, outputFile) != data.packedLength || fclose(outputFile) != 0){
+			printf("Couldnt write %s.\n", outputPath);
+			benchFree(&data);
+			return -1;
+		}
+	}
+
+	printf("%lu MiB, %lu values, %s, n = %d, best of %d\n", megabytes, (unsigned long)data.valueCount,
+		distributionNames[distribution], valuesToPrint, repeats);
+	printf("%-8s %-8s %12s %12s\n", "what", "kernel", "MB/s", "ns/value");
+
+	/*Only the threshold of a full list is worth filtering against, so get it from a list parse first*/
+	unpackSelect(UnpackScalar);
+	threshold = -1;
+	benchParse(&data, 1, (valuesToPrint <= NumberOfValuesToPrint) ? valuesToPrint : NumberOfValuesToPrint, EngineList, &threshold);
+
+	checksum = 0;
+	for(kernel = UnpackScalar; kernel < UnpackKernelCount; kernel++){
+
+		if(unpackSelect((unpackKernelId)kernel) != 0){
+			continue;
+		}
+
+		benchReport("decode", unpackKernelName(), benchDecode(&data, repeats, &checksum), &data);
+		if(threshold >= 0){
+			benchReport("filter", unpackKernelName(), benchFilter(&data, repeats, (unsigned short int)threshold, &checksum), &data);
+		}
+		benchReport("crc32c", unpackKernelName(), benchCrc(&data, repeats, &checksum), &data);
+
+		/*The list uses the filter kernel too, so it gets timed with every kernel. -1 means it cant do this n*/
+		seconds = benchParse(&data, repeats, valuesToPrint, EngineList, NULL);
+		if(seconds >= 0){
+			benchReport("list", unpackKernelName(), seconds, &data);
+		}
+		seconds = benchParse(&data, repeats, valuesToPrint, EngineHistogram, NULL);
+		if(seconds >= 0){
+			benchReport("hist", unpackKernelName(), seconds, &data);
+		}
+		seconds = benchParse(&data, repeats, valuesToPrint, EngineHeap, NULL);
+		if(seconds >= 0){
+			benchReport("heap", unpackKernelName(), seconds, &data);
+		}
+		seconds = benchParse(&data, repeats, valuesToPrint, EngineArray, NULL);
+		if(seconds >= 0){
+			benchReport("array", unpackKernelName(), seconds, &data);
+		}
+		seconds = benchParse(&data, repeats, valuesToPrint, EngineAuto, NULL);
+		if(seconds >= 0){
+			benchReport("auto", unpackKernelName(), seconds, &data);
+		}
+
+	}
+
+	/*Printing it means the compiler cant throw the decode & filter loops away*/
+	printf("checksum %lu\n", checksum);
+
+	/*The rings dont look at the data, so they get their own table: millions of descriptors a second & ns per descriptor*/
+	printf("%-8s %-8s %12s %12s\n", "ring", "threads", "Mdesc/s", "ns/desc");
+	failed = 0;
+	for(ring = 0; ring < 3; ring++){
+		if(benchRing(ring > 0, (ring > 0) ? 4 : 1, (ring > 1) ? 4 : 1, &seconds) != 0){
+			printf("%s ring lost, repeated or reordered descriptors!\n", (ring > 0) ? "mpmc" : "spsc");
+			failed = -1;
+			continue;
+		}
+		if(seconds <= 0){
+			seconds = 1e-9;
+		}
+		printf("%-8s %-8s %12.1f %12.3f\n", (ring > 0) ? "mpmc" : "spsc", (ring > 1) ? "4x4" : ((ring > 0) ? "4x1" : "1x1"),
+			(double)BenchRingDescriptors / seconds / 1e6, seconds * 1e9 / (double)BenchRingDescriptors);
+	}
+
+	benchFree(&data);
+
+	return failed;
+
+}
+
+
+/*This function makes the values with a small xorshift generator & packs them with the scalar kernel*/
+int benchGenerate(benchData * data, size_t valueCount, benchDistribution distribution, unsigned long seed){
+
+	size_t i;
+	unsigned long state;
+	unsigned short int value;
+
+	/*Room for one more value, so an odd count still packs as whole pairs*/
+	data->valueCount = valueCount;
+	data->packedLength = (valueCount / 2) * 3 + ((valueCount & 1) ? 2 : 0);
+	data->values = malloc((valueCount + 1) * sizeof(unsigned short int));
+	data->packed = malloc((valueCount / 2 + 1) * 3);
+	if(data->values == NULL || data->packed == NULL){
+		benchFree(data);
+		return -1;
+	}
+
+	state = seed | 1;
+	for(i = 0; i < valueCount; i++){
+
+		/*xorshift32, masked so it behaves the same with a 64 bit long*/
+		state ^= (state << 13) & 0xFFFFFFFF;
+		state ^= state >> 17;
+		state ^= (state << 5) & 0xFFFFFFFF;
+
+		switch(distribution){
+			case DistributionAscending:
+				value = (unsigned short int)((double)i * ValueRange / valueCount);
+				break;
+			case DistributionDescending:
+				value = (unsigned short int)(Lower12BitMask - (unsigned short int)((double)i * ValueRange / valueCount));
+				break;
+			case DistributionSpiky:
+				/*About one in a thousand values is a spike*/
+				value = (unsigned short int)(((state >> 8) % 1000 == 0) ? (state & Lower12BitMask) : (state & 0xFF));
+				break;
+			default:
+				value = (unsigned short int)(state & Lower12BitMask);
+				break;
+		}
+		data->values[i] = value;
+
+	}
+	data->values[valueCount] = 0;
+
+	unpackSelect(UnpackScalar);
+	pack12Pairs(data->values, (int)((valueCount + 1) / 2), data->packed);
+
+	return 0;
+
+}
+
+
+/*This function frees the generated data*/
+void benchFree(benchData * data){
+
+	free(data->values);
+	free(data->packed);
+	data->values = NULL;
+	data->packed = NULL;
+
+}
+
+
+/*Simple lookup so the distribution can be picked from the cmd line*/
+int benchDistributionByName(const char * name){
+
+	int i;
+
+	for(i = 0; i < DistributionCount; i++){
+		if(strcmp(name, distributionNames[i]) == 0){
+			return i;
+		}
+	}
+
+	return -1;
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+double benchNow(void){
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+
+}
+
+
+/*This function unpacks the input a batch at a time, the same way decodeBlock does*/
+double benchDecode(const benchData * data, int repeats, unsigned long * checksum){
+
+	unsigned short int decoded[BenchBatchPairs * 2];
+	size_t pairs, done;
+	int run, batch;
+	double start, seconds, best;
+
+	pairs = data->valueCount / 2;
+	best = -1;
+	for(run = 0; run < repeats; run++){
+
+		start = benchNow();
+		for(done = 0; done < pairs; done += batch){
+			batch = (pairs - done > BenchBatchPairs) ? BenchBatchPairs : (int)(pairs - done);
+			unpack12Pairs(&data->packed[done * 3], batch, decoded);
+			*checksum += decoded[batch * 2 - 1];
+		}
+		seconds = benchNow() - start;
+
+		if(best < 0 || seconds < best){
+			best = seconds;
+		}
+
+	}
+
+	return best;
+
+}
+
+
+/*This function checksums the packed input the way -e framed checks its blocks*/
+double benchCrc(const benchData * data, int repeats, unsigned long * checksum){
+
+	size_t done, length;
+	int run;
+	double start, seconds, best;
+
+	best = -1;
+	for(run = 0; run < repeats; run++){
+
+		start = benchNow();
+		for(done = 0; done < data->packedLength; done += length){
+			length = (data->packedLength - done > BenchCrcBlock) ? BenchCrcBlock : data->packedLength - done;
+			*checksum += crc32c(0, &data->packed[done], length);
+		}
+		seconds = benchNow() - start;
+
+		if(best < 0 || seconds < best){
+			best = seconds;
+		}
+
+	}
+
+	return best;
+
+}
+
+
+/*This function scans all of the values for ones above threshold, like the list engine does between inserts*/
+double benchFilter(const benchData * data, int repeats, unsigned short int threshold, unsigned long * checksum){
+
+	size_t done;
+	int run, batch, found;
+	double start, seconds, best;
+
+	best = -1;
+	for(run = 0; run < repeats; run++){
+
+		start = benchNow();
+		for(done = 0; done < data->valueCount; done += batch){
+			batch = (data->valueCount - done > BenchBatchPairs * 2) ? BenchBatchPairs * 2 : (int)(data->valueCount - done);
+			/*Keep going after every hit, like insertValues does*/
+			for(found = 0; found < batch; found++){
+				found += firstAboveThreshold(&data->values[done + found], batch - found, threshold);
+				*checksum += found;
+			}
+		}
+		seconds = benchNow() - start;
+
+		if(best < 0 || seconds < best){
+			best = seconds;
+		}
+
+	}
+
+	return best;
+
+}
+
+
+/*This function runs the input through a fresh context, from parserInit to parserFinish*/
+double benchParse(const benchData * data, int repeats, int valuesToPrint, maxValueEngine engine, int * threshold){
+
+	parserCtx * ctx;
+	unsigned short int * maxValues;
+	int run;
+	double start, seconds, best;
+
+	/*A context is ~50 KiB with the histogram, too big for some stacks*/
+	ctx = malloc(sizeof(parserCtx));
+	maxValues = malloc(valuesToPrint * sizeof(unsigned short int));
+	if(ctx == NULL || maxValues == NULL){
+		free(ctx);
+		free(maxValues);
+		return -1;
+	}
+
+	best = -1;
+	for(run = 0; run < repeats; run++){
+
+		if(parserInit(ctx, valuesToPrint, engine) != 0){
+			break;
+		}
+
+		/*Getting the max values out is part of the cost, the histogram walk especially*/
+		start = benchNow();
+		parserFeed(ctx, data->packed, data->packedLength);
+		parserFinish(ctx);
+		parserMaxValues(ctx, maxValues);
+		seconds = benchNow() - start;
+
+		if(threshold != NULL){
+			*threshold = parserMaxThreshold(ctx);
+		}
+		parserDestroy(ctx);
+
+		if(best < 0 || seconds < best){
+			best = seconds;
+		}
+
+	}
+
+	free(ctx);
+	free(maxValues);
+
+	return best;
+
+}
+
+
+/*This function runs the producers & consumers, then ends the consumers with a -1 each once every producer is done*/
+/*The ends go in after every item, so by the time a consumer pops one everything before it has been taken*/
+int benchRing(int mpmc, int producers, int consumers, double * seconds){
+
+	spscRing spsc;
+	mpmcRing ring;
+	benchRingThread threads[BenchRingMaxThreads * 2];
+	bufferDescriptor end;
+	unsigned long count, i;
+	unsigned char * seen;
+	double start;
+	int t, failed;
+
+	count = BenchRingDescriptors / (unsigned long)producers;
+	seen = calloc(count * (unsigned long)producers, 1);
+	if(seen == NULL){
+		return -1;
+	}
+	if((mpmc ? mpmcInit(&ring, BenchRingCapacity) : spscInit(&spsc, BenchRingCapacity)) != 0){
+		free(seen);
+		return -1;
+	}
+
+	for(t = 0; t < producers + consumers; t++){
+		threads[t].spsc = mpmc ? NULL : &spsc;
+		threads[t].mpmc = mpmc ? &ring : NULL;
+		threads[t].id = (t < producers) ? t : t - producers;
+		threads[t].count = count;
+		threads[t].producers = producers;
+		threads[t].seen = seen;
+		threads[t].failed = 0;
+	}
+
+	/*A thread that doesnt start would leave the others waiting forever, so that ends the whole benchmark*/
+	failed = 0;
+	start = benchNow();
+	for(t = 0; t < producers + consumers; t++){
+		if(pthread_create(&threads[t].thread, NULL, (t < producers) ? benchRingProducer : benchRingConsumer, &threads[t]) != 0){
+			printf("Couldnt start the ring benchmark threads.\n");
+			exit(-1);
+		}
+	}
+	for(t = 0; t < producers; t++){
+		pthread_join(threads[t].thread, NULL);
+	}
+	end.data = NULL;
+	end.length = -1;
+	end.tag = -1;
+	for(t = 0; t < consumers; t++){
+		if(mpmc){
+			mpmcPushWait(&ring, &end);
+		}
+		else{
+			spscPushWait(&spsc, &end);
+		}
+	}
+	for(t = producers; t < producers + consumers; t++){
+		pthread_join(threads[t].thread, NULL);
+		failed |= threads[t].failed;
+	}
+	*seconds = benchNow() - start;
+
+	for(i = 0; i < count * (unsigned long)producers; i++){
+		if(seen[i] != 1){
+			failed = -1;
+		}
+	}
+
+	if(mpmc){
+		mpmcDestroy(&ring);
+	}
+	else{
+		spscDestroy(&spsc);
+	}
+	free(seen);
+
+	return failed;
+
+}
+
+
+/*This function pushes the producer's items, numbered from 0 in the length*/
+void * benchRingProducer(void * context){
+
+	benchRingThread * thread;
+	bufferDescriptor item;
+	unsigned long i;
+
+	thread = (benchRingThread *)context;
+	item.data = NULL;
+	item.tag = thread->id;
+
+	for(i = 0; i < thread->count; i++){
+		item.length = (long)i;
+		if(thread->mpmc != NULL){
+			mpmcPushWait(thread->mpmc, &item);
+		}
+		else{
+			spscPushWait(thread->spsc, &item);
+		}
+	}
+
+	return NULL;
+
+}
+
+
+/*This function pops until it gets an end, checking items of the same producer only ever go up*/
+/*With one consumer (& the spsc ring) they have to go up by exactly 1*/
+void * benchRingConsumer(void * context){
+
+	benchRingThread * thread;
+	bufferDescriptor item;
+	long last[BenchRingMaxThreads];
+	int i;
+
+	thread = (benchRingThread *)context;
+	for(i = 0; i < thread->producers; i++){
+		last[i] = -1;
+	}
+
+	for(;;){
+
+		if(thread->mpmc != NULL){
+			mpmcPopWait(thread->mpmc, &item);
+		}
+		else{
+			spscPopWait(thread->spsc, &item);
+		}
+		if(item.length < 0){
+			break;
+		}
+
+		if(item.tag < 0 || item.tag >= thread->producers || (unsigned long)item.length >= thread->count || item.length <= last[item.tag] ||
+		   (thread->spsc != NULL && item.length != last[item.tag] + 1)){
+			thread->failed = -1;
+			continue;
+		}
+		last[item.tag] = item.length;
+
+		/*Two consumers that both got the same item have to both get counted*/
+		__atomic_fetch_add(&thread->seen[(unsigned long)item.tag * thread->count + (unsigned long)item.length], 1, __ATOMIC_RELAXED);
+
+	}
+
+	return NULL;
+
+}
+
+
+/*This function prints one row of the results*/
+void benchReport(const char * name, const char * kernel, double seconds, const benchData * data){
+
+	/*Timers on some machines are too coarse for tiny inputs*/
+	if(seconds <= 0){
+		seconds = 1e-9;
+	}
+
+	printf("%-8s %-8s %12.1f %12.3f\n", name, kernel, (double)data->packedLength / seconds / 1e6, seconds * 1e9 / (double)data->valueCount);
+
+}
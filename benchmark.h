@@ -0,0 +1,95 @@
+/* ##################################
+   Benchmark Settings
+   ################################## */
+
+/*Default size of the generated input in MiB*/
+#define BenchDefaultMegabytes 64
+/*Default # of times every measurement is repeated. The fastest run is reported*/
+#define BenchDefaultRepeats 3
+/*How many pairs the decode & filter benchmarks hand to the kernel at once, same as the parser*/
+#define BenchBatchPairs DecodeBatchPairs
+/*How many bytes the crc benchmark checks at once, the same as a block of -m frame (FrameBlockSize)*/
+#define BenchCrcBlock (105 * 2048)
+
+/*How many descriptors every ring benchmark moves in total, split between the producers*/
+#define BenchRingDescriptors (1 << 22)
+/*Slots in the rings, small enough that the producers keep running into full rings*/
+#define BenchRingCapacity 64
+/*Most producers or consumers on one ring*/
+#define BenchRingMaxThreads 8
+
+/*The shapes of synthetic data the generator can make (-d)*/
+typedef enum{
+	/*Every value equally likely*/
+	DistributionUniform = 0,
+	/*Ramps up from 0 to 4095 over the whole file. Worst case for the list, every value makes the cut*/
+	DistributionAscending,
+	/*Ramps down from 4095 to 0. Best case, nothing after the first n values makes it*/
+	DistributionDescending,
+	/*Low noise (0-255) with a rare spike anywhere up to 4095, like a real capture*/
+	DistributionSpiky,
+	DistributionCount
+}benchDistribution;
+
+/*The generated input, as values & as the packed bytes the parser sees*/
+typedef struct{
+	unsigned short int * values;
+	unsigned char * packed;
+	size_t valueCount;
+	size_t packedLength;
+}benchData;
+
+/*One producer or consumer of the ring benchmark. Only one of spsc & mpmc is set*/
+typedef struct{
+	spscRing * spsc;
+	mpmcRing * mpmc;
+	int id;
+	/*Descriptors every producer pushes. A consumer uses this & producers to find an item in seen*/
+	unsigned long count;
+	int producers;
+	/*How often each item was popped, producer id * count + its number. Has to be exactly 1 for all of them*/
+	unsigned char * seen;
+	/*Set by a consumer that saw a producer's items out of order*/
+	int failed;
+	pthread_t thread;
+}benchRingThread;
+
+
+/* ###################
+   Function Prototypes
+   ################### */
+
+/*Make valueCount values of the given shape & pack them. Returns -1 if the buffers cant be allocated*/
+int benchGenerate(benchData * data, size_t valueCount, benchDistribution distribution, unsigned long seed);
+
+/*Free what benchGenerate allocated*/
+void benchFree(benchData * data);
+
+/*Look up a distribution by its name (uniform, asc, desc, spiky). Returns -1 for unknown names*/
+int benchDistributionByName(const char * name);
+
+/*Seconds since some fixed point, for timing*/
+double benchNow(void);
+
+/*Time the current unpack kernel over the whole input. Returns the fastest run in seconds*/
+double benchDecode(const benchData * data, int repeats, unsigned long * checksum);
+
+/*Time the current filter kernel scanning the values against threshold. Returns the fastest run in seconds*/
+double benchFilter(const benchData * data, int repeats, unsigned short int threshold, unsigned long * checksum);
+
+/*Time the current crc kernel over the packed input, a framed block (FrameBlockSize) at a time. Returns the fastest run in seconds*/
+double benchCrc(const benchData * data, int repeats, unsigned long * checksum);
+
+/*Time a whole parse (decode, last values & max values) with the given engine. Returns -1 if the engine cant do n*/
+double benchParse(const benchData * data, int repeats, int valuesToPrint, maxValueEngine engine, int * threshold);
+
+/*Move BenchRingDescriptors descriptors through a ring with that many threads on each side & check every one came*/
+/*out exactly once, in order per producer. mpmc 0 means the SPSC ring (1 x 1). Returns -1 if the check fails*/
+int benchRing(int mpmc, int producers, int consumers, double * seconds);
+
+/*Thread entry points of benchRing. context is a benchRingThread*/
+void * benchRingProducer(void * context);
+void * benchRingConsumer(void * context);
+
+/*Print one result row: what was measured, MB/s of packed input & ns per value*/
+void benchReport(const char * name, const char * kernel, double seconds, const benchData * data);
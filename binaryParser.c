@@ -1,6 +1,38 @@
+/*mmap, madvise & getopt arent part of C89*/
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <arpa/inet.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <pthread.h>
+#include <glob.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "unpack12.h"
+#include "accParser.h"
+#include "outputWriter.h"
+#include "bufferRing.h"
 #include "binaryParser.h"
 
 
@@ -39,17 +71,17 @@
 
     TL:DR - A binary heap sounds nice, but a linked list may offer better performance if you have to store less data.
 
- 2) fread() size
- 	I chose to read in 24 bit chunks because fread has a minimum read size of 1 byte and 24 is the LCM of 12 & 8.
- 	I could have gone with a larger read size and reduced the # of file reads that take place, but it would have
- 	made the code messier, both in terms of the data structure that I read data into and how I handled the
- 	remaining bits at the end of the file.
- 	While there is some concern that so many reads would be a performance hit, in real life fread is buffered and
- 	the performance penalty shouldnt be that high. 
- 	As a side note, I had to implement a big-endian to little-endian converter for the 24 bit read size,
- 	but it turned out to be pretty small.
+ 2) read size
+ 	I originally read in 24 bit chunks because fread has a minimum read size of 1 byte and 24 is the LCM of 12 & 8.
+ 	That kept the code simple, but on multi-GB files most of the time went into the fread call itself
+ 	(plus a memset & byte swap per pair), not into decoding.
+ 	Now we read 1 MiB at a time into a static buffer and decode every complete 24 bit pair in it.
+ 	A chunk rarely ends on a pair boundary, so the 1-2 leftover bytes are carried over (in the parser context)
+ 	and finish off the first pair of the next chunk. Whatever is left after the last read is the end of the file,
+ 	which is handled exactly like before (2 bytes = one more value, 1 byte = ignored).
+ 	The pairs are assembled straight from the big endian bytes with shifts, so the 24 bit byte swap is gone too.
 
- 	TL:DR - fread size was chosen for simplicity, not necessarily performance, but it shouldnt be a big deal.
+ 	TL:DR - Big reads, carry the partial pair across chunks, same end of file behavior.
 
  3) Further Optimizations & Performance thoughts:
     a) I used a statically allocated linked list. Its reasonably fast, and doesnt take up much room.
@@ -61,57 +93,818 @@
     c) Strict C89 does not support 'inline'. However the compiler should inline the smaller functions if 
        it feels it's worth it.
 
+    d) Regular files are memory mapped and decoded straight out of the page cache, so there is no copy into
+       readBuffer at all. Pipes, sockets & other things that cant be mapped (or -s on the cmd line) get read with
+       big read() calls into readBuffer instead. Non-blocking fds are fine too, we just poll() until there is data.
+       Either file name can be - for stdin/stdout, e.g. zcat capture.bin.gz | binaryParser - -
+
+    e) The shift & mask work is done by a vectorized unpack kernel (SSSE3/AVX2/NEON, picked at runtime) that
+       unpacks a batch of pairs into decodedValues before they get stored. See unpack12.c.
+       Once the list is full, a matching filter kernel compares the batch against the smallest value in the list,
+       so the few values that can actually go in are the only ones that ever reach listInsert().
+
+    f) Since the values are only 12 bits, there is a second engine for the max values (-t hist): a 4096 bin
+       histogram of every value. Inserting is a single increment with no compares, and the largest n values
+       fall out of a walk down from the top bin. It costs 32 KiB of RAM instead of 256 bytes, so the list stays
+       the default, but the histogram also gives us every other statistic for free and two of them can be
+       merged by just adding the bins.
+
+    g) The number of values we print (n) is set with -n. The list & buffer are statically allocated for the
+       default of 32, and the list only ever handles up to that (O(n) inserts get slow quickly).
+       Bigger n automatically switches to the heap (see u, it's only O(log n) per insert) and mallocs the buffer.
+       The buffer still wraps with a mask whenever n is a power of two.
+
+    h) With -j, a mapped file is split into equal runs of whole 24 bit pairs, one per worker thread.
+       Each worker has its own parser context, so there is no shared state & no locking while decoding.
+       The partial results are merged in file order: two histograms just add up, two lists take the union
+       of their values, and the last values of each chunk are appended after the ones before it.
+       Pipes cant be split, so they stay single threaded.
+
+    i) All of the parser state lives in a parserCtx (see accParser.h) instead of globals, with
+       parserInit/parserFeed/parserFinish/parserReset to drive it. This file is just the cmd line, the file I/O
+       & the thread pool around it. Building with -DParserStaticOnly leaves out the histogram & all mallocs
+       for the embedded version.
+
+    j) Live mode (-u) is for data that shows up a little at a time, like a socket. The input is read with read(),
+       which never waits for a full chunk, and whatever arrived gets fed to the parser (a pair split across
+       two packets is carried over in the ctx). Every few seconds a snapshot of the results is copied out of the
+       ctx and written over the output file, while the parsing just carries on. The wait for more data (poll, or
+       spscPopTimed with -a) only lasts until the next update is due, so the last data before the feed goes quiet
+       still makes it out on time, and an update with nothing new since the one before is skipped.
+
+    k) The output doesnt go through fprintf anymore. outputWriter.c formats the numbers with a 2 digit lookup
+       table into a 64 KiB buffer and fwrites the whole thing at once. Same text as before, byte for byte.
+
+    l) -f picks the output format. text is the default & the same as always. raw is just the two arrays as
+       little endian uint16s, binary adds a small header with the counts & section offsets so the file can be
+       mmapped & used as is, and csv/json are for scripts & spreadsheets. Live mode writes the same format.
+
+    m) -m unpack skips the statistics & just expands every sample into a file of little endian uint16s, for offline
+       analysis. It runs the same SIMD kernels straight into a 4 MiB page aligned buffer & writes that with one
+       write() at a time. -d opens the output with O_DIRECT, so a big unpack doesnt push everything else out of the
+       page cache. O_DIRECT only takes whole 4 KiB blocks, so the last partial block is written normally, and
+       filesystems that dont support it at all (tmpfs) just get normal writes.
+
+    n) -m pack is the other way around: a file of little endian uint16s goes back into packed 12 bit pairs, with the
+       2 byte tail for an odd # of values. It's for building test files & re-packing decoded data. The pack kernels
+       live with the unpack ones in unpack12.c & get picked with them (-k), so a round trip runs the same SIMD code
+       in both directions. Only the lower 12 bits of each value are kept.
+
+    o) Value i of a file always starts in the pair at byte (i / 2) * 3, so we dont have to read a whole file to get at
+       part of it. -m last seeks to the pair holding value total - n & only decodes from there (pipes still get read
+       all the way through). -m index writes a sidecar index with the min, max & count of every 64Ki value block.
+       -m range finds the n largest values between -r first:end. With an index (-i) it decodes the partial blocks
+       at the edges first, then the whole blocks from the largest max down, and stops as soon as a block's max
+       cant beat the smallest value we already have. Blocks like that never get read at all.
+
+    p) -m window -w W writes the min, max, mean & n largest values of every W values, as soon as each window is done,
+       so the memory use is the same for any file size. The values come out of the unpack mode's decoder (same
+       kernels, same carry & tail handling) in small batches that are still in the cache. The largest values of a
+       window go in the histogram, which is O(1) per value no matter how big n is, and min/max/sum are plain
+       compares. The windows dont overlap, so there's nothing to take back out when a window moves on & we dont
+       need a monotonic deque for the min/max. -t list is quicker for tiny windows, since the histogram has to be
+       cleared every window.
+
+    q) -m batch is for lots of small files, where starting the program once per file costs more than decoding it.
+       The first argument is the output, everything after it (and every line of the -l manifest) is an input,
+       and quoted patterns like 'captures/run*.bin' get expanded with glob(). The inputs are split into one run per
+       worker thread (-j). Each worker works through its own run from the front, and once it's done it steals
+       from the back of somebody else's, so a few big files dont leave the other threads idle.
+       Every worker has its own parser context & read buffer that get reused for every file, and files smaller
+       than a read buffer get read instead of mapped, since mapping a tiny file costs more than reading it.
+       The results go in one file, in the same order as the inputs (with the file name in text, csv & json),
+       or with -p in <output directory>/<input name>.<format>. Captures from different days often have the same
+       name, so every input keeps as many of its directories as it takes to be unique (sorting the paths by their
+       last part, then the one before & so on puts the ones with most in common next to each other, so that's
+       O(n log n) for any number of inputs). Two workers never get the same output, and two inputs that would are
+       an error before anything starts.
+
+    r) Plain reads (-s, pipes) wait for a chunk, then decode it, then wait for the next one. On network storage the
+       wait can be as long as the decode, so -a N runs the reads N chunks ahead of the decoder. Built with
+       -DHAVE_LIBURING (& -luring) regular files get N reads in flight at once through io_uring, on the decoding
+       thread. Everything else (or a kernel without io_uring) gets a reader thread that fills a ring of N buffers,
+       handed back & forth over two lock free rings (see y). The buffers go to the parser in file order either
+       way, so the results are the same as without -a.
+
+    s) Archived captures are usually .gz or .zst. Built with -DHAVE_ZLIB -lz and/or -DHAVE_ZSTD -lzstd, regular files
+       that start with the gzip or zstd magic bytes get decompressed straight into a 1 MiB buffer that goes to
+       parserFeed, so there are no temp files or pipes to gzip. Pipes cant be looked at without eating the bytes,
+       so they need -z gzip or -z zstd. gzip is one stream, so it's always one thread. A zstd file written as many
+       frames (zstd -T, pzstd, seekable zstd) says how big every frame is, so with -j each worker decompresses its own
+       run of frames into its own context. A run doesnt have to start on a pair, so each worker holds back the 0-2
+       bytes at its start & those get glued onto the end of the run before it when the results are merged.
+       Only the stats & last modes take compressed input, and so does -m batch: every input gets looked at on its
+       own (or -z says for all of them) & decompressed on its worker with that worker's buffer. The workers are
+       the parallelism there, so a zstd input doesnt get split any further.
+
+    t) Built with -DParserInstrument, every read() is timed & counted, the output is timed, and the parser counts
+       what the list does & how long decoding & the largest values take (see accParser.c). It all goes to stderr as
+       one line of JSON at exit, or whenever the process gets a SIGUSR1 (kill -USR1 <pid>), so a long run can be
+       looked at while it's going. The signal handler only formats numbers & calls write(), nothing that could
+       deadlock. Without the flag none of it is compiled in, so it costs nothing.
+       Threads add up, so with -j the decode & top times are the sum over all of the workers.
+
+    u) Item 1 still holds for n = 32 on noisy data: nearly every value gets thrown out by the filter kernel before
+       the list even sees it. It falls apart when lots of values make it in (a stream that keeps rising, or a big n),
+       since every one of them walks half the list. -t heap is an implicit 4-ary min heap (log4 n levels, the 4
+       children of a node next to each other in memory) in the same bytes as the list, so up to 128 values need no
+       malloc. The filter kernel skips for it exactly like it does for the list, so for n > 32 it beats the
+       histogram too unless most values make it in. -t auto picks the list up to 32 & the heap above, then watches
+       how many values of each batch get taken: past 1 in 64 the list turns into a heap, past 1 in 16 the heap moves
+       into the histogram for the rest of the stream. ./benchmark shows all of them side by side.
+
+    v) -b 10 & -b 14 read the 10 & 14 bit versions of the format (4 values in 5 or 7 bytes). Each width gets its own
+       unrolled kernel out of one macro in unpack12.c, with all of the shifts known at compile time, so there is no
+       per value check of the width anywhere. The parser just picks the kernel & group size once (parserSetSampleBits),
+       and the splitting & carrying code works in groups instead of pairs. 12 bits still gets the SIMD kernels.
+       Only the stats & last modes know about other widths, everything else (index, range, pack, ...) is 12 bit only,
+       and 14 bit values dont fit the histogram, so -t hist is out too.
+
+    w) -c N is for captures with N channels interleaved value by value (X Y Z X Y Z ... for an accelerometer), which
+       used to be split into N files before they got here. Every channel gets its own context for its largest & last
+       values, but the file is still read & unpacked once: each batch of 4096 values gets split between the channels
+       (pshufb for 2 & 3 channels, see unpack12.c) & stored by each of them. Threads work like they do for one
+       channel, every worker just starts on whichever channel its chunk starts with. The output is one section per
+       channel, tagged with its number.
+
+    x) -q adds count, min, max, mean, variance, p50, p99 & p999 of every value to the output, so nobody has to run a
+       second tool over the unpacked values. It's one pass like everything else: the parser counts every value into
+       a histogram (4 of them actually, see accParser.c) & the stats are worked out of the bins when the output is
+       written, so the percentiles are exact & the mean doesnt add up billions of values. What it costs is one
+       increment per value, which is about as much as the unpack itself (the filter kernel keeps the list nearly
+       free), so it's off unless asked for.
+
+    y) The -a reader used to hand buffers over with a mutex & condition variables, i.e. a lock, a syscall & a wakeup
+       per chunk on each side. Now it's two single producer single consumer rings of buffer descriptors
+       (bufferRing.c): full buffers go to the decoder on one, empty ones come back on the other, and neither side
+       takes a lock. A side that finds its ring empty spins, then yields, then sleeps, and every such wait is
+       counted, which is the back pressure: the reader waiting for a free buffer means decoding is behind the
+       input, the decoder waiting means the input is. -DParserInstrument reports both (& the most full buffers
+       ever waiting), and -u -a says on stderr at every update where the reader had to wait. There's an MPMC
+       ring too, with the same masking, for fanning several receivers into one parser. Nothing in here uses it
+       yet, so the benchmark runs it with 4 producers & 4 consumers & checks every descriptor came out once.
+
+    z) Captures that are sharded across machines used to need the raw data moved to one place for a global top n &
+       last n. Now every shard can write a partial result (-f partial, with -o saying where it starts), which is
+       the top n, the last n with their offsets, the counts & the -q histogram, a few hundred bytes plus at most
+       32 KiB of bins. -m merge folds any number of them into one (or into another partial, for the next level
+       of a reduce tree). The merge is associative & commutative (see accParser.c), so the tree can have any
+       shape & the partials can come in any order. The header has a version, and a merge rejects any version
+       (or n or sample width) it doesnt know, rather than guessing. It also rejects two partials that have more
+       values between them than the stretch of the stream they span, i.e. that overlap, which for single shards
+       (no gaps) is every overlap. Counting a shard twice would otherwise just quietly skew the stats.
+
+    aa) Raw input has nothing to check, so a flipped bit on a long haul transfer just turns into a wrong value,
+       possibly a new max. -e framed takes blocks with a CRC32C (hardware crc, 3 stripes at a time, see unpack12.c)
+       over the sequence #, the length & the samples. A block that fails gets skipped: we step forward a byte at
+       a time (memchr for the first magic byte) until a header whose block checks out, so a bad length cant send
+       us off somewhere random. parserSkip drops any partial pair so nothing after the gap gets glued to what
+       was before it, and when the sequence #s & the skipped bytes add up the channels move on by the lost
+       values, so -c doesnt get shifted. Every gap goes to stderr with its offset. -m frame writes blocks of
+       FrameBlockSize bytes, whole pairs (or groups) at any width. Raw stays the default & doesnt pay for any of
+       it, but it does say on stderr now when the input ends in the middle of a value (1 byte for 12 bits).
+
+    ab) Watching a capture that is still being written used to mean running the whole file again every time,
+       O(file) per look. -m tail keeps the context around: it remembers how far it got, preads only what is past
+       that & feeds it in, and the partial pair at the end waits in the context like it does for any other read.
+       inotify wakes it up as soon as the file changes, and poll times out every TailPollMilliseconds anyway, so
+       it still works (a bit later) where inotify isnt there or ran out of watches. A file that got shorter has
+       been rewritten, and so has one whose last TailCheckBytes before where we stopped are different now (that
+       one pread catches a truncate & rewrite that got past us between two looks, or one of the same size). A
+       different inode at the path is a new capture, which gets opened & watched instead. All of those start
+       over from 0. A query takes a snapshot & never calls parserFinish, which
+       would put the unfinished pair into the results & make it impossible to keep going. It isnt a real
+       daemon (no fork, no pid file), whatever runs it (systemd, nohup) takes care of that & stops it with SIGTERM.
+
  ***********************************************************************************************************************************/
 
 
 
 int main(const int argc, const char* argv[]){
 
-	FILE * inputFile;
 	FILE * outputFile;
-	int closeInputVal, closeOutputVal, i;
+	int closeInputVal, closeOutputVal, option, inputFd, useStdio, mapped, kernel, valuesToPrint, liveInterval, direct, sections, perInput, pipelineBuffers;
+	int sampleBits, channelCount, summaryStats, framedInput, i;
+	unsigned long rangeFirst, rangeEnd, totalValues, windowValues, shardFirst;
+	const char * indexPath;
+	const char * manifestPath;
+	char * rangeText;
+	runMode mode;
+	inputCodec codec;
+	valueIndex index;
+	maxValueEngine maxEngine;
+	struct stat inputStat;
+	parserCtx * ctx;
+	parserSnapshot snapshot;
+	parserPartial partial;
+#ifdef ParserInstrument
+	struct sigaction action;
+	double outputStart;
+
+	/*The summary goes out at exit, whichever way we get there, and on every SIGUSR1*/
+	atexit(instrumentReport);
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = instrumentSignal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+#endif
+
+	/*Check for cmd line options. We memory map regular files unless -s asks for plain reads*/
+	/*The unpack kernel is picked from the cpu unless -k asks for a specific one*/
+	/*-n sets how many values we print. The max values engine is picked from that unless -t asks for one*/
+	useStdio = 0;
+	kernel = UnpackAuto;
+	maxEngine = EngineAuto;
+	valuesToPrint = NumberOfValuesToPrint;
+	/*-u turns on live mode: the output file gets rewritten every few seconds while the input is still coming in*/
+	threadCount = 1;
+	liveInterval = 0;
+	/*-f picks the output format, text by default*/
+	resultFormat = FormatText;
+	/*-m picks what we do with the input. -d is only used by the unpack mode*/
+	mode = ModeStats;
+	direct = 0;
+	/*-r & -i are only used by the range mode. The default range is the whole file*/
+	rangeFirst = 0;
+	rangeEnd = (unsigned long)-1;
+	indexPath = NULL;
+	/*-w is the window size for the windowed mode*/
+	windowValues = 0;
+	/*-l & -p are for the batch mode*/
+	manifestPath = NULL;
+	perInput = 0;
+	/*-a turns on the read pipeline*/
+	pipelineBuffers = 0;
+	/*-z says how the input is compressed*/
+	codec = CodecAuto;
+	/*-b is how wide the samples are*/
+	sampleBits = DefaultSampleBits;
+	/*-c is how many channels are interleaved in the stream*/
+	channelCount = 1;
+	/*-q adds the summary stats & percentiles*/
+	summaryStats = 0;
+	/*-o is where the input starts in the whole stream, for -f partial*/
+	shardFirst = 0;
+	/*-e framed says the input is in checksummed blocks*/
+	framedInput = 0;
+	while((option = getopt(argc, (char * const *)argv, "sk:t:n:j:u:f:m:dr:i:w:l:pa:z:b:c:qo:e:")) != -1){
+		switch(option){
+			case 'e':
+				if(strcmp(optarg, "raw") == 0){
+					framedInput = 0;
+				}
+				else if(strcmp(optarg, "framed") == 0){
+					framedInput = 1;
+				}
+				else{
+					printf("Unknown input encoding %s. Use raw or framed.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'o':
+				shardFirst = strtoul(optarg, &rangeText, 10);
+				if(*rangeText != '\0'){
+					printf("The shard offset has to be a number of values.\n");
+					return -1;
+				}
+				break;
+			case 'q':
+				summaryStats = 1;
+				break;
+			case 'c':
+				channelCount = atoi(optarg);
+				if(channelCount < 1 || channelCount > MaxChannels){
+					printf("The number of channels has to be between 1 and %d.\n", MaxChannels);
+					return -1;
+				}
+				break;
+			case 'b':
+				sampleBits = atoi(optarg);
+				if(sampleBits != 10 && sampleBits != 12 && sampleBits != 14){
+					printf("Unknown sample width %s. Use 10, 12 or 14.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'z':
+				if(strcmp(optarg, "auto") == 0){
+					codec = CodecAuto;
+				}
+				else if(strcmp(optarg, "none") == 0){
+					codec = CodecNone;
+				}
+				else if(strcmp(optarg, "gzip") == 0){
+					codec = CodecGzip;
+				}
+				else if(strcmp(optarg, "zstd") == 0){
+					codec = CodecZstd;
+				}
+				else{
+					printf("Unknown compression %s. Use auto, none, gzip or zstd.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'a':
+				pipelineBuffers = atoi(optarg);
+				if(pipelineBuffers < 2 || pipelineBuffers > PipelineMaxBuffers){
+					printf("The read pipeline needs between 2 and %d buffers.\n", PipelineMaxBuffers);
+					return -1;
+				}
+				break;
+			case 'l':
+				manifestPath = optarg;
+				break;
+			case 'p':
+				perInput = 1;
+				break;
+			case 'w':
+				windowValues = strtoul(optarg, &rangeText, 10);
+				if(*rangeText != '\0' || windowValues == 0){
+					printf("The window size has to be at least 1 value.\n");
+					return -1;
+				}
+				break;
+			case 'r':
+				rangeFirst = strtoul(optarg, &rangeText, 10);
+				if(*rangeText != ':'){
+					printf("The range has to look like first:end.\n");
+					return -1;
+				}
+				rangeEnd = strtoul(rangeText + 1, &rangeText, 10);
+				if(*rangeText != '\0' || rangeEnd < rangeFirst){
+					printf("The range has to look like first:end, with end >= first.\n");
+					return -1;
+				}
+				break;
+			case 'i':
+				indexPath = optarg;
+				break;
+			case 'm':
+				if(strcmp(optarg, "stats") == 0){
+					mode = ModeStats;
+				}
+				else if(strcmp(optarg, "unpack") == 0){
+					mode = ModeUnpack;
+				}
+				else if(strcmp(optarg, "pack") == 0){
+					mode = ModePack;
+				}
+				else if(strcmp(optarg, "last") == 0){
+					mode = ModeLast;
+				}
+				else if(strcmp(optarg, "index") == 0){
+					mode = ModeIndex;
+				}
+				else if(strcmp(optarg, "range") == 0){
+					mode = ModeRange;
+				}
+				else if(strcmp(optarg, "window") == 0){
+					mode = ModeWindow;
+				}
+				else if(strcmp(optarg, "batch") == 0){
+					mode = ModeBatch;
+				}
+				else if(strcmp(optarg, "merge") == 0){
+					mode = ModeMerge;
+				}
+				else if(strcmp(optarg, "frame") == 0){
+					mode = ModeFrame;
+				}
+				else if(strcmp(optarg, "tail") == 0){
+					mode = ModeTail;
+				}
+				else{
+					printf("Unknown mode %s. Use stats, unpack, pack, last, index, range, window, batch, merge, frame or tail.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'd':
+				direct = 1;
+				break;
+			case 'f':
+				if(outputFormatByName(optarg) < 0){
+					printf("Unknown output format %s. Use text, raw, binary, csv, json or partial.\n", optarg);
+					return -1;
+				}
+				resultFormat = (outputFormat)outputFormatByName(optarg);
+				break;
+			case 'u':
+				liveInterval = atoi(optarg);
+				if(liveInterval <= 0){
+					printf("The live update interval has to be at least 1 second.\n");
+					return -1;
+				}
+				break;
+			case 'j':
+				/*-j 0 means one thread per cpu*/
+				threadCount = atoi(optarg);
+				if(threadCount == 0){
+					threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+				}
+				if(threadCount < 1 || threadCount > MaxThreads){
+					printf("The number of threads has to be between 1 and %d.\n", MaxThreads);
+					return -1;
+				}
+				break;
+			case 'n':
+				valuesToPrint = atoi(optarg);
+				if(valuesToPrint <= 0 || valuesToPrint > MaxValuesToPrint){
+					printf("The number of values to print has to be between 1 and %d.\n", MaxValuesToPrint);
+					return -1;
+				}
+				break;
+			case 's':
+				useStdio = 1;
+				break;
+			case 'k':
+				kernel = unpackKernelByName(optarg);
+				if(kernel < 0){
+					printf("Unknown unpack kernel %s. Use auto, scalar, ssse3, avx2 or neon.\n", optarg);
+					return -1;
+				}
+				break;
+			case 't':
+				if(strcmp(optarg, "auto") == 0){
+					maxEngine = EngineAuto;
+				}
+				else if(strcmp(optarg, "list") == 0){
+					maxEngine = EngineList;
+				}
+				else if(strcmp(optarg, "hist") == 0){
+					maxEngine = EngineHistogram;
+				}
+				else if(strcmp(optarg, "heap") == 0){
+					maxEngine = EngineHeap;
+				}
+				else if(strcmp(optarg, "array") == 0){
+					maxEngine = EngineArray;
+				}
+				else{
+					printf("Unknown max value engine %s. Use auto, list, hist, heap or array.\n", optarg);
+					return -1;
+				}
+				break;
+			default:
+				printf("Incorrect usage. Options: -s (use read instead of mmap), -k <unpack kernel>, -t <auto|list|hist|heap|array>, -n <values to print>, -j <threads>, -u <live update seconds>, -f <text|raw|binary|csv|json|partial>, -m <stats|unpack|pack|last|index|range|window|batch|merge|frame|tail>, %s",
+				       "-d (O_DIRECT unpack output), -r <first:end>, -i <index file>, -w <window size>, -l <manifest>, -p (one output per input), -a <read pipeline buffers>, -z <auto|none|gzip|zstd>, -b <10|12|14>, -c <channels>, -q (summary stats), -o <shard offset>, -e <raw|framed>\n");
+				return -1;
+		}
+	}
+
+	/*The list is O(n) per insert and statically allocated, so it only makes sense for small n*/
+	if(maxEngine == EngineList && valuesToPrint > NumberOfValuesToPrint){
+		printf("The list engine only handles up to %d values. Use -t heap or -t hist for more.\n", NumberOfValuesToPrint);
+		return -1;
+	}
+	if(maxEngine == EngineArray && valuesToPrint > (int)TopStaticValues){
+		printf("The array engine only handles up to %d values. Use -t heap or -t hist for more.\n", (int)TopStaticValues);
+		return -1;
+	}
+
+	/*Everything but the stats, last & tail modes assumes 12 bit pairs, and the histogram only has 4096 bins*/
+	if(sampleBits != DefaultSampleBits && mode != ModeStats && mode != ModeLast && mode != ModeTail){
+		printf("Only the stats, last & tail modes read %d bit samples.\n", sampleBits);
+		return -1;
+	}
+	/*Every channel is its own snapshot, which only the plain stats output knows how to write*/
+	if(channelCount > 1 && (mode != ModeStats || liveInterval > 0)){
+		printf("Interleaved channels only work with the stats mode, without -u.\n");
+		return -1;
+	}
+	/*The summary needs a histogram that gets malloced, and somewhere in the output to go*/
+#ifdef ParserStaticOnly
+	if(summaryStats){
+		printf("The embedded build doesnt have the summary stats.\n");
+		return -1;
+	}
+#endif
+	if(summaryStats && ((mode != ModeStats && mode != ModeTail) || resultFormat == FormatRaw || resultFormat == FormatBinary)){
+		printf("The summary stats only work with the stats & tail modes & the text, csv or json formats.\n");
+		return -1;
+	}
+	/*The tail mode is the stats mode that never ends, answering on a socket instead of writing a file*/
+	if(mode == ModeTail && (channelCount > 1 || liveInterval > 0 || framedInput || resultFormat == FormatPartial)){
+		printf("The tail mode doesnt work with -c, -u, -e framed or -f partial.\n");
+		return -1;
+	}
+	/*The blocks get checked one after the other as they're decoded, so there is nothing to seek around in or hand out to threads*/
+	if(framedInput && ((mode != ModeStats && mode != ModeLast) || liveInterval > 0)){
+		printf("Framed input only works with the stats & last modes, without -u.\n");
+		return -1;
+	}
+	/*A partial is one stream's results plus where it came from, which only the plain stats mode (or a merge) knows*/
+#ifdef ParserStaticOnly
+	if(resultFormat == FormatPartial || mode == ModeMerge){
+		printf("The embedded build doesnt have partial results.\n");
+		return -1;
+	}
+#endif
+	if(resultFormat == FormatPartial && ((mode != ModeStats && mode != ModeMerge) || channelCount > 1 || liveInterval > 0)){
+		printf("Partial results only work with the stats & merge modes, without -c or -u.\n");
+		return -1;
+	}
+	if(sampleBits > DefaultSampleBits && maxEngine == EngineHistogram){
+		printf("The histogram engine only has room for 12 bit values. Use -t heap for %d bit samples.\n", sampleBits);
+		return -1;
+	}
+
+	if(unpackSelect((unpackKernelId)kernel) != 0){
+		printf("The requested unpack kernel isnt supported on this machine!\n");
+		return -1;
+	}
+
+	/*The batch mode takes the output first & then any number of inputs*/
+	if(mode == ModeBatch){
+		if(argc - optind < 1){
+			printf("Incorrect usage. The batch mode needs the output file (or directory with -p), then the input files.\n");
+			return -1;
+		}
+		return runBatch(argv[optind], &argv[optind + 1], argc - optind - 1, manifestPath, perInput, valuesToPrint, maxEngine, useStdio,
+		                codec);
+	}
+
+	/*So does the merge mode. Everything it needs to know is in the partials, so -n, -b & -q dont matter*/
+	if(mode == ModeMerge){
+		if(argc - optind < 2){
+			printf("Incorrect usage. The merge mode needs the output file, then at least one partial result.\n");
+			return -1;
+		}
+		return runMerge(argv[optind], &argv[optind + 1], argc - optind - 1);
+	}
 
 	/*Check for correct cmd line args*/
-	if(argc != 3){
+	if(argc - optind != 2){
 		printf("Incorrect usage. Please provide 2 arguments - the input file, then the output file.");
+		return -1;
 	}
 
 	/*open files*/
 	/*Note: If you run it twice with the same output filename, that file will be overwritten*/
-	inputFile = fopen(argv[1], "r");
-	outputFile = fopen(argv[2], "w+");
+	/*- means stdin for the input & stdout for the output, so we can sit in a pipeline*/
+	if(strcmp(argv[optind], "-") == 0){
+		inputFd = STDIN_FILENO;
+	}
+	else{
+		inputFd = open(argv[optind], O_RDONLY);
+	}
 
-	if(!inputFile || !outputFile){
+	if(inputFd < 0 || fstat(inputFd, &inputStat) != 0){
 		printf("Error opening one of the files! \n");
 		return -1;
 	}
 
-	/*Initialize global data structures*/
-	memset(&maxList[0], 0x00, NumberOfValuesToPrint * sizeof(listNode));
-	memset(&lastValuesBuffer[0], 0x00, NumberOfValuesToPrint * sizeof(unsigned short int));
-	lastValuesWriteIdx = 0;
-	totalValueCount = 0;
-	listSize = 0;
-	listHead = 0;
+	/*Only a regular file can be read from where we left off*/
+	if(mode == ModeTail && !S_ISREG(inputStat.st_mode)){
+		printf("The tail mode needs a regular file for the input.\n");
+		return -1;
+	}
+
+	/*Compressed input only goes through the stats & last modes*/
+	if(codec == CodecAuto){
+		codec = detectCodec(inputFd, &inputStat);
+	}
+	if(codec != CodecNone && mode != ModeStats && mode != ModeLast){
+		printf("Compressed input only works with the stats & last modes.\n");
+		return -1;
+	}
+	if(codec != CodecNone && (framedInput || mode == ModeFrame)){
+		printf("Framed input cant be compressed as well.\n");
+		return -1;
+	}
+	if(checkCodec(codec, NULL) != 0){
+		return -1;
+	}
+
+	/*The unpack, pack & frame modes dont need a parser at all*/
+	if(mode == ModeUnpack || mode == ModePack || mode == ModeFrame){
+		if(mode == ModeUnpack){
+			closeInputVal = unpackFile(inputFd, &inputStat, argv[optind + 1], useStdio, direct);
+		}
+		else if(mode == ModeFrame){
+			closeInputVal = frameFile(inputFd, argv[optind + 1]);
+		}
+		else{
+			closeInputVal = packFile(inputFd, &inputStat, argv[optind + 1], useStdio);
+		}
+		if(close(inputFd) != 0 || closeInputVal != 0){
+			printf("Error reading or writing one of the files! \n");
+			return -1;
+		}
+		return 0;
+	}
+
+	/*A window is a record of its own, so the formats with a fixed layout dont work here*/
+	if(mode == ModeWindow && (windowValues == 0 || resultFormat == FormatRaw || resultFormat == FormatBinary)){
+		printf("The window mode needs -w <window size> & one of the text, csv or json formats.\n");
+		return -1;
+	}
+
+	/*Seeking around only works in regular files*/
+	if((mode == ModeIndex || mode == ModeRange) && !S_ISREG(inputStat.st_mode)){
+		printf("The index & range modes need a regular file for the input.\n");
+		return -1;
+	}
+
+	/*The output of the index mode is the index*/
+	if(mode == ModeIndex){
+		closeInputVal = buildIndex(inputFd, inputStat.st_size, argv[optind + 1]);
+		if(close(inputFd) != 0 || closeInputVal != 0){
+			printf("Error reading or writing one of the files! \n");
+			return -1;
+		}
+		return 0;
+	}
+
+	/*An index that was built from a different file would give wrong answers, so loadIndex checks the size*/
+	index.blocks = NULL;
+	if(mode == ModeRange){
+		totalValues = fileValueCount(inputStat.st_size);
+		if(rangeEnd > totalValues){
+			rangeEnd = totalValues;
+		}
+		if(rangeFirst > rangeEnd){
+			rangeFirst = rangeEnd;
+		}
+		if(indexPath != NULL && loadIndex(indexPath, inputStat.st_size, &index) != 0){
+			printf("Couldnt load the index %s. It has to be built from this input with -m index.\n", indexPath);
+			return -1;
+		}
+	}
+
+#ifndef ParserStaticOnly
+	/*Windows get the histogram unless -t asks for the list, see note p*/
+	if(mode == ModeWindow && maxEngine == EngineAuto){
+		maxEngine = EngineHistogram;
+	}
+#endif
+
+	/*Initialize the parser. The context is big (the histogram & decode buffer), so it doesnt go on the stack*/
+	ctx = malloc(sizeof(parserCtx));
+	if(ctx == NULL || parserInit(ctx, valuesToPrint, maxEngine) != 0 || parserSetSampleBits(ctx, sampleBits) != 0
+	   || (summaryStats && parserEnableStats(ctx) != 0) || parserSetChannels(ctx, channelCount) != 0
+	   || parserSnapshotInit(&snapshot, ctx) != 0){
+		printf("Couldnt allocate room for %d values!\n", valuesToPrint);
+		return -1;
+	}
+#ifdef ParserInstrument
+	instrumentCtx = ctx;
+#endif
+
+	/*In live mode the output file gets replaced on every update, so there is no point opening it now*/
+	/*The tail mode doesnt have one at all, the results go out over the socket*/
+	if(liveInterval > 0 || mode == ModeTail){
+		if(mode == ModeTail){
+			closeInputVal = runTail(ctx, &snapshot, inputFd, argv[optind], argv[optind + 1]);
+		}
+		else{
+			closeInputVal = parseAccLive(ctx, &snapshot, inputFd, argv[optind + 1], liveInterval, pipelineBuffers);
+		}
+#ifdef ParserInstrument
+		finalCounters = ctx->counters;
+		instrumentCtx = NULL;
+#endif
+		parserSnapshotFree(&snapshot);
+		parserDestroy(ctx);
+		free(ctx);
+		if(closeInputVal != 0){
+			printf("Error reading or writing one of the files! \n");
+			return -1;
+		}
+		return 0;
+	}
 
-	/*We need an invalid value for each of the next pointers, as 0 is a valid value*/
-	for(i = 0; i < NumberOfValuesToPrint; i++){
-		maxList[i].next = -1;
+	outputFile = (strcmp(argv[optind + 1], "-") == 0) ? stdout : fopen(argv[optind + 1], "w+");
+	if(!outputFile){
+		printf("Error opening one of the files! \n");
+		return -1;
 	}
 
 
 	/**** Main Processing ****/
-	/*Call reading helper function*/
-	parseAccData(inputFile);
+	closeInputVal = 0;
+	sections = OutputAllSections;
+	totalValues = 0;
+	if(mode == ModeWindow){
+
+		/*Every window was already written out as it went, so there is no snapshot to write at the end*/
+		outputInit(&resultOutput, outputFile);
+		closeInputVal = windowFile(ctx, &snapshot, inputFd, &inputStat, useStdio, windowValues);
+		sections = 0;
+
+	}
+	else if(mode == ModeRange){
+
+		/*Skipped blocks dont get to the last values, so only the largest values mean anything here*/
+		sections = OutputMaxSection;
+		totalValues = rangeEnd - rangeFirst;
+		closeInputVal = rangeMaxValues(ctx, inputFd, inputStat.st_size, rangeFirst, rangeEnd, (index.blocks != NULL) ? &index : NULL);
+
+	}
+	else if(mode == ModeLast && S_ISREG(inputStat.st_mode) && codec == CodecNone && !framedInput && sampleBits == DefaultSampleBits){
+
+		/*Only the end of the file gets read, so the largest values would just be the largest of the last n*/
+		sections = OutputLastSection;
+		totalValues = fileValueCount(inputStat.st_size);
+		closeInputVal = feedValueRange(ctx, inputFd, inputStat.st_size,
+		                               (totalValues > (unsigned long)valuesToPrint) ? totalValues - valuesToPrint : 0, totalValues);
+
+	}
+	else{
+
+		if(mode == ModeLast){
+			sections = OutputLastSection;
+		}
+
+		/*Call reading helper function*/
+		/*Regular files get mapped. Pipes, sockets & anything that fails to map get read in big chunks*/
+		mapped = -1;
+		if(codec != CodecNone){
+			mapped = 0;
+			closeInputVal = parseAccCompressed(ctx, inputFd, &inputStat, codec, useStdio, &readBuffer[0], threadCount);
+		}
+		else if(framedInput){
+			mapped = 0;
+			closeInputVal = parseAccFramed(ctx, inputFd, &inputStat, useStdio);
+		}
+		else if(!useStdio && S_ISREG(inputStat.st_mode)){
+			mapped = parseAccMapped(ctx, inputFd, inputStat.st_size);
+		}
+
+		if(mapped != 0){
+			if(pipelineBuffers > 0){
+				closeInputVal = parseAccPipeline(ctx, inputFd, &inputStat, pipelineBuffers);
+			}
+			else{
+				closeInputVal = parseAccStream(ctx, inputFd);
+			}
+		}
+
+		/*Still decoded, but somebody should know the input was cut short*/
+		if(ctx->truncatedBytes > 0){
+			fprintf(stderr, "The input ends in the middle of a value, the last %d bytes were left out\n", ctx->truncatedBytes);
+		}
+
+	}
+
+	if(closeInputVal != 0){
+		printf("Error reading the input file! \n");
+	}
+
+	if(close(inputFd) != 0){
+		closeInputVal = -1;
+	}
 
 	/*Call Print Helper function*/
-	printMaxValues(outputFile);
-	printLastValues(outputFile);
+	/*The seeking modes didnt feed every value to the parser, so its count is only part of the story*/
+	parserTakeSnapshot(ctx, &snapshot);
+	if(totalValues > 0){
+		snapshot.totalValueCount = totalValues;
+	}
+#ifdef ParserInstrument
+	outputStart = parserClock();
+#endif
+	if(ctx->channels != NULL){
+		/*Same n for every channel, so the one snapshot does for all of them*/
+		outputInit(&resultOutput, outputFile);
+		outputChannelsStart(&resultOutput, resultFormat);
+		for(i = 0; i < ctx->channelCount; i++){
+			parserTakeSnapshot(&ctx->channels[i], &snapshot);
+			outputSnapshotChannel(&resultOutput, &snapshot, resultFormat, i);
+		}
+	}
+	else if(resultFormat == FormatPartial){
+		/*Same settings as ctx, so the take cant fail, but the partial has to be allocated*/
+		outputInit(&resultOutput, outputFile);
+		if(parserPartialInit(&partial, ctx->valuesToPrint, ctx->sampleBits, summaryStats) == 0){
+			parserPartialTake(ctx, shardFirst, &partial);
+			outputPartial(&resultOutput, &partial);
+			parserPartialFree(&partial);
+		}
+		else{
+			resultOutput.failed = 1;
+		}
+	}
+	else if(sections != 0){
+		outputInit(&resultOutput, outputFile);
+		outputSnapshotSections(&resultOutput, &snapshot, resultFormat, sections);
+	}
+	closeOutputVal = outputFlush(&resultOutput);
+#ifdef ParserInstrument
+	ioStats.outputSeconds += parserClock() - outputStart;
+	finalCounters = ctx->counters;
+	instrumentCtx = NULL;
+#endif
 
 	/**** Clean Up ****/
+	free(index.blocks);
+	parserSnapshotFree(&snapshot);
+	parserDestroy(ctx);
+	free(ctx);
+
 	/*Close the files and check to make sure they close correctly*/
-	closeInputVal = fclose(inputFile);
-	closeOutputVal = fclose(outputFile);
+	if(fclose(outputFile) != 0){
+		closeOutputVal = -1;
+	}
 
 	if(closeInputVal != 0 || closeOutputVal != 0){
 		printf("File close failed!");
@@ -124,233 +917,3294 @@ int main(const int argc, const char* argv[]){
 }
 
 
-/*This function parses the binary file and populates the global data structures*/
-void parseAccData(FILE * inputFile){
+/*This function maps the whole file and decodes it straight out of the mapping*/
+/*Returns -1 without touching any data if the file cant be mapped, so the caller can fall back to reading it*/
+int parseAccMapped(parserCtx * ctx, int inputFd, off_t fileSize){
 
-	inputWordUnion inputValues;
-	int size;
-	unsigned short int twelveBitValue; 
+	const unsigned char * fileData;
+	off_t blockEnd;
+	int threaded;
 
-	/*Some housekeeping*/
-	memset(&inputValues, 0x00, sizeof(inputWordUnion));
+	/*mmap doesnt do empty files, and we cant map a file that doesnt fit in our address space*/
+	if(fileSize <= 0 || (off_t)(size_t)fileSize != fileSize){
+		return -1;
+	}
+
+	fileData = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, inputFd, 0);
+	if(fileData == MAP_FAILED){
+		return -1;
+	}
+
+#ifdef ParserInstrument
+	pthread_mutex_lock(&ioStatsLock);
+	ioStats.bytesMapped += (unsigned long)fileSize;
+	pthread_mutex_unlock(&ioStatsLock);
+#endif
+
+	/*We only ever walk the file front to back once, so let the kernel read ahead aggressively*/
+	madvise((void *)fileData, (size_t)fileSize, MADV_SEQUENTIAL);
+	madvise((void *)fileData, (size_t)fileSize, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+	/*Only a hint. Most filesystems ignore it for file backed pages*/
+	madvise((void *)fileData, (size_t)fileSize, MADV_HUGEPAGE);
+#endif
+
+	/*Big files get split across the worker threads if we have any, otherwise we decode it all right here*/
+	blockEnd = fileSize - (fileSize % ctx->groupBytes);
+	threaded = -1;
+	if(threadCount > 1 && blockEnd >= (off_t)threadCount * MinBytesPerThread){
+		threaded = parseAccThreaded(ctx, fileData, blockEnd);
+	}
+
+	if(threaded == 0){
+		parserFeed(ctx, &fileData[blockEnd], (size_t)(fileSize - blockEnd));
+	}
+	else{
+		parserFeed(ctx, fileData, (size_t)fileSize);
+	}
+	parserFinish(ctx);
+
+	munmap((void *)fileData, (size_t)fileSize);
 
-	/*Read the values from the file*/
-	/*Read 3 1-byte chunks into the character array - 24 bits*/
-	size = fread(&inputValues.inputStruct.twoValues[0], 1, 3, inputFile);
+	return 0;
 
-	while(size == 3){
+}
 
-		/*Convert from big to little endian*/
-		ntoh24Bit(&inputValues.word);
 
-		/*get the first value in the 24 bit chunk*/
-		twelveBitValue = (inputValues.word >> 12) & Lower12BitMask;
-		/*Store the value in the circular buffer*/
-		lastValuesBuffer[lastValuesWriteIdx] = twelveBitValue;
-		/*Incriment the write index and wrap around if necessary*/
-		lastValuesWriteIdx = (lastValuesWriteIdx + 1) & 0x1F;
-		/*populate list with the value*/
-		listInsert(twelveBitValue);
+/*This function splits the complete pairs of a mapped file across threadCount workers*/
+/*Returns -1 without decoding anything if we cant get memory for the workers*/
+int parseAccThreaded(parserCtx * ctx, const unsigned char * fileData, off_t blockEnd){
 
-		/*get the second value*/
-		twelveBitValue = (inputValues.word) & Lower12BitMask;
-		/*Store the value in the circular buffer*/
-		lastValuesBuffer[lastValuesWriteIdx] = twelveBitValue;
-		/*Incriment the write index and wrap around if necessary*/
-		lastValuesWriteIdx = (lastValuesWriteIdx + 1) & 0x1F;
-		/*populate list with the value*/
-		listInsert(twelveBitValue);
-		
-		/*This ensures that if we copy less than 3 bytes in we dont have a stale byte hanging around*/
-		memset(&inputValues, 0x00, sizeof(inputWordUnion));
-		size = fread(&inputValues.inputStruct.twoValues[0], 1, 3, inputFile);
+	workerContext * workers;
+	off_t pairCount, pairsPerWorker;
+	int i;
 
-		totalValueCount +=2;
+	workers = malloc(threadCount * sizeof(workerContext));
+	if(workers == NULL){
+		return -1;
+	}
 
+	/*Every worker gets its own context with the same settings as ours*/
+	for(i = 0; i < threadCount; i++){
+		if(parserInitLike(&workers[i].ctx, ctx) != 0){
+			while(i-- > 0){
+				parserDestroy(&workers[i].ctx);
+			}
+			free(workers);
+			return -1;
+		}
 	}
 
-	/*We need to take care of the case where we have an odd # of values in the file*/
-	if(size == 2){
+	/*Every worker gets the same number of pairs (or groups), the last one also gets whatever doesnt divide evenly*/
+	pairCount = blockEnd / ctx->groupBytes;
+	pairsPerWorker = pairCount / threadCount;
+
+	for(i = 0; i < threadCount; i++){
+		workers[i].data = &fileData[i * pairsPerWorker * ctx->groupBytes];
+		workers[i].length = ((i == threadCount - 1) ? pairCount - i * pairsPerWorker : pairsPerWorker) * ctx->groupBytes;
+		/*Interleaved channels: the first value of the chunk isnt necessarily channel 0*/
+		workers[i].ctx.nextChannel = (int)(((unsigned long)(i * pairsPerWorker) * ctx->groupValues) % ctx->channelCount);
+		/*If we cant start a thread, this one just does its own share of the work*/
+		workers[i].started = (pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]) == 0);
+		if(!workers[i].started){
+			workerMain(&workers[i]);
+		}
+	}
 
-		/*Big to little endian for the 16 bit chunk - we can use the library function for this one*/
-		inputValues.word = ntohs((unsigned short int)inputValues.word);
-		/*Ignore the nibble*/
-		twelveBitValue = (inputValues.word >> 4) & Lower12BitMask;
-		/*Store the value in the circular buffer*/
-		lastValuesBuffer[lastValuesWriteIdx] = twelveBitValue;
-		/*Incriment the write index and wrap around if necessary*/
-		lastValuesWriteIdx = (lastValuesWriteIdx + 1) & 0x1F;
-		/*populate list with the value*/
-		listInsert(twelveBitValue);
-		
-		totalValueCount++;
+	/*Merge the partial results in file order, so the last values come out of the last chunks*/
+	for(i = 0; i < threadCount; i++){
+		if(workers[i].started){
+			pthread_join(workers[i].thread, NULL);
+		}
+		parserMerge(ctx, &workers[i].ctx);
+		parserDestroy(&workers[i].ctx);
 	}
 
-	/* 
-	 * Size = 1 indicates that for whatever reason, there are 8 bits at the end of the file.
-	 * These clearly can't contain another 12 bit value, so we ignore them.
-	 */
+	free(workers);
+
+	return 0;
 
 }
 
 
-/*This function inserts the value passed to it only if it is necessary*/
-void listInsert(unsigned short int value){
+/*Each worker decodes its share of the file into its own context. Nothing is shared, so no locking*/
+void * workerMain(void * context){
 
-	/*We keep track of 2 indexes here.
-	  1) The index of the struct we will clear and use for our new value
-	  2) A temp index used while we traverse the list
-	  3) A previous index that points to the node before nodeIdx (most of the time)
-	  using a prevIdx pointer makes the code easier to read
-	 */
-	unsigned short int smallestValue;
-	int index, nodeIdx, prevIdx;
+	workerContext * worker;
 
-	smallestValue = listPeek();
+	worker = (workerContext *)context;
 
-	/*First check to see if we need to add the value to the heap*/
-	/*WE will add the value under either of two conditions
-	  1) The value is greater than the minimum value
-	  2) The list is not yet full
-	  otherwise, return
-	 */
-	if(value <= smallestValue && listSize == NumberOfValuesToPrint){
-		return;
-	}
+	/*Every share is whole pairs, so there is never anything left to finish*/
+	parserFeed(&worker->ctx, worker->data, (size_t)worker->length);
 
-	/*If the list is already full we need to remove the min;*/
-	if(listSize == NumberOfValuesToPrint){
-		index = listRemove();
-	}
-	else{
-		/*When we first populate the list we use the array indicies in order*/
-		index = listSize;
+	return NULL;
+
+}
+
+
+/*This function reads the input in big chunks & feeds them to the parser*/
+int parseAccStream(parserCtx * ctx, int inputFd){
+
+	ssize_t size;
+
+	/*The parser carries partial pairs across feeds, so the chunks can be any size*/
+	while((size = readChunk(inputFd, &readBuffer[0], ReadBlockSize)) > 0){
+		parserFeed(ctx, &readBuffer[0], (size_t)size);
 	}
 
-	/*We now know where to store the value*/
-	maxList[index].value = value;
+	/*Whatever is still carried over is the end of the file*/
+	parserFinish(ctx);
 
-	/*now we figure out where to put it in the list*/
-	nodeIdx = listHead;
-	prevIdx = nodeIdx;
-	while(nodeIdx != -1){
-		/*Check if the value in the next largest node is greater than or equal to ours*/
-		/*If so, we place the node there*/
-		if(maxList[nodeIdx].value >= value){
-			break;
+	return (size < 0) ? -1 : 0;
+
+}
+
+
+/*This function does one big read() of whatever is available*/
+/*Returns the number of bytes read, 0 at the end of the input or -1 if the read failed*/
+ssize_t readChunk(int inputFd, unsigned char * buffer, size_t length){
+
+	ssize_t size;
+	struct pollfd waitFor;
+#ifdef ParserInstrument
+	double start;
+#endif
+
+	for(;;){
+
+#ifdef ParserInstrument
+		start = parserClock();
+		size = read(inputFd, buffer, length);
+		pthread_mutex_lock(&ioStatsLock);
+		ioStats.readSeconds += parserClock() - start;
+		ioStats.readCalls++;
+		ioStats.bytesRead += (size > 0) ? (unsigned long)size : 0;
+		pthread_mutex_unlock(&ioStatsLock);
+#else
+		size = read(inputFd, buffer, length);
+#endif
+		if(size >= 0){
+			return size;
 		}
-		/*Update our trailing pointer and move along*/
-		prevIdx = nodeIdx;
-		nodeIdx = maxList[nodeIdx].next;
-	}
 
+		/*Signals just mean try again*/
+		if(errno == EINTR){
+			continue;
+		}
 
-	/*We found the correct location in the list!*/
-	/*Need to handle the insert at head case separately*/
-	if(nodeIdx == listHead && listSize != 0){
-		maxList[index].next = listHead;
-		listHead = index;
-	}
-	else{
-		maxList[index].next = maxList[prevIdx].next;
-		/*For the first one, the two indicies are the same. We dont want a node that points to itself*/
-		if(listSize!=0){
-			maxList[prevIdx].next = index;
+		/*A non-blocking fd with nothing in it yet. Sleep until there is something to read*/
+		if(errno == EAGAIN || errno == EWOULDBLOCK){
+			waitFor.fd = inputFd;
+			waitFor.events = POLLIN;
+			if(poll(&waitFor, 1, -1) >= 0 || errno == EINTR){
+				continue;
+			}
 		}
-	}
 
-	listSize++;
+		return -1;
 
-	/*Whew!*/
-	return; 
+	}
 
 }
 
 
-/*Read the circular buffer and print out the last values read (should be <= 32 values)*/
-void printLastValues(FILE * outputFile){
+/*This function decodes a live stream (socket, pipe, ...) as the data shows up*/
+/*Every interval seconds the current results replace the output file, so a dashboard can just keep reading it*/
+int parseAccLive(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const char * outputPath, int interval, int bufferCount){
 
-	int i, j,readIdx;
-	
+	readPipeline pipeline;
+	bufferDescriptor buffer;
+	ringCounters counters;
+	struct pollfd waitFor;
+	unsigned long parserWaits;
+	double lastUpdate, waitLeft;
+	int piped, failed, ended, fresh, arrived, timeout;
 
-	/* j is how many values we print. If we read more than 32, we print 32. 
-	 * Otherwise, we print the number of values that we read.
-	 * 
-	 * readIdx is the location from where we start reading. If we read less than 32,
-	 * then the circular buffer has not yet looped and we read from index 0
-	 * Otherwise, we read from where the write index is
-	 */
-	if(totalValueCount >= NumberOfValuesToPrint)
-	{
-		readIdx = lastValuesWriteIdx;
-		j = NumberOfValuesToPrint;
+	lastUpdate = liveClock();
+
+	/*With -a the receiving happens on the pipeline's reader thread, so a slow update doesnt hold up the socket*/
+	piped = (bufferCount > 0 && pipelineStart(&pipeline, inputFd, bufferCount) == 0);
+	parserWaits = 0;
+	failed = 0;
+	ended = 0;
+	fresh = 0;
+
+	for(;;){
+
+		/*Only wait until the next update is due, so data right before the feed goes quiet still goes out on time*/
+		waitLeft = lastUpdate + interval - liveClock();
+		timeout = (waitLeft > 0) ? (int)(waitLeft * 1000) + 1 : 0;
+
+		/*read() gives us whatever has arrived instead of waiting for a whole chunk like fread would*/
+		if(piped){
+			arrived = (spscPopTimed(&pipeline.filled, &buffer, timeout) == 0);
+		}
+		else{
+			waitFor.fd = inputFd;
+			waitFor.events = POLLIN;
+			waitFor.revents = 0;
+			/*A hang up or an error counts as arrived too, read() then says what happened*/
+			arrived = (poll(&waitFor, 1, timeout) != 0);
+			if(arrived && waitFor.revents == 0){
+				arrived = 0;
+			}
+			if(arrived){
+				buffer.data = &readBuffer[0];
+				buffer.length = (long)readChunk(inputFd, &readBuffer[0], ReadBlockSize);
+			}
+		}
+
+		if(arrived){
+			if(buffer.length <= 0){
+				failed = (buffer.length < 0) ? -1 : 0;
+				ended = 1;
+				break;
+			}
+
+			/*Packets can be any size, the parser carries partial pairs over to the next one*/
+			parserFeed(ctx, buffer.data, (size_t)buffer.length);
+			fresh = 1;
+			if(piped){
+				spscPushWait(&pipeline.emptied, &buffer);
+			}
+		}
+
+		/*Nothing new means the output already has it all*/
+		if(liveClock() - lastUpdate >= interval){
+			lastUpdate = liveClock();
+			if(!fresh){
+				continue;
+			}
+			fresh = 0;
+			parserTakeSnapshot(ctx, snapshot);
+			if(writeSnapshotFile(snapshot, outputPath) != 0){
+				failed = -1;
+				break;
+			}
+
+			/*The reader only ever waits for a free buffer when we're not keeping up, so say so*/
+			if(piped){
+				spscCounters(&pipeline.emptied, &counters);
+				if(counters.emptyWaits > parserWaits){
+					fprintf(stderr, "Decoding is behind the input: the reader waited for a free buffer %lu times since the last update\n",
+					        counters.emptyWaits - parserWaits);
+					parserWaits = counters.emptyWaits;
+				}
+			}
+		}
+
+	}
+
+	/*A failed update leaves the reader going, so it has to be told to stop before it can be waited for*/
+	if(piped){
+		if(!ended){
+			pipelineCancel(&pipeline);
+		}
+		pipelineStop(&pipeline);
 	}
-	else
-	{
-		readIdx = 0;
-		j = totalValueCount;
+	if(failed != 0){
+		close(inputFd);
+		return -1;
 	}
 
-	fprintf(outputFile, "--Last 32 Values--\n");
+	/*The stream is over, so the last update has the final results*/
+	parserFinish(ctx);
+	parserTakeSnapshot(ctx, snapshot);
 
-	for(i = 0; i<j; i++)
-	{
-		fprintf(outputFile, "%hu\n", lastValuesBuffer[readIdx]);
-		readIdx = (readIdx + 1) & 0x1F;
+	if(close(inputFd) != 0){
+		return -1;
 	}
 
+	return writeSnapshotFile(snapshot, outputPath);
+
 }
 
 
-/*Iterate through the linked list and print out the values*/
-void printMaxValues(FILE * outputFile){
+/*This function reads the monotonic clock in seconds, so the live updates dont care about the time of day changing*/
+double liveClock(void){
 
-	int listIndex, i;
+	struct timespec now;
 
-	fprintf(outputFile, "--Sorted Max 32 Values--\n");
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	listIndex = listHead;
-	for(i = 0; i < listSize; i++){
-		fprintf(outputFile, "%hu\n", maxList[listIndex].value);
-		listIndex = maxList[listIndex].next;
-	}
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
 
 }
 
 
-/*This function removes the value at the head of the list.*/
-int listRemove(){
+/*This function replaces the output file with the snapshot*/
+/*It writes a temp file & renames it over the output, so anybody reading it never sees half an update*/
+int writeSnapshotFile(const parserSnapshot * snapshot, const char * outputPath){
+
+	FILE * outputFile;
+	char tempPath[4096];
 
-	int index;
-	/*Store it so we can return it*/
-	index = listHead;
-	/*Update the new list head, which is the second smallest value in the list*/
-	listHead = maxList[listHead].next;
-	/*Clean up the struct at the old index*/
-	maxList[index].next = -1;
-	listSize--;
+	/*stdout cant be replaced, so every update just gets appended to it*/
+	if(strcmp(outputPath, "-") == 0){
+		outputInit(&resultOutput, stdout);
+		outputSnapshot(&resultOutput, snapshot, resultFormat);
+		return outputFlush(&resultOutput);
+	}
 
-	return index;
+	if(strlen(outputPath) + 5 > sizeof(tempPath)){
+		return -1;
+	}
+	strcpy(tempPath, outputPath);
+	strcat(tempPath, ".tmp");
 
-}
+	outputFile = fopen(tempPath, "w+");
+	if(!outputFile){
+		return -1;
+	}
 
+	outputInit(&resultOutput, outputFile);
+	outputSnapshot(&resultOutput, snapshot, resultFormat);
+
+	if(outputFlush(&resultOutput) != 0){
+		fclose(outputFile);
+		return -1;
+	}
+	if(fclose(outputFile) != 0){
+		return -1;
+	}
+
+	return rename(tempPath, outputPath);
 
-/*Simple helper function to keep the code clean*/
-unsigned short int listPeek(){
-	return maxList[listHead].value;
 }
 
 
-/*Didnt find support in the standard library for converting 24 bit network order to byte order*/
-/*I just implemented it myself.*/
-void ntoh24Bit(void * word){
+/*This function decodes the capture as it grows & serves the results until we're told to stop*/
+int runTail(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const char * inputPath, const char * socketPath){
 
-	char tempChar;
-	char * wordPtr;
-	
-	wordPtr = (char *) word;
-	
-	tempChar = *(wordPtr+2);
-	*(wordPtr+2) = *wordPtr;
-	*wordPtr = tempChar;
-}
+	tailState tail;
+	struct sockaddr_un address;
+	struct sigaction action;
+	struct stat socketStat;
+	struct pollfd waiting[2];
+	int failed, ready;
+
+	tail.inputPath = inputPath;
+	tail.inputFd = inputFd;
+	tail.offset = 0;
+	tail.checkLength = 0;
+	tail.ctx = ctx;
+	tail.snapshot = snapshot;
+
+	/*A socket left behind by a tail that was killed would make the bind fail, anything else at that path stays*/
+	if(strlen(socketPath) >= sizeof(address.sun_path)){
+		return -1;
+	}
+	if(lstat(socketPath, &socketStat) == 0 && S_ISSOCK(socketStat.st_mode)){
+		unlink(socketPath);
+	}
+	memset(&address, 0x00, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+	tail.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(tail.listenFd < 0){
+		return -1;
+	}
+	if(bind(tail.listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(tail.listenFd, TailListenBacklog) != 0){
+		close(tail.listenFd);
+		return -1;
+	}
+
+	/*No SA_RESTART, so poll comes back when we're told to stop. A client hanging up on us shouldnt kill us*/
+	tailStop = 0;
+	memset(&action, 0x00, sizeof(action));
+	action.sa_handler = tailSignal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+
+	/*Without inotify we still get there, just up to TailPollMilliseconds late*/
+	tail.watchFd = -1;
+	tail.watchId = -1;
+#ifdef __linux__
+	tail.watchFd = inotify_init();
+#endif
+	tailWatch(&tail);
+
+	/**** Main Processing ****/
+	/*What's there already is the only time the whole file gets read*/
+	failed = tailCatchUp(&tail);
+	while(failed == 0 && !tailStop){
+
+		waiting[0].fd = tail.listenFd;
+		waiting[0].events = POLLIN;
+		waiting[1].fd = tail.watchFd;
+		waiting[1].events = POLLIN;
+		ready = poll(waiting, (tail.watchFd >= 0) ? 2 : 1, TailPollMilliseconds);
+		if(ready < 0 && errno != EINTR){
+			failed = -1;
+			break;
+		}
+
+		if(ready > 0 && tail.watchFd >= 0 && (waiting[1].revents & POLLIN)){
+			tailEvents(&tail);
+		}
+		failed = tailCatchUp(&tail);
+
+		/*Catching up first, so the answer has everything that was there when the client asked*/
+		if(ready > 0 && (waiting[0].revents & POLLIN)){
+			tailServe(&tail);
+		}
+
+	}
+
+	/**** Clean Up ****/
+	if(tail.watchFd >= 0){
+		close(tail.watchFd);
+	}
+	close(tail.listenFd);
+	unlink(socketPath);
+	close(tail.inputFd);
+
+	return failed;
+
+}
+
+
+/*This function reads from where we stopped to the end of the file with pread, so nothing before it is read twice*/
+int tailCatchUp(tailState * tail){
+
+	struct stat inputStat, pathStat;
+	unsigned char check[TailCheckBytes];
+	ssize_t size;
+	int inputFd;
+
+	if(fstat(tail->inputFd, &inputStat) != 0){
+		return -1;
+	}
+
+	/*A capture that was moved or deleted is still our open file, until another one shows up where it was*/
+	if(stat(tail->inputPath, &pathStat) == 0 && S_ISREG(pathStat.st_mode)
+	   && (pathStat.st_dev != inputStat.st_dev || pathStat.st_ino != inputStat.st_ino)){
+		inputFd = open(tail->inputPath, O_RDONLY);
+		if(inputFd >= 0){
+			close(tail->inputFd);
+			tail->inputFd = inputFd;
+			tailWatch(tail);
+			tailRestart(tail, "was replaced by another file");
+			if(fstat(tail->inputFd, &inputStat) != 0){
+				return -1;
+			}
+		}
+	}
+
+	/*Shorter means rewritten. So do different bytes where we stopped, which catches a rewrite that already got*/
+	/*past that point before we looked, or one that came out the same size. The same bytes cant decode differently*/
+	if(inputStat.st_size < tail->offset){
+		tailRestart(tail, "got shorter, so it was rewritten");
+	}
+	else if(tail->checkLength > 0){
+		size = pread(tail->inputFd, check, tail->checkLength, tail->offset - tail->checkLength);
+		if(size != tail->checkLength || memcmp(check, tail->checkBytes, tail->checkLength) != 0){
+			tailRestart(tail, "changed before where we were, so it was rewritten");
+		}
+	}
+
+	/*A pair cut in half by the writer stays in the context until the rest of it shows up*/
+	size = 0;
+	while(tail->offset < inputStat.st_size){
+		size = pread(tail->inputFd, &readBuffer[0], ReadBlockSize, tail->offset);
+		if(size < 0 && errno == EINTR){
+			continue;
+		}
+		if(size <= 0){
+			break;
+		}
+#ifdef ParserInstrument
+		pthread_mutex_lock(&ioStatsLock);
+		ioStats.readCalls++;
+		ioStats.bytesRead += (unsigned long)size;
+		pthread_mutex_unlock(&ioStatsLock);
+#endif
+		parserFeed(tail->ctx, &readBuffer[0], (size_t)size);
+		tail->offset += size;
+		tailKeepCheck(tail, &readBuffer[0], (int)size);
+	}
+
+	return (size < 0) ? -1 : 0;
+
+}
+
+
+/*This function keeps the last TailCheckBytes bytes that went to the parser, the ones from earlier reads too*/
+/*Reading them again from the file instead would take whatever is there by then as what we decoded*/
+void tailKeepCheck(tailState * tail, const unsigned char * data, int length){
+
+	int keep;
+
+	if(length >= TailCheckBytes){
+		memcpy(tail->checkBytes, &data[length - TailCheckBytes], TailCheckBytes);
+		tail->checkLength = TailCheckBytes;
+		return;
+	}
+
+	/*Slide what's already there down to make room*/
+	keep = (tail->checkLength < TailCheckBytes - length) ? tail->checkLength : TailCheckBytes - length;
+	memmove(tail->checkBytes, &tail->checkBytes[tail->checkLength - keep], keep);
+	memcpy(&tail->checkBytes[keep], data, length);
+	tail->checkLength = keep + length;
+
+}
+
+
+/*This function throws away everything decoded so far*/
+void tailRestart(tailState * tail, const char * reason){
+
+	fprintf(stderr, "%s %s. Starting over from the top\n", tail->inputPath, reason);
+	parserReset(tail->ctx);
+	tail->offset = 0;
+	tail->checkLength = 0;
+
+}
+
+
+/*This function moves the inotify watch over to the file we have open now*/
+void tailWatch(tailState * tail){
+
+#ifdef __linux__
+	if(tail->watchFd >= 0){
+		if(tail->watchId >= 0){
+			inotify_rm_watch(tail->watchFd, tail->watchId);
+		}
+		tail->watchId = inotify_add_watch(tail->watchFd, tail->inputPath, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+		if(tail->watchId < 0){
+			close(tail->watchFd);
+			tail->watchFd = -1;
+		}
+	}
+#endif
+	if(tail->watchFd < 0){
+		fprintf(stderr, "Cant watch %s for changes, looking at it every %d ms instead\n", tail->inputPath, TailPollMilliseconds);
+	}
+
+}
+
+
+/*This function goes through every event in the read, a move or delete can be queued up behind lots of changes*/
+void tailEvents(tailState * tail){
+
+#ifdef __linux__
+	struct inotify_event event;
+	unsigned char events[4096];
+	ssize_t eventBytes, position;
+	int moved;
+
+	eventBytes = read(tail->watchFd, events, sizeof(events));
+	moved = 0;
+	for(position = 0; position + (ssize_t)sizeof(event) <= eventBytes; position += (ssize_t)sizeof(event) + event.len){
+		/*The events are packed back to back, so the header isnt always aligned*/
+		memcpy(&event, &events[position], sizeof(event));
+		if(event.wd == tail->watchId && (event.mask & (IN_MOVE_SELF | IN_DELETE_SELF))){
+			moved = 1;
+		}
+	}
+	if(moved){
+		fprintf(stderr, "%s was moved or deleted, following what we have open until another file shows up there\n", tail->inputPath);
+	}
+#else
+	(void)tail;
+#endif
+
+}
+
+
+/*This function writes the current results to the next client & hangs up. The stream isnt over, so no parserFinish*/
+void tailServe(tailState * tail){
+
+	struct timeval timeout;
+	FILE * client;
+	int clientFd;
+
+	clientFd = accept(tail->listenFd, NULL, NULL);
+	if(clientFd < 0){
+		return;
+	}
+	timeout.tv_sec = TailSendSeconds;
+	timeout.tv_usec = 0;
+	setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	client = fdopen(clientFd, "w");
+	if(client == NULL){
+		close(clientFd);
+		return;
+	}
+
+	parserTakeSnapshot(tail->ctx, tail->snapshot);
+	outputInit(&resultOutput, client);
+	outputSnapshot(&resultOutput, tail->snapshot, resultFormat);
+	outputFlush(&resultOutput);
+	fclose(client);
+
+}
+
+
+/*This function just asks the tail loop to stop, everything else happens there*/
+void tailSignal(int signalNumber){
+
+	(void)signalNumber;
+	tailStop = 1;
+
+}
+
+
+/*This function expands every sample of the input into the output file*/
+/*Regular files get mapped, everything else is read in big chunks, same as the stats mode*/
+int unpackFile(int inputFd, const struct stat * inputStat, const char * outputPath, int useStdio, int direct){
+
+	unpackWriter writer;
+	int flags, readFailed;
+
+	writer.failed = 0;
+	writer.used = 0;
+	writer.carryLength = 0;
+	writer.capacity = UnpackWriteSize / sizeof(unsigned short int);
+	writer.sink = NULL;
+
+	/*O_DIRECT needs an aligned buffer. It's big, so it never goes on the stack*/
+	if(posix_memalign((void **)&writer.values, DirectIoAlignment, UnpackWriteSize) != 0){
+		return -1;
+	}
+
+	/*open the output. stdout cant be opened with O_DIRECT, so it just gets normal writes*/
+	writer.fd = -1;
+	writer.direct = 0;
+	if(strcmp(outputPath, "-") == 0){
+		writer.fd = STDOUT_FILENO;
+	}
+	else{
+		flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+		if(direct){
+			writer.fd = open(outputPath, flags | O_DIRECT, 0666);
+			writer.direct = (writer.fd >= 0);
+		}
+#endif
+		/*No O_DIRECT asked for, or the filesystem doesnt do it*/
+		if(writer.fd < 0){
+			writer.fd = open(outputPath, flags, 0666);
+		}
+	}
+
+	if(writer.fd < 0){
+		free(writer.values);
+		return -1;
+	}
+
+	/**** Main Processing ****/
+	readFailed = unpackInput(&writer, inputFd, inputStat, useStdio);
+
+	/**** Clean Up ****/
+	free(writer.values);
+	if(writer.fd != STDOUT_FILENO && close(writer.fd) != 0){
+		writer.failed = 1;
+	}
+
+	return (readFailed || writer.failed) ? -1 : 0;
+
+}
+
+
+/*This function runs the whole input through the writer*/
+/*Regular files get mapped, everything else is read in big chunks, same as the stats mode*/
+int unpackInput(unpackWriter * writer, int inputFd, const struct stat * inputStat, int useStdio){
+
+	const unsigned char * fileData;
+	ssize_t size;
+	int mapped;
+
+	mapped = 0;
+	size = 0;
+	if(!useStdio && S_ISREG(inputStat->st_mode) && inputStat->st_size > 0 && (off_t)(size_t)inputStat->st_size == inputStat->st_size){
+
+		fileData = mmap(NULL, (size_t)inputStat->st_size, PROT_READ, MAP_PRIVATE, inputFd, 0);
+		if(fileData != MAP_FAILED){
+			madvise((void *)fileData, (size_t)inputStat->st_size, MADV_SEQUENTIAL);
+			unpackFeed(writer, fileData, (size_t)inputStat->st_size);
+			munmap((void *)fileData, (size_t)inputStat->st_size);
+			mapped = 1;
+		}
+
+	}
+
+	if(!mapped){
+		while((size = readChunk(inputFd, &readBuffer[0], ReadBlockSize)) > 0){
+			unpackFeed(writer, &readBuffer[0], (size_t)size);
+		}
+	}
+
+	unpackFinish(writer);
+
+	return (size < 0) ? -1 : 0;
+
+}
+
+
+/*This function decodes the input with the unpack mode's decoder & keeps the stats of one window at a time*/
+int windowFile(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const struct stat * inputStat, int useStdio, unsigned long windowValues){
+
+	unpackWriter writer;
+	windowState window;
+	unsigned short int * batch;
+	int readFailed;
+
+	batch = malloc(WindowBatchValues * sizeof(unsigned short int));
+	if(batch == NULL){
+		return -1;
+	}
+
+	writer.fd = -1;
+	writer.direct = 0;
+	writer.failed = 0;
+	writer.values = batch;
+	writer.capacity = WindowBatchValues;
+	writer.used = 0;
+	writer.carryLength = 0;
+	writer.sink = windowSink;
+	writer.sinkContext = &window;
+
+	window.ctx = ctx;
+	window.snapshot = snapshot;
+	window.format = resultFormat;
+	window.windowValues = windowValues;
+	window.stats.index = 0;
+	window.stats.first = 0;
+	window.stats.count = 0;
+	window.sum = 0;
+	window.stats.min = ValueRange;
+	window.stats.max = 0;
+	parserReset(ctx);
+
+	readFailed = unpackInput(&writer, inputFd, inputStat, useStdio);
+
+	/*The last window is usually short*/
+	if(window.stats.count > 0){
+		windowEmit(&window);
+	}
+
+	free(batch);
+
+	return readFailed;
+
+}
+
+
+/*This function splits a batch of values at the window boundaries*/
+void windowSink(void * context, const unsigned short int * values, size_t count){
+
+	windowState * window;
+	size_t part, i;
+
+	window = context;
+
+	while(count > 0){
+
+		part = window->windowValues - window->stats.count;
+		if(part > count){
+			part = count;
+		}
+
+		/*min, max & sum are simple enough to do right here. The largest values go to the parser*/
+		for(i = 0; i < part; i++){
+			if(values[i] < window->stats.min){
+				window->stats.min = values[i];
+			}
+			if(values[i] > window->stats.max){
+				window->stats.max = values[i];
+			}
+			window->sum += values[i];
+		}
+		parserFeedValues(window->ctx, values, (int)part);
+
+		window->stats.count += part;
+		values += part;
+		count -= part;
+
+		if(window->stats.count == window->windowValues){
+			windowEmit(window);
+		}
+
+	}
+
+}
+
+
+/*This function writes out the current window & starts the next one*/
+void windowEmit(windowState * window){
+
+	window->stats.mean = window->sum / (double)window->stats.count;
+	parserTakeSnapshot(window->ctx, window->snapshot);
+	outputWindow(&resultOutput, &window->stats, window->snapshot, window->format);
+
+	window->stats.index++;
+	window->stats.first += window->stats.count;
+	window->stats.count = 0;
+	window->sum = 0;
+	window->stats.min = ValueRange;
+	window->stats.max = 0;
+	parserReset(window->ctx);
+
+}
+
+
+/*This function unpacks whatever complete pairs it gets & carries the rest over to the next call*/
+void unpackFeed(unpackWriter * writer, const unsigned char * bytes, size_t length){
+
+	size_t pairCount;
+
+	/*First finish off the pair that was split across the last read*/
+	if(writer->carryLength > 0){
+
+		while(writer->carryLength < 3 && length > 0){
+			writer->carry[writer->carryLength++] = *bytes++;
+			length--;
+		}
+
+		if(writer->carryLength < 3){
+			return;
+		}
+
+		unpackPairs(writer, &writer->carry[0], 1);
+		writer->carryLength = 0;
+
+	}
+
+	pairCount = length / 3;
+	unpackPairs(writer, bytes, pairCount);
+
+	/*Hang on to the 0-2 leftover bytes*/
+	for(bytes += pairCount * 3, length -= pairCount * 3; length > 0; length--){
+		writer->carry[writer->carryLength++] = *bytes++;
+	}
+
+}
+
+
+/*This function runs the unpack kernel straight into the write buffer, a buffer full at a time*/
+void unpackPairs(unpackWriter * writer, const unsigned char * bytes, size_t pairCount){
+
+	size_t count;
+
+	while(pairCount > 0){
+
+		count = (writer->capacity - writer->used) / 2;
+		if(count > pairCount){
+			count = pairCount;
+		}
+
+		unpack12Pairs(bytes, (int)count, &writer->values[writer->used]);
+
+		writer->used += count * 2;
+		bytes += count * 3;
+		pairCount -= count;
+
+		/*The buffer holds an even # of values, so it's either full or has room for another pair*/
+		if(writer->used == writer->capacity){
+			unpackDrain(writer);
+		}
+
+	}
+
+}
+
+
+/*This function adds the last value of an odd length file & writes out the rest*/
+void unpackFinish(unpackWriter * writer){
+
+	/*Same as decodeTail: 16 bits, big endian, ignore the nibble. A single byte at the end is ignored*/
+	if(writer->carryLength == 2){
+		writer->values[writer->used++] = (((unsigned int)writer->carry[0] << 4) | (writer->carry[1] >> 4)) & Lower12BitMask;
+	}
+	writer->carryLength = 0;
+
+	unpackDrain(writer);
+
+}
+
+
+/*This function writes out the buffer as little endian uint16s*/
+void unpackDrain(unpackWriter * writer){
+
+	static const unsigned short int byteOrder = 1;
+	size_t length, aligned, i;
+
+	/*Somebody else wants the values, not a file*/
+	if(writer->sink != NULL){
+		writer->sink(writer->sinkContext, writer->values, writer->used);
+		writer->used = 0;
+		return;
+	}
+
+	/*The kernels write native uint16s, which only need swapping on big endian machines*/
+	if(*(const unsigned char *)&byteOrder == 0){
+		for(i = 0; i < writer->used; i++){
+			writer->values[i] = (unsigned short int)((writer->values[i] << 8) | (writer->values[i] >> 8));
+		}
+	}
+
+	length = writer->used * sizeof(unsigned short int);
+	aligned = writer->direct ? length - (length % DirectIoAlignment) : length;
+
+	if(writeAll(writer->fd, writer->values, aligned) != 0){
+		writer->failed = 1;
+	}
+
+#ifdef O_DIRECT
+	/*Only the very last write can be a partial block. It has to go through the page cache*/
+	if(aligned < length){
+		if(fcntl(writer->fd, F_SETFL, fcntl(writer->fd, F_GETFL) & ~O_DIRECT) != 0){
+			writer->failed = 1;
+		}
+		writer->direct = 0;
+		if(writeAll(writer->fd, (const unsigned char *)writer->values + aligned, length - aligned) != 0){
+			writer->failed = 1;
+		}
+	}
+#endif
+
+	writer->used = 0;
+
+}
+
+
+/*This function keeps calling write() until everything is out*/
+int writeAll(int outputFd, const void * bytes, size_t length){
+
+	const unsigned char * next;
+	ssize_t size;
+
+	next = bytes;
+	while(length > 0){
+
+		size = write(outputFd, next, length);
+		if(size < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+
+		next += size;
+		length -= (size_t)size;
+
+	}
+
+	return 0;
+
+}
+
+
+/*This function packs every value of the input into the output file*/
+/*Regular files get mapped, everything else is read in big chunks*/
+int packFile(int inputFd, const struct stat * inputStat, const char * outputPath, int useStdio){
+
+	packWriter * writer;
+	const unsigned char * fileData;
+	ssize_t size;
+	size_t length, pending, used;
+	int mapped;
+
+	/*The writer has a batch of values in it, so it doesnt go on the stack*/
+	writer = malloc(sizeof(packWriter));
+	if(writer == NULL){
+		return -1;
+	}
+	writer->bytes = malloc(PackWriteSize);
+	if(writer->bytes == NULL){
+		free(writer);
+		return -1;
+	}
+	writer->failed = 0;
+	writer->used = 0;
+
+	writer->fd = (strcmp(outputPath, "-") == 0) ? STDOUT_FILENO : open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(writer->fd < 0){
+		free(writer->bytes);
+		free(writer);
+		return -1;
+	}
+
+	/**** Main Processing ****/
+	mapped = 0;
+	size = 0;
+	if(!useStdio && S_ISREG(inputStat->st_mode) && inputStat->st_size > 0 && (off_t)(size_t)inputStat->st_size == inputStat->st_size){
+
+		fileData = mmap(NULL, (size_t)inputStat->st_size, PROT_READ, MAP_PRIVATE, inputFd, 0);
+		if(fileData != MAP_FAILED){
+			madvise((void *)fileData, (size_t)inputStat->st_size, MADV_SEQUENTIAL);
+			length = (size_t)inputStat->st_size;
+			used = length - (length % 4);
+			packFeed(writer, fileData, used);
+			packFinish(writer, &fileData[used], length - used);
+			munmap((void *)fileData, (size_t)inputStat->st_size);
+			mapped = 1;
+		}
+
+	}
+
+	/*Reads can end anywhere, so the 0-3 bytes after the last whole pair get moved to the front for the next read*/
+	if(!mapped){
+		pending = 0;
+		while((size = readChunk(inputFd, &readBuffer[pending], ReadBlockSize - pending)) > 0){
+			length = pending + (size_t)size;
+			used = length - (length % 4);
+			packFeed(writer, &readBuffer[0], used);
+			pending = length - used;
+			memmove(&readBuffer[0], &readBuffer[used], pending);
+		}
+		packFinish(writer, &readBuffer[0], pending);
+	}
+
+	/**** Clean Up ****/
+	if(writer->fd != STDOUT_FILENO && close(writer->fd) != 0){
+		writer->failed = 1;
+	}
+	mapped = writer->failed;
+	free(writer->bytes);
+	free(writer);
+
+	return (size < 0 || mapped) ? -1 : 0;
+
+}
+
+
+/*This function packs whole pairs straight into the write buffer, a buffer full at a time*/
+void packFeed(packWriter * writer, const unsigned char * bytes, size_t length){
+
+	static const unsigned short int byteOrder = 1;
+	const unsigned short int * values;
+	size_t pairCount, count, i;
+	int native;
+
+	/*On a little endian machine an aligned input already is an array of uint16s, so the kernel can read it directly*/
+	native = (*(const unsigned char *)&byteOrder == 1) && (((size_t)bytes & 1) == 0);
+
+	for(pairCount = length / 4; pairCount > 0; pairCount -= count){
+
+		count = (PackWriteSize - writer->used) / 3;
+		if(count > pairCount){
+			count = pairCount;
+		}
+
+		if(native){
+			values = (const unsigned short int *)bytes;
+		}
+		else{
+			/*Put the values together ourselves, a batch at a time*/
+			if(count > DecodeBatchPairs){
+				count = DecodeBatchPairs;
+			}
+			for(i = 0; i < count * 2; i++){
+				writer->values[i] = (unsigned short int)(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+			}
+			values = &writer->values[0];
+		}
+
+		pack12Pairs(values, (int)count, &writer->bytes[writer->used]);
+
+		writer->used += count * 3;
+		bytes += count * 4;
+
+		/*PackWriteSize is a multiple of 3, so the buffer is either full or has room for another pair*/
+		if(writer->used == PackWriteSize){
+			if(writeAll(writer->fd, writer->bytes, writer->used) != 0){
+				writer->failed = 1;
+			}
+			writer->used = 0;
+		}
+
+	}
+
+}
+
+
+/*This function packs the last value of an odd length input & writes out the rest*/
+void packFinish(packWriter * writer, const unsigned char * tail, size_t length){
+
+	unsigned int value;
+
+	/*An odd value at the end goes in 16 bits, big endian, with the low nibble empty. A single stray byte is ignored*/
+	if(length >= 2){
+		value = (tail[0] | ((unsigned int)tail[1] << 8)) & Lower12BitMask;
+		writer->bytes[writer->used++] = (unsigned char)(value >> 4);
+		writer->bytes[writer->used++] = (unsigned char)((value & 0xF) << 4);
+	}
+
+	if(writeAll(writer->fd, writer->bytes, writer->used) != 0){
+		writer->failed = 1;
+	}
+	writer->used = 0;
+
+}
+
+
+/*Every 3 bytes are two values, and 2 bytes at the end are one more*/
+unsigned long fileValueCount(off_t fileSize){
+
+	return (unsigned long)(fileSize / 3) * 2 + ((fileSize % 3 == 2) ? 1 : 0);
+
+}
+
+
+/*This function reads & decodes just the pairs that hold the values we want*/
+const unsigned short int * readValues(int inputFd, off_t fileSize, unsigned long first, unsigned long count){
+
+	off_t offset;
+	size_t length, done;
+	ssize_t size;
+
+	/*Value first is in the pair at byte (first / 2) * 3. If first is odd we decode the value before it too*/
+	offset = (off_t)(first / 2) * 3;
+	length = ((first % 2 + count + 1) / 2) * 3;
+	/*The last value might be the 2 byte tail*/
+	if(offset + (off_t)length > fileSize){
+		length = (size_t)(fileSize - offset);
+	}
+
+	for(done = 0; done < length; done += (size_t)size){
+		size = pread(inputFd, &readBuffer[done], length - done, offset + (off_t)done);
+		if(size < 0 && errno == EINTR){
+			size = 0;
+		}
+		else if(size <= 0){
+			return NULL;
+		}
+	}
+
+	unpack12Pairs(&readBuffer[0], (int)(length / 3), &rangeValues[0]);
+
+	/*Same as decodeTail: 16 bits, big endian, ignore the nibble*/
+	if(length % 3 == 2){
+		rangeValues[(length / 3) * 2] = (((unsigned int)readBuffer[length - 2] << 4) | (readBuffer[length - 1] >> 4)) & Lower12BitMask;
+	}
+
+	return &rangeValues[first % 2];
+
+}
+
+
+/*This function feeds a range of values to the parser, a block at a time*/
+int feedValueRange(parserCtx * ctx, int inputFd, off_t fileSize, unsigned long first, unsigned long end){
+
+	const unsigned short int * values;
+	unsigned long count;
+
+	for(; first < end; first += count){
+
+		count = end - first;
+		if(count > IndexBlockValues){
+			count = IndexBlockValues;
+		}
+
+		values = readValues(inputFd, fileSize, first, count);
+		if(values == NULL){
+			return -1;
+		}
+
+		parserFeedValues(ctx, values, (int)count);
+
+	}
+
+	return 0;
+
+}
+
+
+/*This function finds the largest values in a range, using the index to skip whatever it can*/
+int rangeMaxValues(parserCtx * ctx, int inputFd, off_t fileSize, unsigned long first, unsigned long end, const valueIndex * index){
+
+	indexBlock * candidates;
+	unsigned long block, candidateCount, i, wholeFirst, wholeEnd;
+	int threshold;
+
+	if(index == NULL){
+		return feedValueRange(ctx, inputFd, fileSize, first, end);
+	}
+
+	/*The whole blocks inside the range. Only the last block of the file is ever shorter than blockValues*/
+	block = (first + index->blockValues - 1) / index->blockValues;
+	wholeFirst = block * index->blockValues;
+	wholeEnd = wholeFirst;
+	candidateCount = 0;
+	candidates = malloc((index->blockCount + 1) * sizeof(indexBlock));
+	if(candidates == NULL){
+		return -1;
+	}
+	for(; block < index->blockCount && index->blocks[block].first + index->blocks[block].count <= end; block++){
+		candidates[candidateCount++] = index->blocks[block];
+		wholeEnd = index->blocks[block].first + index->blocks[block].count;
+	}
+
+	/*No whole blocks at all (a small range), so it all just gets decoded*/
+	if(candidateCount == 0){
+		free(candidates);
+		return feedValueRange(ctx, inputFd, fileSize, first, end);
+	}
+
+	/*The partial blocks at either end have to be decoded anyway. Doing them first gets us a threshold*/
+	if(feedValueRange(ctx, inputFd, fileSize, first, wholeFirst) != 0 || feedValueRange(ctx, inputFd, fileSize, wholeEnd, end) != 0){
+		free(candidates);
+		return -1;
+	}
+
+	/*Biggest max first. Once a block cant beat the threshold, none of the ones after it can either*/
+	qsort(candidates, candidateCount, sizeof(indexBlock), compareBlockMax);
+	for(i = 0; i < candidateCount; i++){
+
+		threshold = parserMaxThreshold(ctx);
+		if(threshold >= 0 && candidates[i].max <= threshold){
+			break;
+		}
+
+		if(feedValueRange(ctx, inputFd, fileSize, candidates[i].first, candidates[i].first + candidates[i].count) != 0){
+			free(candidates);
+			return -1;
+		}
+
+	}
+
+	free(candidates);
+
+	return 0;
+
+}
+
+
+/*Simple compare function for qsort. Biggest max first, then in file order*/
+int compareBlockMax(const void * a, const void * b){
+
+	const indexBlock * blockA;
+	const indexBlock * blockB;
+
+	blockA = a;
+	blockB = b;
+
+	if(blockA->max != blockB->max){
+		return (blockA->max > blockB->max) ? -1 : 1;
+	}
+
+	return (blockA->first < blockB->first) ? -1 : (blockA->first > blockB->first);
+
+}
+
+
+/*This function decodes the whole file one index block at a time & writes out the min, max & count of each*/
+int buildIndex(int inputFd, off_t fileSize, const char * indexPath){
+
+	FILE * indexFile;
+	const unsigned short int * values;
+	unsigned long totalValues, blockCount, first, count, i;
+	unsigned short int min, max;
+	int failed;
+
+	indexFile = fopen(indexPath, "w+");
+	if(!indexFile){
+		return -1;
+	}
+
+	totalValues = fileValueCount(fileSize);
+	blockCount = (totalValues + IndexBlockValues - 1) / IndexBlockValues;
+
+	/*The file size is in there so we can tell when an index doesnt belong to a file*/
+	outputInit(&resultOutput, indexFile);
+	outputLittleEndian(&resultOutput, IndexMagic, 4);
+	outputLittleEndian(&resultOutput, IndexVersion, 4);
+	outputLittleEndian(&resultOutput, IndexBlockValues, 4);
+	outputLittleEndian(&resultOutput, blockCount, 4);
+	outputLittleEndian(&resultOutput, totalValues & 0xFFFFFFFFUL, 4);
+	outputLittleEndian(&resultOutput, (totalValues >> 16) >> 16, 4);
+	outputLittleEndian(&resultOutput, (unsigned long)fileSize & 0xFFFFFFFFUL, 4);
+	outputLittleEndian(&resultOutput, ((unsigned long)fileSize >> 16) >> 16, 4);
+
+	failed = 0;
+	for(first = 0; first < totalValues; first += count){
+
+		count = totalValues - first;
+		if(count > IndexBlockValues){
+			count = IndexBlockValues;
+		}
+
+		values = readValues(inputFd, fileSize, first, count);
+		if(values == NULL){
+			failed = 1;
+			break;
+		}
+
+		min = max = values[0];
+		for(i = 1; i < count; i++){
+			if(values[i] < min){
+				min = values[i];
+			}
+			if(values[i] > max){
+				max = values[i];
+			}
+		}
+
+		outputLittleEndian(&resultOutput, min, 2);
+		outputLittleEndian(&resultOutput, max, 2);
+		outputLittleEndian(&resultOutput, count, 4);
+
+	}
+
+	if(outputFlush(&resultOutput) != 0){
+		failed = 1;
+	}
+	if(fclose(indexFile) != 0){
+		failed = 1;
+	}
+
+	return failed ? -1 : 0;
+
+}
+
+
+/*This function reads a whole sidecar index into memory*/
+int loadIndex(const char * indexPath, off_t fileSize, valueIndex * index){
+
+	FILE * indexFile;
+	unsigned char header[IndexHeaderSize], record[IndexRecordSize];
+	unsigned long i, first, size;
+
+	indexFile = fopen(indexPath, "r");
+	if(!indexFile){
+		return -1;
+	}
+
+	size = (unsigned long)fileSize;
+	if(fread(header, 1, IndexHeaderSize, indexFile) != IndexHeaderSize
+	   || readLittleEndian(&header[0], 4) != IndexMagic || readLittleEndian(&header[4], 4) != IndexVersion
+	   || readLittleEndian(&header[8], 4) == 0 || (readLittleEndian(&header[8], 4) & 1) != 0
+	   || readLittleEndian(&header[24], 4) != (size & 0xFFFFFFFFUL) || readLittleEndian(&header[28], 4) != ((size >> 16) >> 16)){
+		fclose(indexFile);
+		return -1;
+	}
+
+	index->blockValues = readLittleEndian(&header[8], 4);
+	index->blockCount = readLittleEndian(&header[12], 4);
+	index->blocks = malloc((index->blockCount + 1) * sizeof(indexBlock));
+	if(index->blocks == NULL){
+		fclose(indexFile);
+		return -1;
+	}
+
+	first = 0;
+	for(i = 0; i < index->blockCount; i++){
+		if(fread(record, 1, IndexRecordSize, indexFile) != IndexRecordSize){
+			free(index->blocks);
+			index->blocks = NULL;
+			fclose(indexFile);
+			return -1;
+		}
+		index->blocks[i].first = first;
+		index->blocks[i].min = (unsigned short int)readLittleEndian(&record[0], 2);
+		index->blocks[i].max = (unsigned short int)readLittleEndian(&record[2], 2);
+		index->blocks[i].count = readLittleEndian(&record[4], 4);
+		first += index->blocks[i].count;
+	}
+
+	fclose(indexFile);
+
+	/*The blocks have to add up to the file, or the index is broken*/
+	if(first != fileValueCount(fileSize)){
+		free(index->blocks);
+		index->blocks = NULL;
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+unsigned long readLittleEndian(const unsigned char * bytes, int size){
+
+	unsigned long value;
+
+	value = 0;
+	while(size > 0){
+		size--;
+		value = (value << 8) | bytes[size];
+	}
+
+	return value;
+
+}
+
+
+/*This function loads every partial & folds them into the first one, then writes the result*/
+int runMerge(const char * outputPath, const char * const * inputs, int inputCount){
+
+	FILE * outputFile;
+	parserPartial merged, partial;
+	parserSnapshot snapshot;
+	int i, failed;
+
+	if(loadPartial(inputs[0], &merged) != 0){
+		printf("Couldnt load the partial result %s.\n", inputs[0]);
+		return -1;
+	}
+
+	/*The merge is associative, so we just go down the list. Each partial is read with its own settings & checked by the merge*/
+	for(i = 1; i < inputCount; i++){
+		if(loadPartial(inputs[i], &partial) != 0){
+			printf("Couldnt load the partial result %s.\n", inputs[i]);
+			parserPartialFree(&merged);
+			return -1;
+		}
+		failed = parserPartialMerge(&merged, &partial);
+		parserPartialFree(&partial);
+		if(failed == -2){
+			printf("%s covers some of the same values as the partials before it, check the -o offsets.\n", inputs[i]);
+			parserPartialFree(&merged);
+			return -1;
+		}
+		if(failed != 0){
+			printf("%s wasnt made with the same -n & -b as %s.\n", inputs[i], inputs[0]);
+			parserPartialFree(&merged);
+			return -1;
+		}
+	}
+
+	outputFile = (strcmp(outputPath, "-") == 0) ? stdout : fopen(outputPath, "w+");
+	if(!outputFile){
+		printf("Error opening one of the files! \n");
+		parserPartialFree(&merged);
+		return -1;
+	}
+
+	/*A partial goes out as it is, so the merge can go on at the next level of the tree*/
+	outputInit(&resultOutput, outputFile);
+	failed = 0;
+	if(resultFormat == FormatPartial){
+		outputPartial(&resultOutput, &merged);
+	}
+	else if(parserSnapshotInitValues(&snapshot, merged.valuesToPrint) == 0){
+		parserPartialSnapshot(&merged, &snapshot);
+		outputSnapshot(&resultOutput, &snapshot, resultFormat);
+		parserSnapshotFree(&snapshot);
+	}
+	else{
+		failed = -1;
+	}
+	parserPartialFree(&merged);
+
+	if(outputFlush(&resultOutput) != 0 || failed != 0 || (outputFile != stdout && fclose(outputFile) != 0)){
+		printf("Error reading or writing one of the files! \n");
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/*This function reads a partial result back in, checking everything the merge relies on*/
+int loadPartial(const char * path, parserPartial * partial){
+
+	FILE * inputFile;
+	unsigned char header[sizeof(partialRecordHeader)], record[16];
+	unsigned long bins, statsFirst, statsCount, value, runValues;
+	int sampleBits, valuesToPrint, maxCount, lastCount, runCount, flags, i;
+
+	inputFile = fopen(path, "r");
+	if(!inputFile){
+		return -1;
+	}
+
+	/*Anything we dont know how to merge gets rejected here, so the merge itself doesnt have to check*/
+	if(fread(header, 1, sizeof(header), inputFile) != sizeof(header)
+	   || readLittleEndian(&header[0], 4) != PartialRecordMagic || readLittleEndian(&header[4], 4) != PartialRecordVersion){
+		fclose(inputFile);
+		return -1;
+	}
+	sampleBits = (int)readLittleEndian(&header[8], 4);
+	valuesToPrint = (int)readLittleEndian(&header[12], 4);
+	maxCount = (int)readLittleEndian(&header[40], 4);
+	lastCount = (int)readLittleEndian(&header[44], 4);
+	runCount = (int)readLittleEndian(&header[48], 4);
+	flags = (int)readLittleEndian(&header[52], 4);
+	statsFirst = readLittleEndian(&header[56], 4);
+	statsCount = readLittleEndian(&header[60], 4);
+	bins = 1UL << ((sampleBits > 0 && sampleBits <= 16) ? sampleBits : 0);
+	if((sampleBits != 10 && sampleBits != 12 && sampleBits != 14) || valuesToPrint <= 0 || valuesToPrint > MaxValuesToPrint
+	   || maxCount < 0 || maxCount > valuesToPrint || lastCount < 0 || lastCount > valuesToPrint
+	   || runCount < 0 || runCount > lastCount || statsFirst + statsCount > bins || statsCount > bins){
+		fclose(inputFile);
+		return -1;
+	}
+
+	if(parserPartialInit(partial, valuesToPrint, sampleBits, (flags & PartialHasStats) != 0) != 0){
+		fclose(inputFile);
+		return -1;
+	}
+	partial->totalValueCount = readLittleEndian(&header[16], 4) | ((readLittleEndian(&header[20], 4) << 16) << 16);
+	partial->firstValue = readLittleEndian(&header[24], 4) | ((readLittleEndian(&header[28], 4) << 16) << 16);
+	partial->endValue = readLittleEndian(&header[32], 4) | ((readLittleEndian(&header[36], 4) << 16) << 16);
+	partial->maxCount = maxCount;
+	partial->lastCount = lastCount;
+	partial->runCount = runCount;
+
+	if(readPartialValues(inputFile, partial->maxValues, maxCount, bins) != 0
+	   || readPartialValues(inputFile, partial->lastValues, lastCount, bins) != 0){
+		parserPartialFree(partial);
+		fclose(inputFile);
+		return -1;
+	}
+
+	/*The runs have to be in order, not overlap & cover exactly the last values*/
+	runValues = 0;
+	for(i = 0; i < runCount; i++){
+		if(fread(record, 1, 16, inputFile) != 16){
+			break;
+		}
+		partial->runs[i].first = readLittleEndian(&record[0], 4) | ((readLittleEndian(&record[4], 4) << 16) << 16);
+		partial->runs[i].count = (int)readLittleEndian(&record[8], 4);
+		if(partial->runs[i].count <= 0 || (i > 0 && partial->runs[i].first < partial->runs[i - 1].first + partial->runs[i - 1].count)){
+			break;
+		}
+		runValues += partial->runs[i].count;
+	}
+	if(i < runCount || runValues != (unsigned long)lastCount){
+		parserPartialFree(partial);
+		fclose(inputFile);
+		return -1;
+	}
+
+	if(partial->statsBins != NULL){
+		for(value = statsFirst; value < statsFirst + statsCount; value++){
+			if(fread(record, 1, 8, inputFile) != 8){
+				break;
+			}
+			partial->statsBins[value] = readLittleEndian(&record[0], 4) | ((readLittleEndian(&record[4], 4) << 16) << 16);
+		}
+		if(value < statsFirst + statsCount){
+			parserPartialFree(partial);
+			fclose(inputFile);
+			return -1;
+		}
+	}
+
+	fclose(inputFile);
+
+	return 0;
+
+}
+
+
+/*This function reads one of the uint16 sections of a partial*/
+int readPartialValues(FILE * inputFile, unsigned short int * values, int count, unsigned long limit){
+
+	unsigned char bytes[2];
+	int i;
+
+	for(i = 0; i < count; i++){
+		if(fread(bytes, 1, 2, inputFile) != 2 || readLittleEndian(bytes, 2) >= limit){
+			return -1;
+		}
+		values[i] = (unsigned short int)readLittleEndian(bytes, 2);
+	}
+
+	/*Every section is padded to a multiple of 8 bytes*/
+	for(i = (2 * count) % 8; i != 0 && i < 8; i += 2){
+		if(fread(bytes, 1, 2, inputFile) != 2){
+			return -1;
+		}
+	}
+
+	return 0;
+
+}
+
+
+/*This function sets up the batch, runs the workers & writes the results*/
+int runBatch(const char * outputPath, const char * const * inputs, int inputCount, const char * manifestPath, int perInput,
+             int valuesToPrint, maxValueEngine engine, int useStdio, inputCodec codec){
+
+	batchPool pool;
+	batchWorker * worker;
+	FILE * outputFile;
+	int i, failed;
+
+	pool.jobs = NULL;
+	pool.jobCount = 0;
+	pool.jobCapacity = 0;
+	pool.outputDir = perInput ? outputPath : NULL;
+	pool.format = resultFormat;
+	pool.useStdio = useStdio;
+	pool.codec = codec;
+
+	/*An input that turns out to be compressed gets checked when its turn comes*/
+	failed = (checkCodec(codec, NULL) != 0);
+	for(i = 0; i < inputCount && !failed; i++){
+		failed = (addBatchInput(&pool, inputs[i]) != 0);
+	}
+	if(!failed && manifestPath != NULL && readManifest(&pool, manifestPath) != 0){
+		printf("Error reading the manifest %s! \n", manifestPath);
+		failed = 1;
+	}
+	if(!failed && pool.jobCount == 0){
+		printf("The batch mode needs at least one input file.\n");
+		failed = 1;
+	}
+	if(!failed && perInput && nameBatchOutputs(&pool) != 0){
+		failed = 1;
+	}
+
+	/*No point having more threads than files*/
+	pool.workerCount = failed ? 0 : ((threadCount < pool.jobCount) ? threadCount : pool.jobCount);
+	pool.workers = failed ? NULL : malloc(pool.workerCount * sizeof(batchWorker));
+	if(!failed && pool.workers == NULL){
+		printf("Couldnt allocate the batch workers!\n");
+		failed = 1;
+	}
+
+	/*Every worker gets its own context, buffers & an even share of the inputs to start with*/
+	for(i = 0; !failed && i < pool.workerCount; i++){
+
+		worker = &pool.workers[i];
+		worker->pool = &pool;
+		worker->id = i;
+		worker->nextJob = (int)((long)pool.jobCount * i / pool.workerCount);
+		worker->endJob = (int)((long)pool.jobCount * (i + 1) / pool.workerCount);
+		worker->buffer = malloc(ReadBlockSize);
+		worker->writer = perInput ? malloc(sizeof(outputWriter)) : NULL;
+		worker->started = 0;
+
+		if(worker->buffer == NULL || (perInput && worker->writer == NULL) || parserInit(&worker->ctx, valuesToPrint, engine) != 0){
+			free(worker->buffer);
+			free(worker->writer);
+			printf("Couldnt allocate room for %d values!\n", valuesToPrint);
+			pool.workerCount = i;
+			failed = 1;
+		}
+		else if(parserSnapshotInit(&worker->snapshot, &worker->ctx) != 0){
+			free(worker->buffer);
+			free(worker->writer);
+			parserDestroy(&worker->ctx);
+			printf("Couldnt allocate room for %d values!\n", valuesToPrint);
+			pool.workerCount = i;
+			failed = 1;
+		}
+		else{
+			pthread_mutex_init(&worker->lock, NULL);
+		}
+
+	}
+
+	/**** Main Processing ****/
+	/*If we cant start a thread, that worker's jobs just get stolen by the others (or done right here after)*/
+	for(i = 0; !failed && i < pool.workerCount; i++){
+		pool.workers[i].started = (pthread_create(&pool.workers[i].thread, NULL, batchWorkerMain, &pool.workers[i]) == 0);
+	}
+	for(i = 0; !failed && i < pool.workerCount; i++){
+		if(pool.workers[i].started){
+			pthread_join(pool.workers[i].thread, NULL);
+		}
+		else{
+			batchWorkerMain(&pool.workers[i]);
+		}
+	}
+
+	/*Everything goes in one file, in the order the inputs were given*/
+	if(!failed && !perInput){
+
+		outputFile = (strcmp(outputPath, "-") == 0) ? stdout : fopen(outputPath, "w+");
+		if(!outputFile){
+			printf("Error opening one of the files! \n");
+			failed = 1;
+		}
+		else{
+			outputInit(&resultOutput, outputFile);
+			outputBatchStart(&resultOutput, pool.format);
+			for(i = 0; i < pool.jobCount; i++){
+				if(pool.jobs[i].haveSnapshot){
+					outputSnapshotNamed(&resultOutput, &pool.jobs[i].snapshot, pool.format, pool.jobs[i].path);
+				}
+			}
+			if(outputFlush(&resultOutput) != 0 || (outputFile != stdout && fclose(outputFile) != 0)){
+				printf("Error writing %s! \n", outputPath);
+				failed = 1;
+			}
+		}
+
+	}
+
+	/**** Clean Up ****/
+	for(i = 0; i < pool.jobCount; i++){
+		if(pool.workers != NULL && pool.jobs[i].failed){
+			printf("Error reading or writing the results of %s! \n", pool.jobs[i].path);
+			failed = 1;
+		}
+		if(pool.jobs[i].haveSnapshot){
+			parserSnapshotFree(&pool.jobs[i].snapshot);
+		}
+		free(pool.jobs[i].path);
+	}
+	for(i = 0; i < pool.workerCount; i++){
+		pthread_mutex_destroy(&pool.workers[i].lock);
+		parserSnapshotFree(&pool.workers[i].snapshot);
+		parserDestroy(&pool.workers[i].ctx);
+		free(pool.workers[i].buffer);
+		free(pool.workers[i].writer);
+	}
+	free(pool.workers);
+	free(pool.jobs);
+
+	return failed ? -1 : 0;
+
+}
+
+
+/*This function appends an input (or everything a pattern matches) to the list of jobs*/
+int addBatchInput(batchPool * pool, const char * path){
+
+	glob_t matches;
+	size_t i;
+	int result;
+
+	/*The shell usually expands patterns already, but quoted ones (or ones from a manifest) get done here*/
+	if(strpbrk(path, "*?[") != NULL){
+		if(glob(path, 0, NULL, &matches) != 0){
+			/*Nothing matched. Keep the pattern, so it gets reported as a file we cant read*/
+			return addBatchJob(pool, path);
+		}
+		result = 0;
+		for(i = 0; i < matches.gl_pathc && result == 0; i++){
+			result = addBatchJob(pool, matches.gl_pathv[i]);
+		}
+		globfree(&matches);
+		return result;
+	}
+
+	return addBatchJob(pool, path);
+
+}
+
+
+/*This function appends one job to the list, making room for it if we have to*/
+int addBatchJob(batchPool * pool, const char * path){
+
+	batchJob * jobs;
+
+	if(pool->jobCount == pool->jobCapacity){
+		pool->jobCapacity = (pool->jobCapacity == 0) ? 64 : pool->jobCapacity * 2;
+		jobs = realloc(pool->jobs, pool->jobCapacity * sizeof(batchJob));
+		if(jobs == NULL){
+			return -1;
+		}
+		pool->jobs = jobs;
+	}
+
+	pool->jobs[pool->jobCount].path = malloc(strlen(path) + 1);
+	if(pool->jobs[pool->jobCount].path == NULL){
+		return -1;
+	}
+	strcpy(pool->jobs[pool->jobCount].path, path);
+	pool->jobs[pool->jobCount].failed = 0;
+	pool->jobs[pool->jobCount].haveSnapshot = 0;
+	pool->jobCount++;
+
+	return 0;
+
+}
+
+
+/*This function names every output after the end of its input's path, with just enough directories to be unique*/
+/*Sorted by the last part, then the one before & so on, the path sharing the most with another one is next to it*/
+int nameBatchOutputs(batchPool * pool){
+
+	batchJob ** order;
+	struct stat outputStat;
+	const char * end, * part;
+	char * outputPath;
+	size_t length;
+	int i, parts, needed, shared, existing, failed;
+
+	order = malloc(pool->jobCount * sizeof(batchJob *));
+	if(order == NULL){
+		printf("Couldnt allocate the batch workers!\n");
+		return -1;
+	}
+	for(i = 0; i < pool->jobCount; i++){
+		order[i] = &pool->jobs[i];
+	}
+	qsort(order, pool->jobCount, sizeof(batchJob *), compareJobTails);
+
+	failed = 0;
+	for(i = 0; i < pool->jobCount && !failed; i++){
+
+		/*The same parts all the way back is usually the same file twice, and there's no name to tell them apart anyway*/
+		if(i > 0 && compareJobTails(&order[i], &order[i - 1]) == 0){
+			printf("%s & %s would get the same output (the same input twice?).\n", order[i - 1]->path, order[i]->path);
+			failed = 1;
+			break;
+		}
+
+		/*One part more than it has in common with either neighbour*/
+		needed = 0;
+		if(i > 0){
+			needed = pathCommonTail(order[i]->path, order[i - 1]->path);
+		}
+		if(i < pool->jobCount - 1 && (shared = pathCommonTail(order[i]->path, order[i + 1]->path)) > needed){
+			needed = shared;
+		}
+		needed++;
+
+		/*Walk back that many parts. A path with fewer is the end of the other one, so the whole path is its name*/
+		end = order[i]->path + strlen(order[i]->path);
+		part = NULL;
+		for(parts = 0; parts < needed && (end = pathPrevious(order[i]->path, end, &length)) != NULL; parts++){
+			part = end;
+			if(length == 2 && part[0] == '.' && part[1] == '.'){
+				printf("Cant name the output of %s without going up a directory, give the inputs paths that differ further down.\n", order[i]->path);
+				failed = 1;
+				break;
+			}
+		}
+		if(failed){
+			break;
+		}
+		if(part == NULL){
+			printf("%s isnt a file name.\n", order[i]->path);
+			failed = 1;
+		}
+		order[i]->outputName = part;
+
+	}
+	free(order);
+	if(failed){
+		return -1;
+	}
+
+	/*Rerunning into the same directory is normal, but it shouldnt happen without anybody noticing*/
+	existing = 0;
+	for(i = 0; i < pool->jobCount; i++){
+		outputPath = batchOutputPath(pool, &pool->jobs[i]);
+		if(outputPath == NULL){
+			printf("Couldnt allocate the batch workers!\n");
+			return -1;
+		}
+		if(stat(outputPath, &outputStat) == 0){
+			if(existing == 0){
+				fprintf(stderr, "Replacing %s", outputPath);
+			}
+			existing++;
+		}
+		free(outputPath);
+	}
+	if(existing > 1){
+		fprintf(stderr, " & %d more outputs that are there already\n", existing - 1);
+	}
+	else if(existing == 1){
+		fprintf(stderr, ", it's there already\n");
+	}
+
+	return 0;
+
+}
+
+
+/*This function puts the output directory, the name & the format's extension together*/
+char * batchOutputPath(const batchPool * pool, const batchJob * job){
+
+	char * outputPath;
+	const char * extension;
+
+	extension = outputFormatExtension(pool->format);
+	outputPath = malloc(strlen(pool->outputDir) + strlen(job->outputName) + strlen(extension) + 2);
+	if(outputPath != NULL){
+		sprintf(outputPath, "%s/%s%s", pool->outputDir, job->outputName, extension);
+	}
+
+	return outputPath;
+
+}
+
+
+/*This function makes every directory in the path after the output directory, one slash at a time*/
+/*Two workers making the same one at once is fine, whoever loses just gets EEXIST. fopen says if it didnt work*/
+void makeOutputDirs(char * outputPath, size_t dirLength){
+
+	char * slash;
+
+	for(slash = strchr(&outputPath[dirLength + 1], '/'); slash != NULL; slash = strchr(slash + 1, '/')){
+		*slash = '\0';
+		mkdir(outputPath, 0777);
+		*slash = '/';
+	}
+
+}
+
+
+/*This function steps back over slashes & "." parts to the part before end*/
+const char * pathPrevious(const char * path, const char * end, size_t * length){
+
+	const char * start;
+
+	for(;;){
+		while(end > path && end[-1] == '/'){
+			end--;
+		}
+		if(end == path){
+			return NULL;
+		}
+		for(start = end; start > path && start[-1] != '/'; start--);
+		*length = (size_t)(end - start);
+		if(*length != 1 || start[0] != '.'){
+			return start;
+		}
+		end = start;
+	}
+
+}
+
+
+/*This function counts the parts both paths end with*/
+int pathCommonTail(const char * a, const char * b){
+
+	const char * endA, * endB;
+	size_t lengthA, lengthB;
+	int count;
+
+	endA = a + strlen(a);
+	endB = b + strlen(b);
+	for(count = 0; ; count++){
+		endA = pathPrevious(a, endA, &lengthA);
+		endB = pathPrevious(b, endB, &lengthB);
+		if(endA == NULL || endB == NULL || lengthA != lengthB || memcmp(endA, endB, lengthA) != 0){
+			return count;
+		}
+	}
+
+}
+
+
+/*This function orders two paths by their parts from the end. A path that runs out first goes first*/
+int compareJobTails(const void * a, const void * b){
+
+	const char * pathA, * pathB, * endA, * endB;
+	size_t lengthA, lengthB;
+	int difference;
+
+	pathA = (*(batchJob * const *)a)->path;
+	pathB = (*(batchJob * const *)b)->path;
+	endA = pathA + strlen(pathA);
+	endB = pathB + strlen(pathB);
+	for(;;){
+		endA = pathPrevious(pathA, endA, &lengthA);
+		endB = pathPrevious(pathB, endB, &lengthB);
+		if(endA == NULL || endB == NULL){
+			return (endA != NULL) - (endB != NULL);
+		}
+		difference = memcmp(endA, endB, (lengthA < lengthB) ? lengthA : lengthB);
+		if(difference == 0 && lengthA != lengthB){
+			difference = (lengthA < lengthB) ? -1 : 1;
+		}
+		if(difference != 0){
+			return difference;
+		}
+	}
+
+}
+
+
+/*This function adds every line of the manifest as an input. Empty lines are skipped*/
+int readManifest(batchPool * pool, const char * manifestPath){
+
+	FILE * manifest;
+	char line[4096];
+	size_t length;
+	int failed;
+
+	manifest = (strcmp(manifestPath, "-") == 0) ? stdin : fopen(manifestPath, "r");
+	if(!manifest){
+		return -1;
+	}
+
+	failed = 0;
+	while(!failed && fgets(line, sizeof(line), manifest) != NULL){
+		length = strlen(line);
+		while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')){
+			line[--length] = '\0';
+		}
+		if(length > 0){
+			failed = (addBatchInput(pool, line) != 0);
+		}
+	}
+
+	if(ferror(manifest)){
+		failed = 1;
+	}
+	if(manifest != stdin){
+		fclose(manifest);
+	}
+
+	return failed ? -1 : 0;
+
+}
+
+
+/*This function keeps taking jobs until there are none left anywhere*/
+void * batchWorkerMain(void * context){
+
+	batchWorker * worker;
+	int job;
+
+	worker = (batchWorker *)context;
+
+	while((job = takeBatchJob(worker)) >= 0){
+		if(runBatchJob(worker, &worker->pool->jobs[job]) != 0){
+			worker->pool->jobs[job].failed = 1;
+		}
+	}
+
+	return NULL;
+
+}
+
+
+/*This function takes the next of our own jobs, or steals the last job of another worker*/
+int takeBatchJob(batchWorker * worker){
+
+	batchWorker * victim;
+	int job, i;
+
+	job = -1;
+
+	pthread_mutex_lock(&worker->lock);
+	if(worker->nextJob < worker->endJob){
+		job = worker->nextJob++;
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	/*Try everybody else once, starting with our neighbour so the thieves dont all pick on worker 0*/
+	for(i = 1; job < 0 && i < worker->pool->workerCount; i++){
+		victim = &worker->pool->workers[(worker->id + i) % worker->pool->workerCount];
+		pthread_mutex_lock(&victim->lock);
+		if(victim->nextJob < victim->endJob){
+			job = --victim->endJob;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	return job;
+
+}
+
+
+/*This function decodes one input & either writes its own output or hangs on to the results*/
+int runBatchJob(batchWorker * worker, batchJob * job){
+
+	FILE * outputFile;
+	char * outputPath;
+	int failed;
+
+	parserReset(&worker->ctx);
+	if(parseAccFile(&worker->ctx, job->path, worker->buffer, worker->pool->useStdio, worker->pool->codec) != 0){
+		return -1;
+	}
+
+	/*One output file: keep a copy of the results until everybody is done*/
+	if(worker->pool->outputDir == NULL){
+		if(parserSnapshotInit(&job->snapshot, &worker->ctx) != 0){
+			return -1;
+		}
+		parserTakeSnapshot(&worker->ctx, &job->snapshot);
+		job->haveSnapshot = 1;
+		return 0;
+	}
+
+	/*Per input outputs: every job has a name of its own, so no two workers ever write the same file*/
+	outputPath = batchOutputPath(worker->pool, job);
+	if(outputPath == NULL){
+		return -1;
+	}
+	makeOutputDirs(outputPath, strlen(worker->pool->outputDir));
+
+	outputFile = fopen(outputPath, "w+");
+	free(outputPath);
+	if(!outputFile){
+		return -1;
+	}
+
+	parserTakeSnapshot(&worker->ctx, &worker->snapshot);
+	outputInit(worker->writer, outputFile);
+	outputSnapshot(worker->writer, &worker->snapshot, worker->pool->format);
+
+	failed = (outputFlush(worker->writer) != 0);
+	if(fclose(outputFile) != 0){
+		failed = 1;
+	}
+
+	return failed ? -1 : 0;
+
+}
+
+
+/*This function decodes a whole file. Only used by the batch mode, so it never uses threads or the shared readBuffer*/
+int parseAccFile(parserCtx * ctx, const char * path, unsigned char * buffer, int useStdio, inputCodec codec){
+
+	struct stat inputStat;
+	const unsigned char * fileData;
+	ssize_t size;
+	int inputFd, mapped, failed;
+
+	inputFd = open(path, O_RDONLY);
+	if(inputFd < 0){
+		return -1;
+	}
+	if(fstat(inputFd, &inputStat) != 0){
+		close(inputFd);
+		return -1;
+	}
+
+	/*A whole archive is one job, so it never gets split over threads like a single compressed input can be*/
+	if(codec == CodecAuto){
+		codec = detectCodec(inputFd, &inputStat);
+	}
+	if(codec != CodecNone){
+		failed = (checkCodec(codec, path) != 0) ? -1 : parseAccCompressed(ctx, inputFd, &inputStat, codec, useStdio, buffer, 1);
+		if(close(inputFd) != 0){
+			failed = -1;
+		}
+		return failed;
+	}
+
+	/*Mapping a small file costs more than a read would*/
+	mapped = 0;
+	size = 0;
+	if(!useStdio && S_ISREG(inputStat.st_mode) && inputStat.st_size >= ReadBlockSize && (off_t)(size_t)inputStat.st_size == inputStat.st_size){
+
+		fileData = mmap(NULL, (size_t)inputStat.st_size, PROT_READ, MAP_PRIVATE, inputFd, 0);
+		if(fileData != MAP_FAILED){
+			madvise((void *)fileData, (size_t)inputStat.st_size, MADV_SEQUENTIAL);
+			parserFeed(ctx, fileData, (size_t)inputStat.st_size);
+			munmap((void *)fileData, (size_t)inputStat.st_size);
+			mapped = 1;
+		}
+
+	}
+
+	if(!mapped){
+		while((size = readChunk(inputFd, buffer, ReadBlockSize)) > 0){
+			parserFeed(ctx, buffer, (size_t)size);
+		}
+	}
+
+	parserFinish(ctx);
+
+	if(close(inputFd) != 0){
+		return -1;
+	}
+
+	return (size < 0) ? -1 : 0;
+
+}
+
+
+/*This function decodes the input while the next few chunks are being read*/
+int parseAccPipeline(parserCtx * ctx, int inputFd, const struct stat * inputStat, int bufferCount){
+
+	readPipeline pipeline;
+	bufferDescriptor buffer;
+	int failed;
+
+#ifdef HAVE_LIBURING
+	/*io_uring needs offsets, so it only does regular files. -2 means the kernel doesnt have it*/
+	if(S_ISREG(inputStat->st_mode)){
+		failed = parseAccUring(ctx, inputFd, inputStat->st_size, bufferCount);
+		if(failed != -2){
+			return failed;
+		}
+	}
+#else
+	(void)inputStat;
+#endif
+
+	/*No reader thread means no pipeline, but the input still gets decoded*/
+	if(pipelineStart(&pipeline, inputFd, bufferCount) != 0){
+		return parseAccStream(ctx, inputFd);
+	}
+
+	/**** Main Processing ****/
+	failed = 0;
+	for(;;){
+
+		spscPopWait(&pipeline.filled, &buffer);
+
+		/*The reader stops after the end or an error, so this is the last buffer*/
+		if(buffer.length <= 0){
+			failed = (buffer.length < 0) ? -1 : 0;
+			break;
+		}
+
+		/*The reader doesnt touch this buffer until we hand it back*/
+		parserFeed(ctx, buffer.data, (size_t)buffer.length);
+		spscPushWait(&pipeline.emptied, &buffer);
+
+	}
+
+	pipelineStop(&pipeline);
+	parserFinish(ctx);
+
+	return failed;
+
+}
+
+
+/*This function sets up the buffers & both rings, hands every buffer to the reader & starts it*/
+int pipelineStart(readPipeline * pipeline, int inputFd, int bufferCount){
+
+	bufferDescriptor buffer;
+	unsigned long capacity;
+	int i;
+
+	/*The rings want a power of two, and each one has to have room for every buffer*/
+	for(capacity = 1; capacity < (unsigned long)bufferCount; capacity <<= 1);
+
+	pipeline->inputFd = inputFd;
+	pipeline->bufferCount = bufferCount;
+	if(pipe(pipeline->wakeFds) != 0){
+		return -1;
+	}
+	if(spscInit(&pipeline->filled, capacity) != 0){
+		pipelineClosePipe(pipeline);
+		return -1;
+	}
+	if(spscInit(&pipeline->emptied, capacity) != 0){
+		spscDestroy(&pipeline->filled);
+		pipelineClosePipe(pipeline);
+		return -1;
+	}
+
+	for(i = 0; i < bufferCount; i++){
+		pipeline->buffers[i] = malloc(ReadBlockSize);
+		if(pipeline->buffers[i] == NULL){
+			while(i-- > 0){
+				free(pipeline->buffers[i]);
+			}
+			spscDestroy(&pipeline->emptied);
+			spscDestroy(&pipeline->filled);
+			pipelineClosePipe(pipeline);
+			return -1;
+		}
+		buffer.data = pipeline->buffers[i];
+		buffer.length = 0;
+		buffer.tag = i;
+		spscPush(&pipeline->emptied, &buffer);
+	}
+
+	if(pthread_create(&pipeline->reader, NULL, pipelineReader, pipeline) != 0){
+		for(i = 0; i < bufferCount; i++){
+			free(pipeline->buffers[i]);
+		}
+		spscDestroy(&pipeline->emptied);
+		spscDestroy(&pipeline->filled);
+		pipelineClosePipe(pipeline);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/*This function tells the reader to stop early & takes back every buffer it fills until it does*/
+/*After this the reader is done & pipelineStop wont wait on it*/
+void pipelineCancel(readPipeline * pipeline){
+
+	bufferDescriptor buffer;
+	ssize_t size;
+
+	/*Nobody ever reads the byte back out, so the wake pipe stays readable & the reader sees it every time it looks*/
+	do{
+		size = write(pipeline->wakeFds[1], "x", 1);
+	}while(size < 0 && errno == EINTR);
+
+	/*The reader might be waiting for a free buffer, so keep handing them back until it sends its last one*/
+	for(;;){
+		spscPopWait(&pipeline->filled, &buffer);
+		if(buffer.length <= 0){
+			break;
+		}
+		spscPushWait(&pipeline->emptied, &buffer);
+	}
+
+}
+
+
+/*This function closes both ends of the pipeline's wake pipe*/
+void pipelineClosePipe(readPipeline * pipeline){
+
+	close(pipeline->wakeFds[0]);
+	close(pipeline->wakeFds[1]);
+
+}
+
+
+/*This function waits until there is something to read or pipelineCancel was called. Returns -1 for the latter*/
+int pipelineWait(readPipeline * pipeline){
+
+	struct pollfd waitFor[2];
+
+	waitFor[0].fd = pipeline->wakeFds[0];
+	waitFor[0].events = POLLIN;
+	waitFor[1].fd = pipeline->inputFd;
+	waitFor[1].events = POLLIN;
+
+	/*A hang up or an error on the input counts as something to read too, read() then says what happened*/
+	while(poll(waitFor, 2, -1) < 0){
+		if(errno != EINTR){
+			return 0;
+		}
+	}
+
+	return (waitFor[0].revents != 0) ? -1 : 0;
+
+}
+
+
+/*This function waits for the reader, counts the back pressure & frees everything*/
+void pipelineStop(readPipeline * pipeline){
+
+	int i;
+#ifdef ParserInstrument
+	ringCounters filled, emptied;
+#endif
+
+	pthread_join(pipeline->reader, NULL);
+
+#ifdef ParserInstrument
+	/*The reader waits on emptied when we're behind, we wait on filled when the input is*/
+	spscCounters(&pipeline->filled, &filled);
+	spscCounters(&pipeline->emptied, &emptied);
+	pthread_mutex_lock(&ioStatsLock);
+	ioStats.pipelineParserWaits += emptied.emptyWaits;
+	ioStats.pipelineInputWaits += filled.emptyWaits;
+	if(filled.highWater > ioStats.pipelineHighWater){
+		ioStats.pipelineHighWater = filled.highWater;
+	}
+	pthread_mutex_unlock(&ioStatsLock);
+#endif
+
+	for(i = 0; i < pipeline->bufferCount; i++){
+		free(pipeline->buffers[i]);
+	}
+	spscDestroy(&pipeline->emptied);
+	spscDestroy(&pipeline->filled);
+	pipelineClosePipe(pipeline);
+
+}
+
+
+/*This function keeps the pipeline's empty buffers filled until the input runs out*/
+void * pipelineReader(void * context){
+
+	readPipeline * pipeline;
+	bufferDescriptor buffer;
+
+	pipeline = (readPipeline *)context;
+
+	do{
+
+		/*Wait for the decoder to hand back a buffer*/
+		spscPopWait(&pipeline->emptied, &buffer);
+
+		/*Only read() once there is something there, so a read never keeps us from seeing pipelineCancel*/
+		if(pipelineWait(pipeline) != 0){
+			buffer.length = 0;
+		}
+		else{
+			buffer.length = (long)readChunk(pipeline->inputFd, buffer.data, ReadBlockSize);
+		}
+
+		spscPushWait(&pipeline->filled, &buffer);
+
+	}while(buffer.length > 0);
+
+	return NULL;
+
+}
+
+
+#ifdef HAVE_LIBURING
+
+/*This function keeps bufferCount reads in flight & decodes the chunks in file order as they complete*/
+/*Chunk k is always at offset k * ReadBlockSize and always goes in buffer k % bufferCount*/
+int parseAccUring(parserCtx * ctx, int inputFd, off_t fileSize, int bufferCount){
+
+	struct io_uring ring;
+	struct io_uring_sqe * sqe;
+	struct io_uring_cqe * cqe;
+	unsigned char * buffers[PipelineMaxBuffers];
+	int results[PipelineMaxBuffers], ready[PipelineMaxBuffers];
+	off_t nextOffset, decodeOffset, length;
+	ssize_t size;
+	int i, slot, failed, inFlight;
+
+	if(io_uring_queue_init((unsigned)bufferCount, &ring, 0) != 0){
+		return -2;
+	}
+
+	for(i = 0; i < bufferCount; i++){
+		buffers[i] = malloc(ReadBlockSize);
+		ready[i] = 0;
+		if(buffers[i] == NULL){
+			while(i-- > 0){
+				free(buffers[i]);
+			}
+			io_uring_queue_exit(&ring);
+			return -2;
+		}
+	}
+
+	/*Get the first few reads going*/
+	nextOffset = 0;
+	inFlight = 0;
+	for(i = 0; i < bufferCount && nextOffset < fileSize; i++){
+		sqe = io_uring_get_sqe(&ring);
+		io_uring_prep_read(sqe, inputFd, buffers[i], ReadBlockSize, nextOffset);
+		io_uring_sqe_set_data(sqe, (void *)(size_t)i);
+		nextOffset += ReadBlockSize;
+		inFlight++;
+	}
+	io_uring_submit(&ring);
+
+	/**** Main Processing ****/
+	failed = 0;
+	slot = 0;
+	for(decodeOffset = 0; decodeOffset < fileSize && !failed; decodeOffset += length){
+
+		/*Completions can come back in any order. Collect them until the one we need next is in*/
+		while(!ready[slot]){
+			if(io_uring_wait_cqe(&ring, &cqe) != 0){
+				failed = -1;
+				break;
+			}
+			i = (int)(size_t)io_uring_cqe_get_data(cqe);
+			results[i] = cqe->res;
+			ready[i] = 1;
+			io_uring_cqe_seen(&ring, cqe);
+			inFlight--;
+		}
+		if(failed || results[slot] < 0){
+			failed = -1;
+			break;
+		}
+
+		/*A short read before the end of the file is allowed, but rare. Just finish that chunk ourselves*/
+		length = fileSize - decodeOffset;
+		if(length > ReadBlockSize){
+			length = ReadBlockSize;
+		}
+		while(results[slot] < length){
+			size = pread(inputFd, &buffers[slot][results[slot]], (size_t)(length - results[slot]), decodeOffset + results[slot]);
+			if(size < 0 && errno == EINTR){
+				continue;
+			}
+			if(size <= 0){
+				/*The file shrank underneath us*/
+				length = results[slot];
+				break;
+			}
+			results[slot] += (int)size;
+		}
+		if(length == 0){
+			break;
+		}
+
+		parserFeed(ctx, buffers[slot], (size_t)length);
+
+		/*The buffer is free again, so it gets the next chunk that isnt in flight yet*/
+		ready[slot] = 0;
+		if(nextOffset < fileSize){
+			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_read(sqe, inputFd, buffers[slot], ReadBlockSize, nextOffset);
+			io_uring_sqe_set_data(sqe, (void *)(size_t)slot);
+			io_uring_submit(&ring);
+			nextOffset += ReadBlockSize;
+			inFlight++;
+		}
+		slot = (slot + 1) % bufferCount;
+
+	}
+
+	parserFinish(ctx);
+
+	/**** Clean Up ****/
+	/*After an error there can still be reads in flight. Wait for them before the buffers go away*/
+	while(inFlight > 0 && io_uring_wait_cqe(&ring, &cqe) == 0){
+		io_uring_cqe_seen(&ring, cqe);
+		inFlight--;
+	}
+	io_uring_queue_exit(&ring);
+	for(i = 0; i < bufferCount; i++){
+		free(buffers[i]);
+	}
+
+	return failed;
+
+}
+
+#endif
+
+
+/*This function looks for the gzip (1f 8b) or zstd (28 b5 2f fd) magic at the start of regular files*/
+inputCodec detectCodec(int inputFd, const struct stat * inputStat){
+
+	unsigned char magic[4];
+
+	/*pread doesnt move the file position, so nothing is lost if it turns out to be raw*/
+	if(!S_ISREG(inputStat->st_mode) || pread(inputFd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)){
+		return CodecNone;
+	}
+
+	if(magic[0] == 0x1F && magic[1] == 0x8B){
+		return CodecGzip;
+	}
+	if(magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD){
+		return CodecZstd;
+	}
+
+	return CodecNone;
+
+}
+
+
+/*This function says so if the codec isnt built in, with the input it's for when there's more than one*/
+int checkCodec(inputCodec codec, const char * path){
+
+	const char * library;
+
+	(void)codec;
+	library = NULL;
+#ifndef HAVE_ZLIB
+	if(codec == CodecGzip){
+		library = "gzip input. Rebuild with -DHAVE_ZLIB -lz";
+	}
+#endif
+#ifndef HAVE_ZSTD
+	if(codec == CodecZstd){
+		library = "zstd input. Rebuild with -DHAVE_ZSTD -lzstd";
+	}
+#endif
+	if(library == NULL){
+		return 0;
+	}
+
+	if(path != NULL){
+		printf("This build cant read %s (%s is compressed).\n", library, path);
+	}
+	else{
+		printf("This build cant read %s.\n", library);
+	}
+
+	return -1;
+
+}
+
+
+/*This function sets up where the compressed data comes from & hands it to the right decompressor*/
+int parseAccCompressed(parserCtx * ctx, int inputFd, const struct stat * inputStat, inputCodec codec, int useStdio,
+                       unsigned char * buffer, int threads){
+
+	compressedSource source;
+	unsigned char * output;
+	int failed;
+
+	/*Only used if some codec is built in*/
+	(void)codec;
+	(void)threads;
+
+	source.data = NULL;
+	source.length = 0;
+	source.inputFd = inputFd;
+	source.buffer = buffer;
+
+	/*Regular files get mapped, so the decompressor can work straight out of the page cache*/
+	if(!useStdio && S_ISREG(inputStat->st_mode) && inputStat->st_size > 0 && (off_t)(size_t)inputStat->st_size == inputStat->st_size){
+		source.data = mmap(NULL, (size_t)inputStat->st_size, PROT_READ, MAP_PRIVATE, inputFd, 0);
+		if(source.data == MAP_FAILED){
+			source.data = NULL;
+		}
+		else{
+			source.length = (size_t)inputStat->st_size;
+			madvise((void *)source.data, source.length, MADV_SEQUENTIAL);
+		}
+	}
+
+	output = malloc(DecompressBlockSize);
+	if(output == NULL){
+		failed = -1;
+	}
+	else{
+
+		failed = -1;
+#ifdef HAVE_ZSTD
+		if(codec == CodecZstd){
+			failed = -2;
+			if(source.data != NULL && threads > 1){
+				failed = parseAccZstdThreaded(ctx, source.data, source.length, threads);
+			}
+			if(failed == -2){
+				failed = parseAccZstd(ctx, &source, output);
+			}
+		}
+#endif
+#ifdef HAVE_ZLIB
+		if(codec == CodecGzip){
+			failed = parseAccGzip(ctx, &source, output);
+		}
+#endif
+
+		free(output);
+
+	}
+
+	/*Same end of stream handling as raw input*/
+	parserFinish(ctx);
+
+	if(source.data != NULL){
+		munmap((void *)source.data, source.length);
+	}
+
+	return failed;
+
+}
+
+
+#ifdef HAVE_ZLIB
+
+/*This function inflates the input a buffer full at a time & feeds every buffer to the parser*/
+int parseAccGzip(parserCtx * ctx, compressedSource * source, unsigned char * output){
+
+	z_stream stream;
+	ssize_t size;
+	int result, failed;
+
+	memset(&stream, 0, sizeof(stream));
+	/*15 + 32: the biggest window, and figure out gzip or zlib from the header*/
+	if(inflateInit2(&stream, 15 + 32) != Z_OK){
+		return -1;
+	}
+
+	failed = 0;
+	result = Z_OK;
+	if(source->data != NULL){
+		stream.next_in = (unsigned char *)source->data;
+	}
+
+	for(;;){
+
+		/*Reading from a pipe: refill the input once it's used up*/
+		if(stream.avail_in == 0){
+			if(source->data != NULL){
+				/*zlib counts in unsigned ints, so a huge mapping goes in pieces*/
+				size = (source->length > 1073741824) ? 1073741824 : (ssize_t)source->length;
+				source->length -= (size_t)size;
+			}
+			else{
+				size = readChunk(source->inputFd, source->buffer, ReadBlockSize);
+				stream.next_in = source->buffer;
+			}
+			if(size < 0){
+				failed = -1;
+				break;
+			}
+			if(size == 0){
+				/*The input ended in the middle of a member*/
+				failed = (result == Z_STREAM_END) ? 0 : -1;
+				break;
+			}
+			stream.avail_in = (unsigned int)size;
+		}
+
+		/*gzip files can be several members back to back (cat a.gz b.gz), so start over after each one*/
+		if(result == Z_STREAM_END){
+			if(inflateReset(&stream) != Z_OK){
+				failed = -1;
+				break;
+			}
+		}
+
+		stream.next_out = output;
+		stream.avail_out = DecompressBlockSize;
+		result = inflate(&stream, Z_NO_FLUSH);
+		if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR){
+			failed = -1;
+			break;
+		}
+
+		parserFeed(ctx, output, DecompressBlockSize - stream.avail_out);
+
+	}
+
+	inflateEnd(&stream);
+
+	return failed;
+
+}
+
+#endif
+
+
+#ifdef HAVE_ZSTD
+
+/*This function decompresses the input a buffer full at a time & feeds every buffer to the parser*/
+int parseAccZstd(parserCtx * ctx, compressedSource * source, unsigned char * output){
+
+	ZSTD_DStream * stream;
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer decompressed;
+	ssize_t size;
+	size_t result;
+	int failed;
+
+	stream = ZSTD_createDStream();
+	if(stream == NULL){
+		return -1;
+	}
+	ZSTD_initDStream(stream);
+
+	input.src = source->data;
+	input.size = (source->data != NULL) ? source->length : 0;
+	input.pos = 0;
+
+	/*result is 0 right after a frame ends, which is the only place the input is allowed to stop*/
+	failed = 0;
+	result = 0;
+	for(;;){
+
+		if(input.pos == input.size){
+			if(source->data != NULL){
+				failed = (result == 0) ? 0 : -1;
+				break;
+			}
+			size = readChunk(source->inputFd, source->buffer, ReadBlockSize);
+			if(size <= 0){
+				failed = (size == 0 && result == 0) ? 0 : -1;
+				break;
+			}
+			input.src = source->buffer;
+			input.size = (size_t)size;
+			input.pos = 0;
+		}
+
+		decompressed.dst = output;
+		decompressed.size = DecompressBlockSize;
+		decompressed.pos = 0;
+		result = ZSTD_decompressStream(stream, &decompressed, &input);
+		if(ZSTD_isError(result)){
+			failed = -1;
+			break;
+		}
+
+		parserFeed(ctx, output, decompressed.pos);
+
+	}
+
+	ZSTD_freeDStream(stream);
+
+	return failed;
+
+}
+
+
+/*This function splits the frames into one run per worker, runs them & merges the results in order*/
+int parseAccZstdThreaded(parserCtx * ctx, const unsigned char * data, size_t length, int threads){
+
+	zstdWorker * workers;
+	size_t offset, frameSize, *frameStarts, *grownStarts;
+	unsigned long long contentSize, totalSize, runSize, *frameOffsets, *grownOffsets;
+	int frameCount, frameCapacity, workerCount, frame, firstChannel, i;
+	unsigned char tail[MaxGroupBytes];
+
+	/*First find every frame & how much it decompresses to. Any frame that doesnt say means we cant split*/
+	frameCount = 0;
+	frameCapacity = 64;
+	frameStarts = malloc((frameCapacity + 1) * sizeof(size_t));
+	frameOffsets = malloc((frameCapacity + 1) * sizeof(unsigned long long));
+	totalSize = 0;
+	for(offset = 0; offset < length && frameStarts != NULL && frameOffsets != NULL; offset += frameSize){
+
+		frameSize = ZSTD_findFrameCompressedSize(&data[offset], length - offset);
+		contentSize = ZSTD_getFrameContentSize(&data[offset], length - offset);
+		if(ZSTD_isError(frameSize) || contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR){
+			free(frameStarts);
+			free(frameOffsets);
+			return -2;
+		}
+
+		if(frameCount == frameCapacity){
+			frameCapacity *= 2;
+			grownStarts = realloc(frameStarts, (frameCapacity + 1) * sizeof(size_t));
+			frameStarts = (grownStarts != NULL) ? grownStarts : frameStarts;
+			grownOffsets = realloc(frameOffsets, (frameCapacity + 1) * sizeof(unsigned long long));
+			frameOffsets = (grownOffsets != NULL) ? grownOffsets : frameOffsets;
+			if(grownStarts == NULL || grownOffsets == NULL){
+				free(frameStarts);
+				free(frameOffsets);
+				return -2;
+			}
+		}
+		frameStarts[frameCount] = offset;
+		frameOffsets[frameCount] = totalSize;
+		frameCount++;
+		totalSize += contentSize;
+
+	}
+
+	/*Not worth it (or not possible) with fewer frames than threads or tiny files*/
+	workerCount = (threads < frameCount) ? threads : frameCount;
+	if(frameStarts == NULL || frameOffsets == NULL || workerCount < 2 || totalSize < (unsigned long long)workerCount * MinBytesPerThread){
+		free(frameStarts);
+		free(frameOffsets);
+		return -2;
+	}
+	frameStarts[frameCount] = length;
+	frameOffsets[frameCount] = totalSize;
+
+	workers = malloc(workerCount * sizeof(zstdWorker));
+	if(workers == NULL){
+		free(frameStarts);
+		free(frameOffsets);
+		return -2;
+	}
+
+	/*Hand out frames until each run has about its share of the decompressed bytes*/
+	frame = 0;
+	for(i = 0; i < workerCount; i++){
+
+		workers[i].data = &data[frameStarts[frame]];
+		workers[i].skip = (int)((ctx->groupBytes - frameOffsets[frame] % ctx->groupBytes) % ctx->groupBytes);
+		/*Interleaved channels: the run's own values start after its head bytes, on whichever channel that is*/
+		firstChannel = (int)(((frameOffsets[frame] + workers[i].skip) / ctx->groupBytes * ctx->groupValues) % ctx->channelCount);
+		workers[i].headLength = 0;
+		workers[i].failed = 0;
+		workers[i].started = 0;
+
+		runSize = 0;
+		do{
+			runSize += frameOffsets[frame + 1] - frameOffsets[frame];
+			frame++;
+		}while(frame < frameCount - (workerCount - 1 - i) && (i == workerCount - 1 || runSize < totalSize / workerCount));
+		workers[i].length = frameStarts[frame] - (size_t)(workers[i].data - data);
+
+		if(parserInitLike(&workers[i].ctx, ctx) != 0){
+			workers[i].failed = 1;
+		}
+		else{
+			workers[i].ctx.nextChannel = firstChannel;
+			workers[i].started = (pthread_create(&workers[i].thread, NULL, zstdWorkerMain, &workers[i]) == 0);
+			if(!workers[i].started){
+				zstdWorkerMain(&workers[i]);
+			}
+		}
+
+	}
+
+	/*
+	 * Merge in order. The 0-2 bytes the last run left over are still in ctx's carry, and this run's head bytes finish
+	 * that pair off. Then this run's own leftovers go back into ctx's carry for the next run.
+	 */
+	frame = 0;
+	for(i = 0; i < workerCount; i++){
+
+		if(workers[i].started){
+			pthread_join(workers[i].thread, NULL);
+		}
+		if(workers[i].failed){
+			frame = -1;
+		}
+		else{
+			parserFeed(ctx, workers[i].head, (size_t)workers[i].headLength);
+			parserMerge(ctx, &workers[i].ctx);
+			memcpy(tail, workers[i].ctx.carry, (size_t)workers[i].ctx.carryLength);
+			parserFeed(ctx, tail, (size_t)workers[i].ctx.carryLength);
+			parserDestroy(&workers[i].ctx);
+		}
+
+	}
+
+	free(workers);
+	free(frameStarts);
+	free(frameOffsets);
+
+	return (frame < 0) ? -1 : 0;
+
+}
+
+
+/*This function decompresses one run of frames. The first skip bytes belong to the run before, so they're kept aside*/
+void * zstdWorkerMain(void * context){
+
+	zstdWorker * worker;
+	ZSTD_DStream * stream;
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer decompressed;
+	unsigned char * output;
+	size_t result, used;
+
+	worker = (zstdWorker *)context;
+
+	stream = ZSTD_createDStream();
+	output = malloc(DecompressBlockSize);
+	if(stream == NULL || output == NULL){
+		ZSTD_freeDStream(stream);
+		free(output);
+		worker->failed = 1;
+		return NULL;
+	}
+	ZSTD_initDStream(stream);
+
+	input.src = worker->data;
+	input.size = worker->length;
+	input.pos = 0;
+
+	result = 0;
+	while(input.pos < input.size){
+
+		decompressed.dst = output;
+		decompressed.size = DecompressBlockSize;
+		decompressed.pos = 0;
+		result = ZSTD_decompressStream(stream, &decompressed, &input);
+		if(ZSTD_isError(result)){
+			worker->failed = 1;
+			break;
+		}
+
+		/*Hold back the head bytes, the rest is ours. The worker's carry ends up with the tail*/
+		used = 0;
+		while(worker->headLength < worker->skip && used < decompressed.pos){
+			worker->head[worker->headLength++] = output[used++];
+		}
+		parserFeed(&worker->ctx, &output[used], decompressed.pos - used);
+
+	}
+
+	/*Every run is whole frames, so it has to end right after one*/
+	if(result != 0 || worker->headLength < worker->skip){
+		worker->failed = 1;
+	}
+
+	ZSTD_freeDStream(stream);
+	free(output);
+
+	return NULL;
+
+}
+
+#endif
+
+
+/*This function checks & decodes framed input, straight out of the mapping for regular files*/
+int parseAccFramed(parserCtx * ctx, int inputFd, const struct stat * inputStat, int useStdio){
+
+	frameReader reader;
+	const unsigned char * fileData;
+	unsigned char * buffer;
+	size_t pending, capacity, used;
+	ssize_t size;
+
+	memset(&reader, 0x00, sizeof(reader));
+	reader.ctx = ctx;
+	size = 0;
+
+	fileData = MAP_FAILED;
+	if(!useStdio && S_ISREG(inputStat->st_mode) && inputStat->st_size > 0 && (off_t)(size_t)inputStat->st_size == inputStat->st_size){
+		fileData = mmap(NULL, (size_t)inputStat->st_size, PROT_READ, MAP_PRIVATE, inputFd, 0);
+	}
+
+	if(fileData != MAP_FAILED){
+		madvise((void *)fileData, (size_t)inputStat->st_size, MADV_SEQUENTIAL);
+		frameScan(&reader, fileData, (size_t)inputStat->st_size, 1);
+		munmap((void *)fileData, (size_t)inputStat->st_size);
+	}
+	else{
+		/*Room for the biggest block plus a read, so a whole block always fits behind whatever is left over*/
+		capacity = FrameHeaderSize + FrameMaxPayload + ReadBlockSize;
+		buffer = malloc(capacity);
+		if(buffer == NULL){
+			return -1;
+		}
+		pending = 0;
+		do{
+			size = readChunk(inputFd, &buffer[pending], capacity - pending);
+			if(size < 0){
+				break;
+			}
+			pending += (size_t)size;
+			used = frameScan(&reader, buffer, pending, size == 0);
+			pending -= used;
+			memmove(&buffer[0], &buffer[used], pending);
+		}while(size > 0);
+		free(buffer);
+	}
+
+	parserFinish(ctx);
+
+	if(reader.lostBlocks > 0 || reader.skippedBytes > 0){
+		fprintf(stderr, "%lu blocks decoded, %lu corrupt or missing blocks skipped (%lu bytes)\n",
+		        reader.goodBlocks, reader.lostBlocks, reader.skippedBytes);
+	}
+
+	return (size < 0) ? -1 : 0;
+
+}
+
+
+/*This function walks the blocks. Anything that doesnt check out gets stepped over a byte at a time to the next magic*/
+size_t frameScan(frameReader * reader, const unsigned char * data, size_t length, int final){
+
+	const unsigned char * header;
+	const unsigned char * next;
+	unsigned long payload;
+	size_t position;
+
+	position = 0;
+	while(length - position >= FrameHeaderSize){
+
+		header = &data[position];
+		if(readLittleEndian(&header[0], 4) == FrameMagic){
+			payload = readLittleEndian(&header[8], 4);
+			if(payload <= FrameMaxPayload && length - position - FrameHeaderSize < payload && !final){
+				/*The rest of the block is still on its way*/
+				break;
+			}
+			/*The crc covers the sequence # & the length too, so a bad length is as good as a bad payload*/
+			if(payload <= FrameMaxPayload && length - position - FrameHeaderSize >= payload
+			   && crc32c(crc32c(0, &header[4], 8), &header[FrameHeaderSize], payload) == readLittleEndian(&header[12], 4)){
+				frameResume(reader, reader->offset + position, readLittleEndian(&header[4], 4));
+				parserFeed(reader->ctx, &header[FrameHeaderSize], payload);
+				position += FrameHeaderSize + payload;
+				continue;
+			}
+		}
+
+		/*Corrupt (or cut off), so look for the next block from the next byte on*/
+		if(!reader->skipping){
+			reader->skipping = 1;
+			reader->skipStart = reader->offset + position;
+		}
+		next = memchr(&data[position + 1], FrameMagic & 0xFF, length - position - 1);
+		position = (next != NULL) ? (size_t)(next - data) : length;
+
+	}
+
+	/*Whatever is left at the very end cant be a block*/
+	if(final && position < length){
+		if(!reader->skipping){
+			reader->skipping = 1;
+			reader->skipStart = reader->offset + position;
+		}
+		position = length;
+	}
+	if(final && reader->skipping){
+		reader->skippedBytes += reader->offset + position - reader->skipStart;
+		reader->lostBlocks++;
+		fprintf(stderr, "The input ends with %lu bytes that arent a whole block, skipped them\n", reader->offset + position - reader->skipStart);
+		reader->skipping = 0;
+	}
+
+	reader->offset += position;
+
+	return position;
+
+}
+
+
+/*This function catches up with a good block. The sequence # says how many blocks went missing before it*/
+void frameResume(frameReader * reader, unsigned long offset, unsigned long sequence){
+
+	unsigned long lost, bytes, payload;
+
+	/*The first block can start anywhere, e.g. a later piece of a bigger framed stream, unless something came before it*/
+	if(reader->goodBlocks == 0 && !reader->skipping){
+		reader->nextSequence = sequence;
+	}
+
+	lost = (sequence - reader->nextSequence) & 0xFFFFFFFFUL;
+	bytes = reader->skipping ? offset - reader->skipStart : 0;
+	if(lost > 0 || bytes > 0){
+		/*If every lost block's header is in the skipped bytes, the rest were their samples & the channels can move on past them*/
+		payload = 0;
+		if(bytes >= lost * FrameHeaderSize && (bytes - lost * FrameHeaderSize) % reader->ctx->groupBytes == 0){
+			payload = (bytes - lost * FrameHeaderSize) / reader->ctx->groupBytes * reader->ctx->groupValues;
+		}
+		parserSkip(reader->ctx, payload);
+		fprintf(stderr, "Skipped %lu corrupt bytes at offset %lu, %lu blocks lost before block %lu\n",
+		        bytes, reader->skipping ? reader->skipStart : offset, lost, sequence);
+		reader->lostBlocks += (lost > 0) ? lost : 1;
+		reader->skippedBytes += bytes;
+	}
+
+	reader->skipping = 0;
+	reader->nextSequence = (sequence + 1) & 0xFFFFFFFFUL;
+	reader->goodBlocks++;
+
+}
+
+
+/*This function cuts the input into blocks & writes each one with its header*/
+int frameFile(int inputFd, const char * outputPath){
+
+	unsigned char * block;
+	unsigned char header[FrameHeaderSize];
+	unsigned long sequence, crc;
+	size_t used;
+	ssize_t size;
+	int outputFd, failed, i;
+
+	block = malloc(FrameBlockSize);
+	if(block == NULL){
+		return -1;
+	}
+	outputFd = (strcmp(outputPath, "-") == 0) ? STDOUT_FILENO : open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(outputFd < 0){
+		free(block);
+		return -1;
+	}
+
+	/**** Main Processing ****/
+	failed = 0;
+	sequence = 0;
+	do{
+		/*Reads can come back short (pipes), so keep going until the block is full or the input is done*/
+		used = 0;
+		while(used < FrameBlockSize && (size = readChunk(inputFd, &block[used], FrameBlockSize - used)) > 0){
+			used += (size_t)size;
+		}
+		if(size < 0){
+			failed = 1;
+			break;
+		}
+		if(used == 0){
+			break;
+		}
+
+		for(i = 0; i < 4; i++){
+			header[i] = (unsigned char)((FrameMagic >> (8 * i)) & 0xFF);
+			header[4 + i] = (unsigned char)((sequence >> (8 * i)) & 0xFF);
+			header[8 + i] = (unsigned char)((used >> (8 * i)) & 0xFF);
+		}
+		crc = crc32c(crc32c(0, &header[4], 8), block, used);
+		for(i = 0; i < 4; i++){
+			header[12 + i] = (unsigned char)((crc >> (8 * i)) & 0xFF);
+		}
+		if(writeAll(outputFd, header, FrameHeaderSize) != 0 || writeAll(outputFd, block, used) != 0){
+			failed = 1;
+			break;
+		}
+		sequence = (sequence + 1) & 0xFFFFFFFFUL;
+	}while(used == FrameBlockSize);
+
+	/**** Clean Up ****/
+	if(outputFd != STDOUT_FILENO && close(outputFd) != 0){
+		failed = 1;
+	}
+	free(block);
+
+	return failed ? -1 : 0;
+
+}
+
+
+#ifdef ParserInstrument
+
+/*This function writes the summary once we're done, whichever way main ended*/
+void instrumentReport(void){
+	instrumentWrite(STDERR_FILENO);
+}
+
+
+/*This function writes the summary in the middle of a run. write() is async signal safe, so this is fine in a handler*/
+void instrumentSignal(int signalNumber){
+
+	int savedErrno;
+
+	(void)signalNumber;
+
+	/*Dont let the write clobber errno for whatever we interrupted*/
+	savedErrno = errno;
+	instrumentWrite(STDERR_FILENO);
+	errno = savedErrno;
+
+}
+
+
+/*This function formats everything into one line by hand, since printf isnt safe in a signal handler*/
+void instrumentWrite(int outputFd){
+
+	char line[InstrumentLineSize];
+	size_t used;
+	const parserCounters * counters;
+	unsigned long averageSteps;
+
+	/*The live context while there is one, otherwise whatever it had at the end*/
+	counters = (instrumentCtx != NULL) ? &instrumentCtx->counters : &finalCounters;
+	averageSteps = (counters->listAccepts > 0) ? counters->listSteps * 100 / counters->listAccepts : 0;
+
+	used = 0;
+	line[used++] = '{';
+	instrumentAppend(line, &used, "readCalls", ioStats.readCalls, 0);
+	instrumentAppend(line, &used, "bytesRead", ioStats.bytesRead, 0);
+	instrumentAppend(line, &used, "bytesMapped", ioStats.bytesMapped, 0);
+	instrumentAppend(line, &used, "pipelineParserWaits", ioStats.pipelineParserWaits, 0);
+	instrumentAppend(line, &used, "pipelineInputWaits", ioStats.pipelineInputWaits, 0);
+	instrumentAppend(line, &used, "pipelineHighWater", ioStats.pipelineHighWater, 0);
+	/*Times are in microseconds, printed as seconds*/
+	instrumentAppend(line, &used, "readSeconds", (unsigned long)(ioStats.readSeconds * 1e6), 6);
+	instrumentAppend(line, &used, "decodeSeconds", (unsigned long)(counters->decodeSeconds * 1e6), 6);
+	instrumentAppend(line, &used, "topSeconds", (unsigned long)(counters->topSeconds * 1e6), 6);
+	instrumentAppend(line, &used, "outputSeconds", (unsigned long)(ioStats.outputSeconds * 1e6), 6);
+	instrumentAppend(line, &used, "listAccepts", counters->listAccepts, 0);
+	instrumentAppend(line, &used, "listRejects", counters->listRejects, 0);
+	instrumentAppend(line, &used, "filterSkips", counters->filterSkips, 0);
+	instrumentAppend(line, &used, "listSteps", counters->listSteps, 0);
+	instrumentAppend(line, &used, "averageListSteps", averageSteps, 2);
+	/*Overwrite the last comma*/
+	line[used - 1] = '}';
+	line[used++] = '\n';
+
+	writeAll(outputFd, line, used);
+
+}
+
+
+/*This function appends one field. Numbers are formatted backwards into a small buffer, then copied over*/
+void instrumentAppend(char * line, size_t * used, const char * key, unsigned long value, int decimals){
+
+	char digits[32];
+	int count;
+
+	line[(*used)++] = '"';
+	while(*key != '\0'){
+		line[(*used)++] = *key++;
+	}
+	line[(*used)++] = '"';
+	line[(*used)++] = ':';
+
+	/*At least one digit before the point*/
+	count = 0;
+	do{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+		if(count == decimals){
+			digits[count++] = '.';
+		}
+	}while(value > 0 || count <= decimals + (decimals > 0));
+
+	while(count > 0){
+		line[(*used)++] = digits[--count];
+	}
+	line[(*used)++] = ',';
+
+}
+
+#endif
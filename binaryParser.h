@@ -2,66 +2,562 @@
    Data Structures & Global Variables
    ################################## */
 
-#define Lower12BitMask 0xFFF
-#define NumberOfValuesToPrint 32
+/*Number of bytes we ask read() for at a time. Doesnt need to be a multiple of 3, leftovers are carried over*/
+#define ReadBlockSize 1048576
+/*How much decompressed data goes to the parser at a time*/
+#define DecompressBlockSize 1048576
+/*Upper limit for -a*/
+#define PipelineMaxBuffers 8
+/*Upper limit for -j*/
+#define MaxThreads 256
+/*Files smaller than this per thread arent worth splitting up*/
+#define MinBytesPerThread (4 * 1048576)
 
-/*We read 3 bytes into the 2 values array, and keep one empty byte so we have 32 bits*/
-/*Assuming the machine is little endian*/
+/*How much unpacked output we collect before writing it. A multiple of DirectIoAlignment*/
+#define UnpackWriteSize (4 * 1048576)
+/*How much packed output we collect before writing it. A multiple of 3, so it always ends on a pair*/
+#define PackWriteSize (3 * 1048576)
+/*The windowed mode hands this many values at a time to the window stats. Small, so they're still in the cache*/
+#define WindowBatchValues 16384
+/*How many values each block of a sidecar index covers. Even, so every block starts on a pair*/
+#define IndexBlockValues 65536
+/*Sidecar index header ("ACCI" little endian) & version*/
+#define IndexMagic 0x49434341
+#define IndexVersion 1
+#define IndexHeaderSize 32
+#define IndexRecordSize 8
+/*Framed input (-e framed): blocks of a FrameHeaderSize header ("ACCF" little endian, sequence #, payload length &*/
+/*the CRC32C of the sequence #, the length & the payload), then the payload, which is plain packed samples*/
+#define FrameMagic 0x46434341
+#define FrameHeaderSize 16
+/*Longer blocks are taken to be a corrupt length*/
+#define FrameMaxPayload (4 * 1048576)
+/*What -m frame puts in a block: a multiple of 3, 5 & 7 bytes, so every block is whole pairs (or groups) at any width*/
+#define FrameBlockSize (105 * 2048)
+/*The tail mode looks at the size of the capture at least this often (ms), in case inotify missed something or isnt there*/
+#define TailPollMilliseconds 1000
+/*Clients that can be waiting for the tail mode to answer*/
+#define TailListenBacklog 16
+/*How long a client gets to take its answer before we hang up on it (s), so a stuck one cant hold up the decoding*/
+#define TailSendSeconds 2
+/*How many of the last bytes it decoded the tail mode reads again every time, to tell if the capture was rewritten*/
+#define TailCheckBytes 64
+/*O_DIRECT writes have to start & end on a multiple of this (& come from memory aligned to it)*/
+#define DirectIoAlignment 4096
+
+/*How the input is compressed, set with -z. CodecAuto looks at the first bytes of regular files*/
+typedef enum{
+	CodecAuto = 0,
+	CodecNone,
+	CodecGzip,
+	CodecZstd
+}inputCodec;
+
+/*What we do with the input, set with -m*/
+typedef enum{
+	ModeStats = 0,
+	ModeUnpack,
+	ModePack,
+	ModeLast,
+	ModeIndex,
+	ModeRange,
+	ModeWindow,
+	ModeBatch,
+	ModeMerge,
+	ModeFrame,
+	ModeTail
+}runMode;
+
+/*Buffer for the chunks we read from the file. Reused for every read*/
+unsigned char readBuffer[ReadBlockSize];
+
+/*Values decoded out of the middle of a file by readValues. One extra in case the range starts on an odd value, one for the tail*/
+unsigned short int rangeValues[IndexBlockValues + 2];
+
+/*Formats the output. Its buffer is big, so it lives here instead of on the stack*/
+outputWriter resultOutput;
+
+/*Format the results are written in, set with -f*/
+outputFormat resultFormat;
+
+/*Number of threads to decode mapped files with, set with -j*/
+int threadCount;
+
+/*Set by SIGINT & SIGTERM, so the tail mode can take its socket with it on the way out*/
+volatile sig_atomic_t tailStop;
+
+#ifdef ParserInstrument
+/*What the reads & the output cost. The parser counts the rest in its context (parserCounters)*/
+typedef struct{
+	double readSeconds;
+	double outputSeconds;
+	unsigned long readCalls;
+	unsigned long bytesRead;
+	/*Mapped files never get read(), so they're counted here*/
+	unsigned long bytesMapped;
+	/*Back pressure of the -a pipeline: the reader waiting for a free buffer (decoding is behind), the decoder*/
+	/*waiting for a full one (the input is behind), and the most full buffers that were ever waiting*/
+	unsigned long pipelineParserWaits;
+	unsigned long pipelineInputWaits;
+	unsigned long pipelineHighWater;
+}ioCounters;
+
+/*Batch workers & the -a reader thread read too, so updates take ioStatsLock. The SIGUSR1 summary reads them without it*/
+ioCounters ioStats;
+pthread_mutex_t ioStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*The context the summary reports on while main has one, and its last counts once it's gone*/
+parserCtx * volatile instrumentCtx;
+parserCounters finalCounters;
+
+/*Longest summary line we write*/
+#define InstrumentLineSize 1024
+#endif
+
+/*Everything a worker thread needs. Each one decodes its own run of pairs into its own context*/
 typedef struct{
-	char twoValues[3];
-	char unused;
-}inputWord;
-
-/*We union it with an int so that we can do bit manipulations to get the values we want*/
-typedef union{
-	inputWord inputStruct; 
-	unsigned int word;
-}inputWordUnion;
-
-/*This is the node for the statically allocated linked list*/
-/*The next ptr is actually just the index of the next node, since they're all in an array*/
+	const unsigned char * data;
+	off_t length;
+	parserCtx ctx;
+	pthread_t thread;
+	int started;
+}workerContext;
+
+/*Everything the unpack mode needs to turn a packed stream into uint16s*/
+/*With a sink the values go to it instead of the file, which is how the windowed mode gets its values*/
+typedef struct{
+	int fd;
+	/*1 while the output is open with O_DIRECT*/
+	int direct;
+	int failed;
+	/*capacity values (UnpackWriteSize bytes for the file), aligned to DirectIoAlignment*/
+	unsigned short int * values;
+	size_t capacity;
+	size_t used;
+	void (*sink)(void * context, const unsigned short int * values, size_t count);
+	void * sinkContext;
+	/*The start of a 24 bit pair that was split across two reads*/
+	unsigned char carry[3];
+	int carryLength;
+}unpackWriter;
+
+/*Everything the pack mode needs to turn uint16s back into a packed stream*/
+typedef struct{
+	int fd;
+	int failed;
+	/*PackWriteSize bytes*/
+	unsigned char * bytes;
+	size_t used;
+	/*Input values get copied here first if they arent already native uint16s we can point the kernel at*/
+	unsigned short int values[DecodeBatchPairs * 2];
+}packWriter;
+
+/*Everything the windowed mode keeps track of. None of it grows with the file*/
+typedef struct{
+	/*The largest values of the current window*/
+	parserCtx * ctx;
+	parserSnapshot * snapshot;
+	outputFormat format;
+	unsigned long windowValues;
+	/*What the current window has seen so far*/
+	windowStats stats;
+	double sum;
+}windowState;
+
+/*The read pipeline (-a). A reader thread fills the buffers in order while the decoder empties them in the same order*/
 typedef struct{
-	unsigned short int value;
-	int next;
-}listNode;
-
-/*List for storing the 32 largest values*/
-/*We will maintain it from smallest to largest. (Head pointer is always the smallest value.)*/
-listNode maxList[NumberOfValuesToPrint];
-/*Keep track of the size of the list so we know if it is full or not*/
-int listSize;
-/*Keep track of the index of the head of the list.*/
-int listHead;
-
-/*Circular buffer for maintaining last 32 values*/
-unsigned short int lastValuesBuffer[NumberOfValuesToPrint];
-/*Write ptr for the circular buffer*/
-int lastValuesWriteIdx;
-/*Total # of values that we have read.*/
-int totalValueCount;
+	int inputFd;
+	int bufferCount;
+	unsigned char * buffers[PipelineMaxBuffers];
+	/*Lock free SPSC rings (see bufferRing.c): filled buffers go from the reader to the decoder, empty ones come back*/
+	/*A length of 0 (the end) or -1 (an error) is the last one the reader fills*/
+	spscRing filled;
+	spscRing emptied;
+	pthread_t reader;
+	/*pipelineCancel writes to [1], the reader polls [0] along with the input*/
+	int wakeFds[2];
+}readPipeline;
+
+/*Where a framed input is at. Bytes from skipStart on are being skipped until the next block passes its check*/
+typedef struct{
+	parserCtx * ctx;
+	/*Offset in the input of the next byte frameScan gets*/
+	unsigned long offset;
+	unsigned long nextSequence;
+	int skipping;
+	unsigned long skipStart;
+	/*Blocks that made it to the parser, blocks that were lost (corrupt or missing) & bytes left out to get past them*/
+	unsigned long goodBlocks;
+	unsigned long lostBlocks;
+	unsigned long skippedBytes;
+}frameReader;
+
+/*The tail mode (-m tail): the capture we follow, how far into it we are & the socket the results are served on*/
+typedef struct{
+	const char * inputPath;
+	int inputFd;
+	off_t offset;
+	/*The TailCheckBytes (or fewer, at the start) bytes right before offset, as we decoded them*/
+	unsigned char checkBytes[TailCheckBytes];
+	int checkLength;
+	/*inotify instance & its watch on the capture, -1 if we just look at it every TailPollMilliseconds*/
+	int watchFd;
+	int watchId;
+	int listenFd;
+	parserCtx * ctx;
+	parserSnapshot * snapshot;
+}tailState;
+
+/*Where compressed data comes from: the whole (mapped) file at once, or read() from inputFd if data is NULL*/
+typedef struct{
+	const unsigned char * data;
+	size_t length;
+	int inputFd;
+	/*ReadBlockSize bytes to read into. readBuffer, except in the batch workers*/
+	unsigned char * buffer;
+}compressedSource;
+
+/*A worker that decompresses a run of whole zstd frames into its own context*/
+typedef struct{
+	const unsigned char * data;
+	size_t length;
+	/*How many bytes at the start of the run finish off the last pair (or group) of the run before it, and those bytes*/
+	int skip;
+	unsigned char head[MaxGroupBytes - 1];
+	int headLength;
+	int failed;
+	parserCtx ctx;
+	pthread_t thread;
+	int started;
+}zstdWorker;
+
+/*One input of the batch mode*/
+typedef struct{
+	char * path;
+	/*With -p: the end of path the output is named after, as few directories as it takes to tell it from the others*/
+	const char * outputName;
+	int failed;
+	/*Only used when all the results go in one output file, so they can be written in input order*/
+	parserSnapshot snapshot;
+	int haveSnapshot;
+}batchJob;
+
+typedef struct batchPool batchPool;
+
+/*A batch mode worker thread. It works through its own run of jobs & steals from the others when it runs out*/
+typedef struct{
+	batchPool * pool;
+	int id;
+	/*This worker's jobs are nextJob to endJob - 1. It takes them from the front, thieves take them from the back*/
+	int nextJob;
+	int endJob;
+	pthread_mutex_t lock;
+	/*Reset for every input, so nothing gets allocated per file*/
+	parserCtx ctx;
+	parserSnapshot snapshot;
+	/*Only used for per input outputs*/
+	outputWriter * writer;
+	/*ReadBlockSize bytes, since readBuffer is shared*/
+	unsigned char * buffer;
+	pthread_t thread;
+	int started;
+}batchWorker;
+
+/*Everything the batch mode workers share. Nothing in here changes once they start (except through the locks)*/
+struct batchPool{
+	batchJob * jobs;
+	int jobCount;
+	int jobCapacity;
+	batchWorker * workers;
+	int workerCount;
+	/*Directory for the per input outputs, or NULL when everything goes in one file*/
+	const char * outputDir;
+	outputFormat format;
+	int useStdio;
+	/*-z. CodecAuto looks at every input on its own*/
+	inputCodec codec;
+};
+
+/*One block of a sidecar index: values first to first + count - 1 are all between min & max*/
+typedef struct{
+	unsigned long first;
+	unsigned long count;
+	unsigned short int min;
+	unsigned short int max;
+}indexBlock;
+
+/*A sidecar index, loaded into memory*/
+typedef struct{
+	unsigned long blockValues;
+	unsigned long blockCount;
+	indexBlock * blocks;
+}valueIndex;
 
 
 /* ###################
    Function Prototypes
    ################### */
 
-/*Parse the data from the binary file and place it into the heap & buffer*/
-void parseAccData(FILE * inputFile);
+/*Read the input (file, pipe or socket) in big chunks and feed it to the parser. Returns -1 if a read fails*/
+int parseAccStream(parserCtx * ctx, int inputFd);
+
+/*Same as parseAccStream, but the next chunks are read (by io_uring or a reader thread) while the current one is decoded*/
+/*bufferCount is how many chunks can be in flight. Returns -1 if a read fails*/
+int parseAccPipeline(parserCtx * ctx, int inputFd, const struct stat * inputStat, int bufferCount);
+
+/*Get the buffers & rings ready & start the reader thread. Returns -1 (with nothing to clean up) if any of it fails*/
+int pipelineStart(readPipeline * pipeline, int inputFd, int bufferCount);
+
+/*Wait for the reader to finish & free everything. Adds the back pressure counts to the -DParserInstrument stats*/
+void pipelineStop(readPipeline * pipeline);
+
+/*Tell the reader to stop before the end of the input & take back the buffers it still fills. Call pipelineStop after*/
+void pipelineCancel(readPipeline * pipeline);
+
+/*Close the wake pipe*/
+void pipelineClosePipe(readPipeline * pipeline);
+
+/*Wait for the input to be readable. Returns -1 instead if pipelineCancel was called*/
+int pipelineWait(readPipeline * pipeline);
+
+/*Reader thread entry point for the pipeline. context is a readPipeline*/
+void * pipelineReader(void * context);
+
+#ifdef HAVE_LIBURING
+/*io_uring version of the pipeline for regular files. Returns -1 if a read fails, -2 if io_uring isnt available*/
+int parseAccUring(parserCtx * ctx, int inputFd, off_t fileSize, int bufferCount);
+#endif
+
+/*One read() of up to length bytes. Retries on signals & waits on non-blocking fds. Returns 0 at the end, -1 on errors*/
+ssize_t readChunk(int inputFd, unsigned char * buffer, size_t length);
+
+/*Follow a capture that's being appended to (-m tail): decode what's there, then only what gets added, and answer*/
+/*every connection to the unix socket at socketPath with the current results. Runs until SIGINT or SIGTERM*/
+/*Returns -1 if the socket cant be set up or a read fails*/
+int runTail(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const char * inputPath, const char * socketPath);
+
+/*Decode whatever was added to the capture since the last time. A capture that got shorter or whose last decoded*/
+/*bytes changed was rewritten, and another file at inputPath replaced it, so both start over from the top*/
+/*Returns -1 if a read fails*/
+int tailCatchUp(tailState * tail);
+
+/*Remember the end of what just went to the parser, length bytes at data, as the bytes to check next time*/
+void tailKeepCheck(tailState * tail, const unsigned char * data, int length);
+
+/*Start over from the top of the capture (or of the file that replaced it), saying why on stderr*/
+void tailRestart(tailState * tail, const char * reason);
+
+/*Watch the file that's open now for changes. Without inotify (or when the watch cant be added) there is no watchFd*/
+void tailWatch(tailState * tail);
+
+/*Read every inotify event that's waiting. They only say something happened, tailCatchUp works out what*/
+void tailEvents(tailState * tail);
+
+/*Answer one waiting client with the current results. A client that goes away early doesnt matter*/
+void tailServe(tailState * tail);
+
+/*SIGINT & SIGTERM handler for the tail mode*/
+void tailSignal(int signalNumber);
+
+/*Decode framed input (-e framed). Blocks that fail their CRC get skipped & reported on stderr*/
+/*Returns -1 if reading fails, a corrupt input still decodes everything that's left*/
+int parseAccFramed(parserCtx * ctx, int inputFd, const struct stat * inputStat, int useStdio);
+
+/*Check & decode every whole block in data. Returns how many bytes it got through, the rest has to come again*/
+/*with more after it. With final set there isnt any more, so whatever doesnt make a block is corrupt*/
+size_t frameScan(frameReader * reader, const unsigned char * data, size_t length, int final);
+
+/*A good block with sequence # sequence starts at offset. Reports & skips whatever got lost before it*/
+void frameResume(frameReader * reader, unsigned long offset, unsigned long sequence);
+
+/*Wrap the input in FrameBlockSize blocks (-m frame), so it can be read back with -e framed. Returns -1 if reading or writing fails*/
+int frameFile(int inputFd, const char * outputPath);
+
+#ifdef ParserInstrument
+/*Write the counters as one line of JSON to stderr. Runs at exit*/
+void instrumentReport(void);
+
+/*SIGUSR1 handler: the same line, right now*/
+void instrumentSignal(int signalNumber);
+
+/*Format the summary & write() it to outputFd. Only uses async signal safe calls*/
+void instrumentWrite(int outputFd);
+
+/*Append "key":value to the line, with value / 10^decimals printed with that many decimals*/
+void instrumentAppend(char * line, size_t * used, const char * key, unsigned long value, int decimals);
+#endif
+
+/*Map the whole input file & decode it from memory. Returns -1 if the file cant be mapped*/
+int parseAccMapped(parserCtx * ctx, int inputFd, off_t fileSize);
+
+/*Split the complete pairs of a mapped file across the worker threads & merge their results*/
+/*Returns -1 if the workers cant be set up, in which case nothing was decoded*/
+int parseAccThreaded(parserCtx * ctx, const unsigned char * fileData, off_t blockEnd);
+
+/*Decode a live stream, rewriting the output file with the current results every interval seconds*/
+/*Returns -1 if reading or writing fails*/
+/*With bufferCount > 0 a reader thread receives ahead of the decoder over the -a pipeline's lock free rings*/
+int parseAccLive(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const char * outputPath, int interval, int bufferCount);
+
+/*Seconds on the monotonic clock, for when the next live update is due*/
+double liveClock(void);
+
+/*Replace the file at outputPath with the snapshot in one go. Returns -1 if it cant be written*/
+int writeSnapshotFile(const parserSnapshot * snapshot, const char * outputPath);
+
+/*Worker thread entry point. context is a workerContext*/
+void * workerMain(void * context);
+
+/*Expand the whole input into outputPath as little endian uint16s. direct asks for O_DIRECT writes*/
+/*Returns -1 if reading or writing fails*/
+int unpackFile(int inputFd, const struct stat * inputStat, const char * outputPath, int useStdio, int direct);
+
+/*Unpack the next length bytes into the writer, writing it out whenever it fills up*/
+void unpackFeed(unpackWriter * writer, const unsigned char * bytes, size_t length);
+
+/*Unpack pairCount complete pairs into the writer*/
+void unpackPairs(unpackWriter * writer, const unsigned char * bytes, size_t pairCount);
+
+/*The input is over. Adds the odd value at the end (if there is one) & writes out the rest*/
+void unpackFinish(unpackWriter * writer);
+
+/*Write out everything the writer has collected*/
+void unpackDrain(unpackWriter * writer);
+
+/*write() all length bytes, retrying short writes & signals. Returns -1 if it fails*/
+int writeAll(int outputFd, const void * bytes, size_t length);
+
+/*Read the whole input (mapped or in chunks) into the writer. Returns -1 if a read fails*/
+int unpackInput(unpackWriter * writer, int inputFd, const struct stat * inputStat, int useStdio);
+
+/*Write the stats of every windowValues values of the input to the output writer as soon as each window is done*/
+/*Returns -1 if reading or writing fails*/
+int windowFile(parserCtx * ctx, parserSnapshot * snapshot, int inputFd, const struct stat * inputStat, int useStdio, unsigned long windowValues);
+
+/*unpackWriter sink for the windowed mode. context is a windowState*/
+void windowSink(void * context, const unsigned short int * values, size_t count);
+
+/*Write out the current window & start the next one*/
+void windowEmit(windowState * window);
+
+/*Pack a file of little endian uint16s (like the unpack mode writes) into outputPath as 12 bit pairs*/
+/*Returns -1 if reading or writing fails*/
+int packFile(int inputFd, const struct stat * inputStat, const char * outputPath, int useStdio);
+
+/*Pack length bytes (a multiple of 4, so whole pairs) of little endian uint16s into the writer*/
+void packFeed(packWriter * writer, const unsigned char * bytes, size_t length);
+
+/*The input is over. Packs the odd value at the end into 2 bytes (if there is one) & writes out the rest*/
+void packFinish(packWriter * writer, const unsigned char * tail, size_t length);
+
+/*Number of values in a file of fileSize bytes*/
+unsigned long fileValueCount(off_t fileSize);
+
+/*Decode values first to first + count - 1 (count up to IndexBlockValues) of the file with pread*/
+/*Returns a pointer into rangeValues, or NULL if the read fails*/
+const unsigned short int * readValues(int inputFd, off_t fileSize, unsigned long first, unsigned long count);
+
+/*Feed values first to end - 1 of the file to the parser. Returns -1 if a read fails*/
+int feedValueRange(parserCtx * ctx, int inputFd, off_t fileSize, unsigned long first, unsigned long end);
+
+/*Find the largest values between first & end - 1, skipping index blocks that cant make the cut (index can be NULL)*/
+/*Returns -1 if a read fails*/
+int rangeMaxValues(parserCtx * ctx, int inputFd, off_t fileSize, unsigned long first, unsigned long end, const valueIndex * index);
+
+/*qsort compare function that puts the index blocks with the biggest max first*/
+int compareBlockMax(const void * a, const void * b);
+
+/*Write a sidecar index of the file to indexPath. Returns -1 if reading or writing fails*/
+int buildIndex(int inputFd, off_t fileSize, const char * indexPath);
+
+/*Load the sidecar index at indexPath. Returns -1 if it cant be read or wasnt built for a file of fileSize bytes*/
+int loadIndex(const char * indexPath, off_t fileSize, valueIndex * index);
+
+/*Assemble an unsigned number from size little endian bytes*/
+unsigned long readLittleEndian(const unsigned char * bytes, int size);
+
+/*Fold the partial results (-f partial) at inputs into one & write it to outputPath in resultFormat*/
+/*Returns -1 if any of them cant be read or they werent made with the same -n & -b*/
+int runMerge(const char * outputPath, const char * const * inputs, int inputCount);
+
+/*Load the partial result at path into a partial that gets parserPartialInit'ed with its settings*/
+/*Returns -1 if it cant be read, isnt a partial result or has a version we dont know*/
+int loadPartial(const char * path, parserPartial * partial);
+
+/*Read count little endian uint16s into values. Returns -1 if any are missing or limit or bigger. Skips the padding after them*/
+int readPartialValues(FILE * inputFile, unsigned short int * values, int count, unsigned long limit);
+
+/*Decode every input (from the cmd line, globs & the manifest) on a pool of threadCount workers*/
+/*Returns -1 if anything couldnt be read or written*/
+int runBatch(const char * outputPath, const char * const * inputs, int inputCount, const char * manifestPath, int perInput,
+             int valuesToPrint, maxValueEngine engine, int useStdio, inputCodec codec);
+
+/*Add an input to the batch. Patterns with * ? or [ get expanded with glob(). Returns -1 if we run out of memory*/
+int addBatchInput(batchPool * pool, const char * path);
+
+/*Add a single input to the batch, no pattern matching. Returns -1 if we run out of memory*/
+int addBatchJob(batchPool * pool, const char * path);
+
+/*Add every line of the manifest file (- for stdin) as an input. Returns -1 if it cant be read*/
+int readManifest(batchPool * pool, const char * manifestPath);
+
+/*Give every job of a -p batch its own outputName. Returns -1 (after saying which) if two inputs are the same file*/
+/*name or one cant be named without a .. in it*/
+int nameBatchOutputs(batchPool * pool);
+
+/*Path of a job's -p output: <outputDir>/<outputName><extension>. Returns NULL if we run out of memory*/
+char * batchOutputPath(const batchPool * pool, const batchJob * job);
+
+/*Make the directories an output path needs below the output directory. Ones that are there already are fine*/
+void makeOutputDirs(char * outputPath, size_t dirLength);
+
+/*The last part of path before end that isnt empty or ".", and its length. Returns NULL if there isnt one*/
+const char * pathPrevious(const char * path, const char * end, size_t * length);
+
+/*How many parts at the end of two paths are the same*/
+int pathCommonTail(const char * a, const char * b);
+
+/*qsort compare for batchJob pointers: by the last part of the path, then the one before it & so on*/
+int compareJobTails(const void * a, const void * b);
+
+/*Batch worker thread entry point. context is a batchWorker*/
+void * batchWorkerMain(void * context);
+
+/*Next job for the worker, its own or stolen from another worker. Returns -1 once there are none left anywhere*/
+int takeBatchJob(batchWorker * worker);
+
+/*Decode one input in the worker's context & write (or keep) the results. Returns -1 if it fails*/
+int runBatchJob(batchWorker * worker, batchJob * job);
+
+/*Decode the whole file at path into ctx, using buffer (ReadBlockSize bytes) for reads. Compressed files (see codec)*/
+/*get decompressed on this thread. Returns -1 if it cant be read*/
+int parseAccFile(parserCtx * ctx, const char * path, unsigned char * buffer, int useStdio, inputCodec codec);
+
+/*Work out how the input is compressed. Only regular files can be looked at without eating the first bytes*/
+inputCodec detectCodec(int inputFd, const struct stat * inputStat);
+
+/*Say which library a build without the codec needs. path is the input, or NULL if there's only the one*/
+/*Returns -1 if the codec isnt built in*/
+int checkCodec(inputCodec codec, const char * path);
 
-/*Convert from big endian in the binary file to little endian*/
-void ntoh24Bit(void * word);
+/*Decompress the input straight into the parser. Regular files get mapped (& multi frame zstd on up to threads*/
+/*threads), everything else is read into buffer (ReadBlockSize bytes). Returns -1 if reading or decompressing fails*/
+int parseAccCompressed(parserCtx * ctx, int inputFd, const struct stat * inputStat, inputCodec codec, int useStdio,
+                       unsigned char * buffer, int threads);
 
-/*Read the circular buffer and print out the last values read (should be <= 32 values)*/
-void printLastValues(FILE * outputFile);
+#ifdef HAVE_ZLIB
+/*Inflate gzip (or zlib) data, including several gzip members back to back. Returns -1 if the data is bad*/
+int parseAccGzip(parserCtx * ctx, compressedSource * source, unsigned char * output);
+#endif
 
-/*Add the value to the heap if necessary*/
-void listInsert(unsigned short int value);
+#ifdef HAVE_ZSTD
+/*Decompress zstd data one frame after the other. Returns -1 if the data is bad*/
+int parseAccZstd(parserCtx * ctx, compressedSource * source, unsigned char * output);
 
-/*Remove the smallest element from the list*/
-/*Returns the index of the removed element, so that the location can be used for the new element*/
-int listRemove();
-/*prints the contest of the linked list in order from smallest to largest*/
-void printMaxValues(FILE * outputFile);
-/*returns the smallest number*/
-unsigned short int listPeek();
+/*Decompress the frames of mapped zstd data on up to threads workers*/
+/*Returns -2 without touching ctx if the frames dont say how big they are (or there are too few of them)*/
+int parseAccZstdThreaded(parserCtx * ctx, const unsigned char * data, size_t length, int threads);
 
+/*zstd worker thread entry point. context is a zstdWorker*/
+void * zstdWorkerMain(void * context);
+#endif
@@ -0,0 +1,424 @@
+/*sched_yield & nanosleep arent part of C89*/
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include "bufferRing.h"
+
+
+
+/***********************************************************************************************************************************
+ Notes on the rings:
+
+ The read pipeline used to hand buffers between the reader & the decoder under a mutex, with two condition variables
+ for the waits. Every buffer cost two lock/unlock pairs & usually a wake up, and a live feed with small packets does
+ that thousands of times a second. These rings do the hand over with plain loads & stores instead.
+
+ 1) SPSC - The producer only ever writes tail & the consumer only ever writes head, so neither needs a lock. A push
+    writes the slot, then publishes tail with a release store; a pop reads tail with an acquire load before it reads
+    the slot, so it always sees the whole descriptor. Each side also keeps the last index it saw of the other side,
+    and only goes back to the other side's cache line once it looks full (or empty) with the old one.
+
+ 2) MPMC - Several threads on a side cant share an index like that, so this is the usual bounded queue with a
+    sequence number per slot. A producer claims a position with a CAS on enqueuePosition, writes the slot, then
+    bumps the slot's sequence to say it's ready to pop; a consumer does the same the other way and sets the sequence
+    a whole lap ahead for the next push. A slot whose sequence doesnt match is either still being written/read or
+    the ring is full/empty, which the difference tells apart.
+
+ 3) Waits - Neither ring ever blocks in the kernel. The Wait versions spin a little, then sched_yield, then sleep
+    100 us at a time, so a live feed that goes quiet doesnt burn a cpu. Every wait that was needed at all gets
+    counted (fullWaits/emptyWaits), which is the back pressure: a producer waiting on a full ring means the parser
+    is behind.
+
+ The atomics are the gcc/clang __atomic builtins, since C89 doesnt have any.
+
+ ***********************************************************************************************************************************/
+
+
+
+#define RingLoad(pointer, order) __atomic_load_n(pointer, __ATOMIC_##order)
+#define RingStore(pointer, value, order) __atomic_store_n(pointer, value, __ATOMIC_##order)
+#define RingAdd(pointer, value) __atomic_fetch_add(pointer, value, __ATOMIC_RELAXED)
+
+/*Spins before the Wait functions start yielding, and yields before they start sleeping*/
+#define RingSpinAttempts 64
+#define RingYieldAttempts 128
+#define RingSleepNanoseconds 100000
+
+static void ringBackoff(int attempt);
+static double ringClock(void);
+static void ringRaiseHighWater(unsigned long * highWater, unsigned long count);
+
+
+/*This function gets an SPSC ring ready*/
+int spscInit(spscRing * ring, unsigned long capacity){
+
+	if(capacity == 0 || capacity > RingMaxCapacity || (capacity & (capacity - 1)) != 0){
+		return -1;
+	}
+
+	ring->slots = malloc(capacity * sizeof(bufferDescriptor));
+	if(ring->slots == NULL){
+		return -1;
+	}
+
+	ring->mask = capacity - 1;
+	ring->head = 0;
+	ring->cachedTail = 0;
+	ring->popped = 0;
+	ring->emptyWaits = 0;
+	ring->tail = 0;
+	ring->cachedHead = 0;
+	ring->pushed = 0;
+	ring->fullWaits = 0;
+	ring->highWater = 0;
+
+	return 0;
+
+}
+
+
+/*This function frees the slots of an SPSC ring*/
+void spscDestroy(spscRing * ring){
+
+	free(ring->slots);
+	ring->slots = NULL;
+
+}
+
+
+/*This function adds a descriptor to an SPSC ring, if there is room*/
+int spscPush(spscRing * ring, const bufferDescriptor * descriptor){
+
+	unsigned long tail;
+
+	/*Only look at the consumer's head if the old one says we're full*/
+	tail = ring->tail;
+	if(tail - ring->cachedHead > ring->mask){
+		ring->cachedHead = RingLoad(&ring->head, ACQUIRE);
+		if(tail - ring->cachedHead > ring->mask){
+			return -1;
+		}
+	}
+
+	ring->slots[tail & ring->mask] = *descriptor;
+	/*The slot has to be written before the consumer can see the new tail*/
+	RingStore(&ring->tail, tail + 1, RELEASE);
+
+	RingStore(&ring->pushed, ring->pushed + 1, RELAXED);
+	if(tail + 1 - ring->cachedHead > ring->highWater){
+		RingStore(&ring->highWater, tail + 1 - ring->cachedHead, RELAXED);
+	}
+
+	return 0;
+
+}
+
+
+/*This function takes the oldest descriptor off an SPSC ring, if there is one*/
+int spscPop(spscRing * ring, bufferDescriptor * descriptor){
+
+	unsigned long head;
+
+	head = ring->head;
+	if(head == ring->cachedTail){
+		ring->cachedTail = RingLoad(&ring->tail, ACQUIRE);
+		if(head == ring->cachedTail){
+			return -1;
+		}
+	}
+
+	*descriptor = ring->slots[head & ring->mask];
+	/*We're done with the slot once the producer sees the new head*/
+	RingStore(&ring->head, head + 1, RELEASE);
+
+	RingStore(&ring->popped, ring->popped + 1, RELAXED);
+
+	return 0;
+
+}
+
+
+/*This function pushes, waiting for room if it has to*/
+void spscPushWait(spscRing * ring, const bufferDescriptor * descriptor){
+
+	int attempt;
+
+	if(spscPush(ring, descriptor) == 0){
+		return;
+	}
+
+	RingStore(&ring->fullWaits, ring->fullWaits + 1, RELAXED);
+	for(attempt = 0; spscPush(ring, descriptor) != 0; attempt++){
+		ringBackoff(attempt);
+	}
+
+}
+
+
+/*This function pops, waiting for a descriptor if it has to*/
+void spscPopWait(spscRing * ring, bufferDescriptor * descriptor){
+
+	int attempt;
+
+	if(spscPop(ring, descriptor) == 0){
+		return;
+	}
+
+	RingStore(&ring->emptyWaits, ring->emptyWaits + 1, RELAXED);
+	for(attempt = 0; spscPop(ring, descriptor) != 0; attempt++){
+		ringBackoff(attempt);
+	}
+
+}
+
+
+/*This function pops like spscPopWait, but only waits until milliseconds have gone by*/
+int spscPopTimed(spscRing * ring, bufferDescriptor * descriptor, long milliseconds){
+
+	double deadline;
+	int attempt;
+
+	if(spscPop(ring, descriptor) == 0){
+		return 0;
+	}
+
+	RingStore(&ring->emptyWaits, ring->emptyWaits + 1, RELAXED);
+	deadline = ringClock() + (double)milliseconds / 1e3;
+	for(attempt = 0; spscPop(ring, descriptor) != 0; attempt++){
+		if(ringClock() >= deadline){
+			return -1;
+		}
+		ringBackoff(attempt);
+	}
+
+	return 0;
+
+}
+
+
+/*This function copies out the counters of an SPSC ring*/
+void spscCounters(const spscRing * ring, ringCounters * counters){
+
+	counters->pushed = RingLoad(&ring->pushed, RELAXED);
+	counters->popped = RingLoad(&ring->popped, RELAXED);
+	counters->fullWaits = RingLoad(&ring->fullWaits, RELAXED);
+	counters->emptyWaits = RingLoad(&ring->emptyWaits, RELAXED);
+	counters->highWater = RingLoad(&ring->highWater, RELAXED);
+
+}
+
+
+/*This function gets an MPMC ring ready. Slot i is ready for the push at position i*/
+int mpmcInit(mpmcRing * ring, unsigned long capacity){
+
+	unsigned long i;
+
+	if(capacity < 2 || capacity > RingMaxCapacity || (capacity & (capacity - 1)) != 0){
+		return -1;
+	}
+
+	ring->slots = malloc(capacity * sizeof(mpmcSlot));
+	if(ring->slots == NULL){
+		return -1;
+	}
+
+	for(i = 0; i < capacity; i++){
+		ring->slots[i].sequence = i;
+	}
+	ring->mask = capacity - 1;
+	ring->enqueuePosition = 0;
+	ring->dequeuePosition = 0;
+	ring->counters.pushed = 0;
+	ring->counters.popped = 0;
+	ring->counters.fullWaits = 0;
+	ring->counters.emptyWaits = 0;
+	ring->counters.highWater = 0;
+
+	return 0;
+
+}
+
+
+/*This function frees the slots of an MPMC ring*/
+void mpmcDestroy(mpmcRing * ring){
+
+	free(ring->slots);
+	ring->slots = NULL;
+
+}
+
+
+/*This function claims the next position with a CAS, fills its slot & marks it ready to pop*/
+int mpmcPush(mpmcRing * ring, const bufferDescriptor * descriptor){
+
+	mpmcSlot * slot;
+	unsigned long position, sequence;
+	long difference;
+
+	position = RingLoad(&ring->enqueuePosition, RELAXED);
+	for(;;){
+
+		slot = &ring->slots[position & ring->mask];
+		sequence = RingLoad(&slot->sequence, ACQUIRE);
+		difference = (long)(sequence - position);
+
+		if(difference == 0){
+			/*Our turn, if nobody else claims it first. A failed CAS gives us the new position*/
+			if(__atomic_compare_exchange_n(&ring->enqueuePosition, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+		}
+		else if(difference < 0){
+			/*The slot still has last lap's descriptor in it*/
+			return -1;
+		}
+		else{
+			/*Somebody else got this one, try again from wherever they left it*/
+			position = RingLoad(&ring->enqueuePosition, RELAXED);
+		}
+
+	}
+
+	slot->descriptor = *descriptor;
+	RingStore(&slot->sequence, position + 1, RELEASE);
+
+	RingAdd(&ring->counters.pushed, 1);
+	ringRaiseHighWater(&ring->counters.highWater, position + 1 - RingLoad(&ring->dequeuePosition, RELAXED));
+
+	return 0;
+
+}
+
+
+/*This function claims the oldest position with a CAS, reads its slot & hands the slot to the push a lap later*/
+int mpmcPop(mpmcRing * ring, bufferDescriptor * descriptor){
+
+	mpmcSlot * slot;
+	unsigned long position, sequence;
+	long difference;
+
+	position = RingLoad(&ring->dequeuePosition, RELAXED);
+	for(;;){
+
+		slot = &ring->slots[position & ring->mask];
+		sequence = RingLoad(&slot->sequence, ACQUIRE);
+		difference = (long)(sequence - (position + 1));
+
+		if(difference == 0){
+			if(__atomic_compare_exchange_n(&ring->dequeuePosition, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+		}
+		else if(difference < 0){
+			/*Nothing has been pushed here yet*/
+			return -1;
+		}
+		else{
+			position = RingLoad(&ring->dequeuePosition, RELAXED);
+		}
+
+	}
+
+	*descriptor = slot->descriptor;
+	RingStore(&slot->sequence, position + ring->mask + 1, RELEASE);
+
+	RingAdd(&ring->counters.popped, 1);
+
+	return 0;
+
+}
+
+
+/*This function pushes, waiting for room if it has to*/
+void mpmcPushWait(mpmcRing * ring, const bufferDescriptor * descriptor){
+
+	int attempt;
+
+	if(mpmcPush(ring, descriptor) == 0){
+		return;
+	}
+
+	RingAdd(&ring->counters.fullWaits, 1);
+	for(attempt = 0; mpmcPush(ring, descriptor) != 0; attempt++){
+		ringBackoff(attempt);
+	}
+
+}
+
+
+/*This function pops, waiting for a descriptor if it has to*/
+void mpmcPopWait(mpmcRing * ring, bufferDescriptor * descriptor){
+
+	int attempt;
+
+	if(mpmcPop(ring, descriptor) == 0){
+		return;
+	}
+
+	RingAdd(&ring->counters.emptyWaits, 1);
+	for(attempt = 0; mpmcPop(ring, descriptor) != 0; attempt++){
+		ringBackoff(attempt);
+	}
+
+}
+
+
+/*This function copies out the counters of an MPMC ring*/
+void mpmcCounters(const mpmcRing * ring, ringCounters * counters){
+
+	counters->pushed = RingLoad(&ring->counters.pushed, RELAXED);
+	counters->popped = RingLoad(&ring->counters.popped, RELAXED);
+	counters->fullWaits = RingLoad(&ring->counters.fullWaits, RELAXED);
+	counters->emptyWaits = RingLoad(&ring->counters.emptyWaits, RELAXED);
+	counters->highWater = RingLoad(&ring->counters.highWater, RELAXED);
+
+}
+
+
+/*This function waits a little longer every time it's called for the same wait*/
+static void ringBackoff(int attempt){
+
+	struct timespec pause;
+
+	if(attempt < RingSpinAttempts){
+		return;
+	}
+	if(attempt < RingYieldAttempts){
+		sched_yield();
+		return;
+	}
+
+	pause.tv_sec = 0;
+	pause.tv_nsec = RingSleepNanoseconds;
+	nanosleep(&pause, NULL);
+
+}
+
+
+/*This function reads the monotonic clock in seconds, for the timed waits*/
+static double ringClock(void){
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+
+}
+
+
+/*This function raises the high water mark to count, unless another thread already raised it past that*/
+static void ringRaiseHighWater(unsigned long * highWater, unsigned long count){
+
+	unsigned long seen;
+
+	/*The dequeue position we read can be a little stale, which would make count look huge*/
+	seen = RingLoad(highWater, RELAXED);
+	while(count > seen && count <= RingMaxCapacity){
+		if(__atomic_compare_exchange_n(highWater, &seen, count, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			break;
+		}
+	}
+
+}
@@ -0,0 +1,109 @@
+/* ##################################
+   Lock Free Buffer Descriptor Rings
+   ################################## */
+
+/*Keeps what the producer & the consumer write on different cache lines*/
+#define RingCacheLine 64
+/*Biggest ring ringInit takes*/
+#define RingMaxCapacity (1 << 20)
+
+/*One buffer handed from one thread to another. Whoever pops it owns the bytes until it gets handed back*/
+typedef struct{
+	unsigned char * data;
+	/*How many bytes of data are filled in. 0 = the end of the stream, -1 = the producer hit an error*/
+	long length;
+	/*Whatever the two sides want it to mean, e.g. which buffer of a pool or which receiver it came from*/
+	int tag;
+}bufferDescriptor;
+
+/*
+ * Back pressure. fullWaits counts every time a producer found the ring full & had to wait, i.e. the consumer (the
+ * parser) is falling behind. emptyWaits counts the consumer finding it empty, i.e. the producer is the slow side.
+ * highWater is the most descriptors that were ever in the ring at once, as far as the producers could tell (they
+ * dont always look at what the consumer took in the meantime, so it can be a little high).
+ */
+typedef struct{
+	unsigned long pushed;
+	unsigned long popped;
+	unsigned long fullWaits;
+	unsigned long emptyWaits;
+	unsigned long highWater;
+}ringCounters;
+
+/*
+ * Single producer, single consumer. head & tail count up forever & the slot is the count & mask, the same trick
+ * lastValuesBuffer uses, so full is tail - head == capacity & empty is tail == head.
+ */
+typedef struct{
+	bufferDescriptor * slots;
+	unsigned long mask;
+	/*Only the consumer writes these. cachedTail is the last tail it saw, so it only has to look again when it runs out*/
+	unsigned long head;
+	unsigned long cachedTail;
+	unsigned long popped;
+	unsigned long emptyWaits;
+	char consumerPad[RingCacheLine];
+	/*Only the producer writes these, cachedHead the same way*/
+	unsigned long tail;
+	unsigned long cachedHead;
+	unsigned long pushed;
+	unsigned long fullWaits;
+	unsigned long highWater;
+	char producerPad[RingCacheLine];
+}spscRing;
+
+/*A slot of the MPMC ring. sequence says whose turn it is: the next push when it equals the slot's position, the next pop when it's one past it*/
+typedef struct{
+	unsigned long sequence;
+	bufferDescriptor descriptor;
+}mpmcSlot;
+
+/*Any number of producers & consumers (fan in from several receivers). Same counting & masking, plus a CAS per op*/
+typedef struct{
+	mpmcSlot * slots;
+	unsigned long mask;
+	unsigned long enqueuePosition;
+	char producerPad[RingCacheLine];
+	unsigned long dequeuePosition;
+	char consumerPad[RingCacheLine];
+	/*Updated with atomic adds, since several threads do it*/
+	ringCounters counters;
+}mpmcRing;
+
+
+/* ###################
+   Function Prototypes
+   ################### */
+
+/*Get a ring ready for capacity descriptors. capacity has to be a power of two. Returns -1 if it isnt or cant be allocated*/
+int spscInit(spscRing * ring, unsigned long capacity);
+
+/*Free the slots*/
+void spscDestroy(spscRing * ring);
+
+/*Add a descriptor. Returns -1 right away if the ring is full. Only ever called from the one producer thread*/
+int spscPush(spscRing * ring, const bufferDescriptor * descriptor);
+
+/*Take the oldest descriptor. Returns -1 right away if the ring is empty. Only ever called from the one consumer thread*/
+int spscPop(spscRing * ring, bufferDescriptor * descriptor);
+
+/*spscPush, but waits (spin, then yield, then sleep) for room instead of failing. Counts a full wait if it had to*/
+void spscPushWait(spscRing * ring, const bufferDescriptor * descriptor);
+
+/*spscPop, but waits for a descriptor instead of failing. Counts an empty wait if it had to*/
+void spscPopWait(spscRing * ring, bufferDescriptor * descriptor);
+
+/*spscPopWait, but gives up after milliseconds. Returns -1 if nothing came in that time*/
+int spscPopTimed(spscRing * ring, bufferDescriptor * descriptor, long milliseconds);
+
+/*Copy out the back pressure counters. Can be called from any thread, the numbers are just a moment apart*/
+void spscCounters(const spscRing * ring, ringCounters * counters);
+
+/*Same as the spsc functions, for any number of threads on either side*/
+int mpmcInit(mpmcRing * ring, unsigned long capacity);
+void mpmcDestroy(mpmcRing * ring);
+int mpmcPush(mpmcRing * ring, const bufferDescriptor * descriptor);
+int mpmcPop(mpmcRing * ring, bufferDescriptor * descriptor);
+void mpmcPushWait(mpmcRing * ring, const bufferDescriptor * descriptor);
+void mpmcPopWait(mpmcRing * ring, bufferDescriptor * descriptor);
+void mpmcCounters(const mpmcRing * ring, ringCounters * counters);
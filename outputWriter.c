@@ -0,0 +1,794 @@
+#include <stdio.h>
+#include <string.h>
+#include "accParser.h"
+#include "outputWriter.h"
+
+
+
+/***********************************************************************************************************************************
+ Notes on the output writer:
+
+ With big n (or a full dump) printing used to cost more than decoding, since every value went through
+ fprintf & its format string parsing. Here the digits come two at a time out of a 200 byte table
+ ("00" to "99"), so a 12 bit value is at most two lookups, and everything is collected into one 64 KiB buffer
+ that goes out with a single fwrite when it fills up. The text is byte for byte what "%hu\n" gave us.
+
+ Programs downstream of us dont want text at all, so there are a few other formats:
+   raw    - the max values then the last values as little endian uint16s. Both arrays always have the same
+            length (min(n, values read)), so the file size / 4 tells you how many there are.
+   binary - a binaryRecordHeader (see outputWriter.h) followed by the two arrays, every section aligned to 8 bytes,
+            so a consumer can mmap it & use it without any parsing.
+   csv    - kind,value rows, kind being max or last
+   json   - {"totalValues": ..., "valuesToPrint": ..., "max": [...], "last": [...]}
+   partial - a partialRecordHeader & the sections of a parserPartial, for -m merge to put back together. Only the
+            stats histogram from the lowest to the highest value that was seen goes in, so a capture that only
+            uses part of the range doesnt pay for the rest.
+
+ The windowed mode writes a record per window instead, as soon as the window is done: a block of text, a csv row
+ (the max values space separated in the last column) or a JSON object on its own line.
+ With -q the text, csv & json get the summary stats too: a --Summary-- block, one kind,value row per stat, or a
+ "summary" object.
+ Interleaved channels (-c) get one snapshot each, written like the inputs of a batch but tagged with the channel number.
+
+ ***********************************************************************************************************************************/
+
+
+
+/*Every 2 digit number, back to back. digitPairs[2 * n] & digitPairs[2 * n + 1] are the digits of n*/
+static const char digitPairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+static const char * formatNames[FormatCount] = {"text", "raw", "binary", "csv", "json", "partial"};
+
+static const char * formatExtensions[FormatCount] = {".txt", ".raw", ".bin", ".csv", ".json", ".part"};
+
+static void outputDrain(outputWriter * writer);
+static int formatUnsigned(char * out, unsigned long value);
+static void outputTextMax(outputWriter * writer, const parserSnapshot * snapshot);
+static void outputTextLast(outputWriter * writer, const parserSnapshot * snapshot);
+static void outputValuesList(outputWriter * writer, const unsigned short int * values, int count);
+static void outputMean(outputWriter * writer, double mean);
+static void outputValuesRows(outputWriter * writer, const char * name, int channel, const char * kind, const unsigned short int * values, int count);
+static void outputJson(outputWriter * writer, const parserSnapshot * snapshot, const char * name, int channel);
+static void outputQuoted(outputWriter * writer, const char * name, outputFormat format);
+static void outputSummaryRows(outputWriter * writer, const char * name, int channel, const parserSummary * summary);
+static void outputSummaryField(outputWriter * writer, const char * name, int channel, const char * kind, unsigned long value, const double * decimal, outputFormat format);
+
+
+/*This function gets a writer ready*/
+void outputInit(outputWriter * writer, FILE * file){
+
+	writer->file = file;
+	writer->failed = 0;
+	writer->used = 0;
+
+}
+
+
+/*Write out the buffer so there is room again*/
+static void outputDrain(outputWriter * writer){
+
+	if(writer->used > 0 && fwrite(&writer->buffer[0], 1, writer->used, writer->file) != writer->used){
+		writer->failed = 1;
+	}
+	writer->used = 0;
+
+}
+
+
+/*This function appends raw bytes, going straight to the file if they dont fit in the buffer anyway*/
+void outputBytes(outputWriter * writer, const void * bytes, size_t length){
+
+	if(writer->used + length > OutputBufferSize){
+		outputDrain(writer);
+		if(length > OutputBufferSize){
+			if(fwrite(bytes, 1, length, writer->file) != length){
+				writer->failed = 1;
+			}
+			return;
+		}
+	}
+
+	memcpy(&writer->buffer[writer->used], bytes, length);
+	writer->used += length;
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+void outputString(outputWriter * writer, const char * string){
+	outputBytes(writer, string, strlen(string));
+}
+
+
+/*Format value into out with no terminator. Returns how many characters that took*/
+static int formatUnsigned(char * out, unsigned long value){
+
+	char digits[24];
+	int pos, index;
+
+	/*Fill in from the back, 2 digits at a time*/
+	pos = sizeof(digits);
+	while(value >= 100){
+		index = (int)(value % 100) << 1;
+		value /= 100;
+		digits[--pos] = digitPairs[index + 1];
+		digits[--pos] = digitPairs[index];
+	}
+	if(value >= 10){
+		index = (int)value << 1;
+		digits[--pos] = digitPairs[index + 1];
+		digits[--pos] = digitPairs[index];
+	}
+	else{
+		digits[--pos] = (char)('0' + value);
+	}
+
+	memcpy(out, &digits[pos], sizeof(digits) - pos);
+
+	return (int)sizeof(digits) - pos;
+
+}
+
+
+/*This function appends a number in decimal*/
+void outputUnsigned(outputWriter * writer, unsigned long value){
+
+	char text[24];
+
+	outputBytes(writer, text, (size_t)formatUnsigned(text, value));
+
+}
+
+
+/*This function appends a batch of values, one per line*/
+void outputValues(outputWriter * writer, const unsigned short int * values, int count){
+
+	char * out;
+	unsigned int value, high, low;
+	int i;
+
+	for(i = 0; i < count; i++){
+
+		/*A 16 bit value + the newline is never more than 6 characters*/
+		if(writer->used + 6 > OutputBufferSize){
+			outputDrain(writer);
+		}
+		out = &writer->buffer[writer->used];
+
+		/*Split it into 2 digit halves & skip any leading zeros*/
+		value = values[i];
+		if(value >= 10000){
+			writer->used += formatUnsigned(out, value);
+			out = &writer->buffer[writer->used];
+		}
+		else{
+			high = (value / 100) << 1;
+			low = (value % 100) << 1;
+			if(value >= 1000){
+				*out++ = digitPairs[high];
+			}
+			if(value >= 100){
+				*out++ = digitPairs[high + 1];
+			}
+			if(value >= 10){
+				*out++ = digitPairs[low];
+			}
+			*out++ = digitPairs[low + 1];
+		}
+		*out++ = '\n';
+
+		writer->used = out - &writer->buffer[0];
+
+	}
+
+}
+
+
+/*This function writes out everything & reports whether any of it failed*/
+int outputFlush(outputWriter * writer){
+
+	outputDrain(writer);
+
+	if(fflush(writer->file) != 0){
+		writer->failed = 1;
+	}
+
+	return writer->failed ? -1 : 0;
+
+}
+
+
+/*This function writes a snapshot in the same text format we've always had*/
+void outputSnapshotText(outputWriter * writer, const parserSnapshot * snapshot){
+
+	outputTextMax(writer, snapshot);
+	outputTextLast(writer, snapshot);
+	if(snapshot->hasSummary){
+		outputString(writer, "--Summary--\n");
+		outputSummaryRows(writer, NULL, -2, &snapshot->summary);
+	}
+
+}
+
+
+/*The sorted max values with their header*/
+static void outputTextMax(outputWriter * writer, const parserSnapshot * snapshot){
+
+	outputString(writer, "--Sorted Max ");
+	outputUnsigned(writer, (unsigned long)snapshot->valuesToPrint);
+	outputString(writer, " Values--\n");
+	outputValues(writer, snapshot->maxValues, snapshot->maxCount);
+
+}
+
+
+/*The last values with their header*/
+static void outputTextLast(outputWriter * writer, const parserSnapshot * snapshot){
+
+	outputString(writer, "--Last ");
+	outputUnsigned(writer, (unsigned long)snapshot->valuesToPrint);
+	outputString(writer, " Values--\n");
+	outputValues(writer, snapshot->lastValues, snapshot->lastCount);
+
+}
+
+
+/*This function writes just the sections that were asked for*/
+void outputSnapshotSections(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, int sections){
+
+	parserSnapshot part;
+
+	if(format == FormatText){
+		if(sections & OutputMaxSection){
+			outputTextMax(writer, snapshot);
+		}
+		if(sections & OutputLastSection){
+			outputTextLast(writer, snapshot);
+		}
+		if(snapshot->hasSummary){
+			outputString(writer, "--Summary--\n");
+			outputSummaryRows(writer, NULL, -2, &snapshot->summary);
+		}
+		return;
+	}
+
+	/*The other formats have a fixed layout, so the missing sections are just empty*/
+	part = *snapshot;
+	if(!(sections & OutputMaxSection)){
+		part.maxCount = 0;
+	}
+	if(!(sections & OutputLastSection)){
+		part.lastCount = 0;
+	}
+
+	outputSnapshot(writer, &part, format);
+
+}
+
+
+/*This function appends the low size bytes of value, least significant first*/
+void outputLittleEndian(outputWriter * writer, unsigned long value, int size){
+
+	unsigned char bytes[8];
+	int i;
+
+	for(i = 0; i < size; i++){
+		bytes[i] = (unsigned char)(value & 0xFF);
+		value >>= 8;
+	}
+
+	outputBytes(writer, bytes, (size_t)size);
+
+}
+
+
+/*This function appends a batch of values as little endian uint16s, no matter what byte order we run on*/
+void outputValuesLittleEndian(outputWriter * writer, const unsigned short int * values, int count){
+
+	unsigned char * out;
+	int i;
+
+	for(i = 0; i < count; i++){
+
+		if(writer->used + 2 > OutputBufferSize){
+			outputDrain(writer);
+		}
+		out = (unsigned char *)&writer->buffer[writer->used];
+
+		out[0] = (unsigned char)(values[i] & 0xFF);
+		out[1] = (unsigned char)(values[i] >> 8);
+
+		writer->used += 2;
+
+	}
+
+}
+
+
+/*Simple lookup so the format can be picked from the cmd line*/
+int outputFormatByName(const char * name){
+
+	int i;
+
+	for(i = 0; i < FormatCount; i++){
+		if(strcmp(name, formatNames[i]) == 0){
+			return i;
+		}
+	}
+
+	return -1;
+
+}
+
+
+/*This function writes a snapshot in whichever format was asked for*/
+void outputSnapshot(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format){
+
+	switch(format){
+		case FormatRaw:
+			outputSnapshotRaw(writer, snapshot);
+			break;
+		case FormatBinary:
+			outputSnapshotBinary(writer, snapshot);
+			break;
+		case FormatCsv:
+			outputSnapshotCsv(writer, snapshot);
+			break;
+		case FormatJson:
+			outputSnapshotJson(writer, snapshot);
+			break;
+		default:
+			outputSnapshotText(writer, snapshot);
+			break;
+	}
+
+}
+
+
+/*This function writes the two arrays with nothing around them*/
+void outputSnapshotRaw(outputWriter * writer, const parserSnapshot * snapshot){
+
+	outputValuesLittleEndian(writer, snapshot->maxValues, snapshot->maxCount);
+	outputValuesLittleEndian(writer, snapshot->lastValues, snapshot->lastCount);
+
+}
+
+
+/*This function writes the header field by field (so the byte order & layout dont depend on the compiler), then the sections*/
+void outputSnapshotBinary(outputWriter * writer, const parserSnapshot * snapshot){
+
+	static const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	unsigned long maxOffset, lastOffset, total;
+
+	/*Each section starts on the next multiple of 8*/
+	maxOffset = sizeof(binaryRecordHeader);
+	lastOffset = (maxOffset + 2 * (unsigned long)snapshot->maxCount + 7) & ~7UL;
+	total = snapshot->totalValueCount;
+
+	outputLittleEndian(writer, BinaryRecordMagic, 4);
+	outputLittleEndian(writer, BinaryRecordVersion, 4);
+	outputLittleEndian(writer, total & 0xFFFFFFFFUL, 4);
+	/*Shifting by 32 in two steps, since long might only have 32 bits*/
+	outputLittleEndian(writer, (total >> 16) >> 16, 4);
+	outputLittleEndian(writer, (unsigned long)snapshot->valuesToPrint, 4);
+	outputLittleEndian(writer, (unsigned long)snapshot->maxCount, 4);
+	outputLittleEndian(writer, maxOffset, 4);
+	outputLittleEndian(writer, (unsigned long)snapshot->lastCount, 4);
+	outputLittleEndian(writer, lastOffset, 4);
+	outputLittleEndian(writer, 0, 4);
+
+	outputValuesLittleEndian(writer, snapshot->maxValues, snapshot->maxCount);
+	outputBytes(writer, padding, lastOffset - maxOffset - 2 * (unsigned long)snapshot->maxCount);
+
+	/*Pad the end too, so records can be concatenated & still stay aligned*/
+	outputValuesLittleEndian(writer, snapshot->lastValues, snapshot->lastCount);
+	outputBytes(writer, padding, ((2 * (unsigned long)snapshot->lastCount + 7) & ~7UL) - 2 * (unsigned long)snapshot->lastCount);
+
+}
+
+
+/*This function writes the header field by field like the binary record, then the sections, each padded to 8 bytes*/
+void outputPartial(outputWriter * writer, const parserPartial * partial){
+
+	static const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	unsigned long statsFirst, statsEnd, bins;
+	int i;
+
+	/*Only the bins from the first to the last one that isnt 0*/
+	statsFirst = 0;
+	statsEnd = 0;
+	if(partial->statsBins != NULL){
+		bins = 1UL << partial->sampleBits;
+		for(statsFirst = 0; statsFirst < bins && partial->statsBins[statsFirst] == 0; statsFirst++);
+		for(statsEnd = bins; statsEnd > statsFirst && partial->statsBins[statsEnd - 1] == 0; statsEnd--);
+		if(statsFirst == bins){
+			statsFirst = 0;
+			statsEnd = 0;
+		}
+	}
+
+	outputLittleEndian(writer, PartialRecordMagic, 4);
+	outputLittleEndian(writer, PartialRecordVersion, 4);
+	outputLittleEndian(writer, (unsigned long)partial->sampleBits, 4);
+	outputLittleEndian(writer, (unsigned long)partial->valuesToPrint, 4);
+	outputLittleEndian(writer, partial->totalValueCount & 0xFFFFFFFFUL, 4);
+	outputLittleEndian(writer, (partial->totalValueCount >> 16) >> 16, 4);
+	outputLittleEndian(writer, partial->firstValue & 0xFFFFFFFFUL, 4);
+	outputLittleEndian(writer, (partial->firstValue >> 16) >> 16, 4);
+	outputLittleEndian(writer, partial->endValue & 0xFFFFFFFFUL, 4);
+	outputLittleEndian(writer, (partial->endValue >> 16) >> 16, 4);
+	outputLittleEndian(writer, (unsigned long)partial->maxCount, 4);
+	outputLittleEndian(writer, (unsigned long)partial->lastCount, 4);
+	outputLittleEndian(writer, (unsigned long)partial->runCount, 4);
+	outputLittleEndian(writer, (partial->statsBins != NULL) ? PartialHasStats : 0, 4);
+	outputLittleEndian(writer, statsFirst, 4);
+	outputLittleEndian(writer, statsEnd - statsFirst, 4);
+
+	outputValuesLittleEndian(writer, partial->maxValues, partial->maxCount);
+	outputBytes(writer, padding, ((2 * (unsigned long)partial->maxCount + 7) & ~7UL) - 2 * (unsigned long)partial->maxCount);
+	outputValuesLittleEndian(writer, partial->lastValues, partial->lastCount);
+	outputBytes(writer, padding, ((2 * (unsigned long)partial->lastCount + 7) & ~7UL) - 2 * (unsigned long)partial->lastCount);
+
+	for(i = 0; i < partial->runCount; i++){
+		outputLittleEndian(writer, partial->runs[i].first & 0xFFFFFFFFUL, 4);
+		outputLittleEndian(writer, (partial->runs[i].first >> 16) >> 16, 4);
+		outputLittleEndian(writer, (unsigned long)partial->runs[i].count, 4);
+		outputLittleEndian(writer, 0, 4);
+	}
+
+	for(; statsFirst < statsEnd; statsFirst++){
+		outputLittleEndian(writer, partial->statsBins[statsFirst] & 0xFFFFFFFFUL, 4);
+		outputLittleEndian(writer, (partial->statsBins[statsFirst] >> 16) >> 16, 4);
+	}
+
+}
+
+
+/*This function appends kind,value (or name,kind,value) for each of the values*/
+static void outputValuesRows(outputWriter * writer, const char * name, int channel, const char * kind, const unsigned short int * values, int count){
+
+	int i;
+
+	for(i = 0; i < count; i++){
+		if(name != NULL){
+			outputQuoted(writer, name, FormatCsv);
+			outputBytes(writer, ",", 1);
+		}
+		if(channel >= 0){
+			outputUnsigned(writer, (unsigned long)channel);
+			outputBytes(writer, ",", 1);
+		}
+		outputString(writer, kind);
+		outputBytes(writer, ",", 1);
+		/*outputValues takes care of the number & the newline*/
+		outputValues(writer, &values[i], 1);
+	}
+
+}
+
+
+/*This function writes one row per value, the max values first*/
+void outputSnapshotCsv(outputWriter * writer, const parserSnapshot * snapshot){
+
+	outputString(writer, "kind,value\n");
+	outputValuesRows(writer, NULL, -1, "max", snapshot->maxValues, snapshot->maxCount);
+	outputValuesRows(writer, NULL, -1, "last", snapshot->lastValues, snapshot->lastCount);
+	if(snapshot->hasSummary){
+		outputSummaryRows(writer, NULL, -1, &snapshot->summary);
+	}
+
+}
+
+
+/*This function appends the values as the inside of a JSON array*/
+static void outputValuesList(outputWriter * writer, const unsigned short int * values, int count){
+
+	int i;
+
+	for(i = 0; i < count; i++){
+		if(i > 0){
+			outputBytes(writer, ",", 1);
+		}
+		outputUnsigned(writer, (unsigned long)values[i]);
+	}
+
+}
+
+
+/*This function writes the snapshot as a single JSON object*/
+void outputSnapshotJson(outputWriter * writer, const parserSnapshot * snapshot){
+	outputJson(writer, snapshot, NULL, -1);
+}
+
+
+/*The JSON object, with a "file" member first if there is a name*/
+static void outputJson(outputWriter * writer, const parserSnapshot * snapshot, const char * name, int channel){
+
+	outputBytes(writer, "{", 1);
+	if(name != NULL){
+		outputString(writer, "\"file\":");
+		outputQuoted(writer, name, FormatJson);
+		outputBytes(writer, ",", 1);
+	}
+	if(channel >= 0){
+		outputString(writer, "\"channel\":");
+		outputUnsigned(writer, (unsigned long)channel);
+		outputBytes(writer, ",", 1);
+	}
+	outputString(writer, "\"totalValues\":");
+	outputUnsigned(writer, snapshot->totalValueCount);
+	outputString(writer, ",\"valuesToPrint\":");
+	outputUnsigned(writer, (unsigned long)snapshot->valuesToPrint);
+	outputString(writer, ",\"max\":[");
+	outputValuesList(writer, snapshot->maxValues, snapshot->maxCount);
+	outputString(writer, "],\"last\":[");
+	outputValuesList(writer, snapshot->lastValues, snapshot->lastCount);
+	outputBytes(writer, "]", 1);
+	if(snapshot->hasSummary){
+		outputString(writer, ",\"summary\":{");
+		outputSummaryField(writer, NULL, -1, "count", snapshot->summary.count, NULL, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "min", snapshot->summary.min, NULL, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "max", snapshot->summary.max, NULL, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "mean", 0, &snapshot->summary.mean, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "variance", 0, &snapshot->summary.variance, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "p50", snapshot->summary.p50, NULL, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "p99", snapshot->summary.p99, NULL, FormatJson);
+		outputBytes(writer, ",", 1);
+		outputSummaryField(writer, NULL, -1, "p999", snapshot->summary.p999, NULL, FormatJson);
+		outputBytes(writer, "}", 1);
+	}
+	outputString(writer, "}\n");
+
+}
+
+
+/*This function writes one stat the way the format wants it: "kind":value for json, [name,][channel,]kind,value rows*/
+/*for csv, and "kind value" lines for text (channel -2). decimal is set for the stats that arent whole numbers*/
+static void outputSummaryField(outputWriter * writer, const char * name, int channel, const char * kind, unsigned long value, const double * decimal, outputFormat format){
+
+	if(format == FormatJson){
+		outputBytes(writer, "\"", 1);
+		outputString(writer, kind);
+		outputString(writer, "\":");
+	}
+	else{
+		if(name != NULL){
+			outputQuoted(writer, name, FormatCsv);
+			outputBytes(writer, ",", 1);
+		}
+		if(channel >= 0){
+			outputUnsigned(writer, (unsigned long)channel);
+			outputBytes(writer, ",", 1);
+		}
+		outputString(writer, kind);
+		outputBytes(writer, (channel == -2) ? " " : ",", 1);
+	}
+
+	if(decimal != NULL){
+		outputMean(writer, *decimal);
+	}
+	else{
+		outputUnsigned(writer, value);
+	}
+
+	if(format != FormatJson){
+		outputBytes(writer, "\n", 1);
+	}
+
+}
+
+
+/*This function writes every stat of the summary as a csv row (or a text line)*/
+static void outputSummaryRows(outputWriter * writer, const char * name, int channel, const parserSummary * summary){
+
+	outputSummaryField(writer, name, channel, "count", summary->count, NULL, FormatCsv);
+	outputSummaryField(writer, name, channel, "min", summary->min, NULL, FormatCsv);
+	outputSummaryField(writer, name, channel, "max", summary->max, NULL, FormatCsv);
+	outputSummaryField(writer, name, channel, "mean", 0, &summary->mean, FormatCsv);
+	outputSummaryField(writer, name, channel, "variance", 0, &summary->variance, FormatCsv);
+	outputSummaryField(writer, name, channel, "p50", summary->p50, NULL, FormatCsv);
+	outputSummaryField(writer, name, channel, "p99", summary->p99, NULL, FormatCsv);
+	outputSummaryField(writer, name, channel, "p999", summary->p999, NULL, FormatCsv);
+
+}
+
+
+/*This function appends a mean with 3 decimals*/
+static void outputMean(outputWriter * writer, double mean){
+
+	char text[64];
+
+	sprintf(text, "%.3f", mean);
+	outputString(writer, text);
+
+}
+
+
+/*This function writes one window in whichever of the line based formats was asked for*/
+void outputWindow(outputWriter * writer, const windowStats * stats, const parserSnapshot * snapshot, outputFormat format){
+
+	int i;
+
+	if(format == FormatCsv){
+
+		if(stats->index == 0){
+			outputString(writer, "window,first,count,min,max,mean,maxValues\n");
+		}
+		outputUnsigned(writer, stats->index);
+		outputBytes(writer, ",", 1);
+		outputUnsigned(writer, stats->first);
+		outputBytes(writer, ",", 1);
+		outputUnsigned(writer, stats->count);
+		outputBytes(writer, ",", 1);
+		outputUnsigned(writer, stats->min);
+		outputBytes(writer, ",", 1);
+		outputUnsigned(writer, stats->max);
+		outputBytes(writer, ",", 1);
+		outputMean(writer, stats->mean);
+		outputBytes(writer, ",", 1);
+		for(i = 0; i < snapshot->maxCount; i++){
+			if(i > 0){
+				outputBytes(writer, " ", 1);
+			}
+			outputUnsigned(writer, snapshot->maxValues[i]);
+		}
+		outputBytes(writer, "\n", 1);
+
+	}
+	else if(format == FormatJson){
+
+		outputString(writer, "{\"window\":");
+		outputUnsigned(writer, stats->index);
+		outputString(writer, ",\"first\":");
+		outputUnsigned(writer, stats->first);
+		outputString(writer, ",\"count\":");
+		outputUnsigned(writer, stats->count);
+		outputString(writer, ",\"min\":");
+		outputUnsigned(writer, stats->min);
+		outputString(writer, ",\"max\":");
+		outputUnsigned(writer, stats->max);
+		outputString(writer, ",\"mean\":");
+		outputMean(writer, stats->mean);
+		outputString(writer, ",\"maxValues\":[");
+		outputValuesList(writer, snapshot->maxValues, snapshot->maxCount);
+		outputString(writer, "]}\n");
+
+	}
+	else{
+
+		outputString(writer, "--Window ");
+		outputUnsigned(writer, stats->index);
+		outputString(writer, ": Values ");
+		outputUnsigned(writer, stats->first);
+		outputString(writer, " to ");
+		outputUnsigned(writer, stats->first + stats->count - 1);
+		outputString(writer, "--\nMin ");
+		outputUnsigned(writer, stats->min);
+		outputString(writer, "\nMax ");
+		outputUnsigned(writer, stats->max);
+		outputString(writer, "\nMean ");
+		outputMean(writer, stats->mean);
+		outputBytes(writer, "\n", 1);
+		outputTextMax(writer, snapshot);
+
+	}
+
+}
+
+
+/*This function writes whatever goes at the very top of a batch output*/
+void outputBatchStart(outputWriter * writer, outputFormat format){
+
+	if(format == FormatCsv){
+		outputString(writer, "file,kind,value\n");
+	}
+
+}
+
+
+/*This function writes the results of one input of a batch, tagged with its name wherever the format has room for it*/
+void outputSnapshotNamed(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, const char * name){
+
+	switch(format){
+		case FormatCsv:
+			outputValuesRows(writer, name, -1, "max", snapshot->maxValues, snapshot->maxCount);
+			outputValuesRows(writer, name, -1, "last", snapshot->lastValues, snapshot->lastCount);
+			if(snapshot->hasSummary){
+				outputSummaryRows(writer, name, -1, &snapshot->summary);
+			}
+			break;
+		case FormatJson:
+			outputJson(writer, snapshot, name, -1);
+			break;
+		case FormatText:
+			outputString(writer, "--File ");
+			outputString(writer, name);
+			outputString(writer, "--\n");
+			outputSnapshotText(writer, snapshot);
+			break;
+		default:
+			/*The binary formats just go back to back, in the same order as the inputs*/
+			outputSnapshot(writer, snapshot, format);
+			break;
+	}
+
+}
+
+
+/*This function writes whatever the channel results start with (the csv header)*/
+void outputChannelsStart(outputWriter * writer, outputFormat format){
+
+	if(format == FormatCsv){
+		outputString(writer, "channel,kind,value\n");
+	}
+
+}
+
+
+/*This function writes the results of one channel of an interleaved stream, tagged with its number like a batch input*/
+void outputSnapshotChannel(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, int channel){
+
+	switch(format){
+		case FormatCsv:
+			outputValuesRows(writer, NULL, channel, "max", snapshot->maxValues, snapshot->maxCount);
+			outputValuesRows(writer, NULL, channel, "last", snapshot->lastValues, snapshot->lastCount);
+			if(snapshot->hasSummary){
+				outputSummaryRows(writer, NULL, channel, &snapshot->summary);
+			}
+			break;
+		case FormatJson:
+			outputJson(writer, snapshot, NULL, channel);
+			break;
+		case FormatText:
+			outputString(writer, "--Channel ");
+			outputUnsigned(writer, (unsigned long)channel);
+			outputString(writer, "--\n");
+			outputSnapshotText(writer, snapshot);
+			break;
+		default:
+			/*The binary formats just go back to back, channel 0 first*/
+			outputSnapshot(writer, snapshot, format);
+			break;
+	}
+
+}
+
+
+/*This function appends name as a quoted csv field or JSON string*/
+static void outputQuoted(outputWriter * writer, const char * name, outputFormat format){
+
+	char escape[8];
+
+	outputBytes(writer, "\"", 1);
+	for(; *name != '\0'; name++){
+		if(*name == '"'){
+			/*csv doubles quotes, JSON escapes them*/
+			outputString(writer, (format == FormatCsv) ? "\"\"" : "\\\"");
+		}
+		else if(format == FormatJson && *name == '\\'){
+			outputString(writer, "\\\\");
+		}
+		else if(format == FormatJson && (unsigned char)*name < 0x20){
+			sprintf(escape, "\\u%04x", (unsigned int)(unsigned char)*name);
+			outputString(writer, escape);
+		}
+		else{
+			outputBytes(writer, name, 1);
+		}
+	}
+	outputBytes(writer, "\"", 1);
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+const char * outputFormatExtension(outputFormat format){
+	return formatExtensions[format];
+}
@@ -0,0 +1,171 @@
+/* ##################################
+   Buffered Output Writer
+   ################################## */
+
+/*How much output we collect before it goes out in a single fwrite*/
+#define OutputBufferSize 65536
+
+/*The formats we can write the results in (-f)*/
+typedef enum{
+	FormatText = 0,
+	FormatRaw,
+	FormatBinary,
+	FormatCsv,
+	FormatJson,
+	FormatPartial,
+	FormatCount
+}outputFormat;
+
+/*Which parts of a snapshot outputSnapshotSections writes. Some modes only work out one of them*/
+#define OutputMaxSection 1
+#define OutputLastSection 2
+#define OutputAllSections (OutputMaxSection | OutputLastSection)
+
+/*
+ * The framed binary format (-f binary). Everything is little endian, and every field & section is naturally
+ * aligned, so on a little endian machine a consumer can mmap the file & cast it to this struct.
+ * The max values (smallest first) are maxCount uint16s at maxOffset, the last values (oldest first) are
+ * lastCount uint16s at lastOffset. Both offsets are multiples of 8.
+ */
+#define BinaryRecordMagic 0x52434341
+#define BinaryRecordVersion 1
+typedef struct{
+	unsigned int magic;
+	unsigned int version;
+	/*Total # of values read, split in two so the struct is the same on 32 & 64 bit machines*/
+	unsigned int totalValuesLow;
+	unsigned int totalValuesHigh;
+	unsigned int valuesToPrint;
+	unsigned int maxCount;
+	unsigned int maxOffset;
+	unsigned int lastCount;
+	unsigned int lastOffset;
+	unsigned int reserved;
+}binaryRecordHeader;
+
+/*
+ * The partial result format (-f partial, read back by -m merge). Little endian like the binary record, but made
+ * to be merged rather than mmapped: the header, then the sections back to back, each padded to a multiple of 8.
+ *   maxCount uint16s     - the largest values, smallest first
+ *   lastCount uint16s    - the last values, oldest first
+ *   runCount x 16 bytes  - where those came from: the offset of the first one (64 bits), how many in a row (32), 0
+ *   statsCount x 8 bytes - the count of every value from statsFirst on (only with PartialHasStats)
+ * A reader has to reject any version it doesnt know. Offsets & counts are split in two like totalValues above.
+ */
+#define PartialRecordMagic 0x50434341
+#define PartialRecordVersion 1
+#define PartialHasStats 1
+typedef struct{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int sampleBits;
+	unsigned int valuesToPrint;
+	unsigned int totalValuesLow;
+	unsigned int totalValuesHigh;
+	/*Where the shard starts in the whole stream, and one past where it ends*/
+	unsigned int firstValueLow;
+	unsigned int firstValueHigh;
+	unsigned int endValueLow;
+	unsigned int endValueHigh;
+	unsigned int maxCount;
+	unsigned int lastCount;
+	unsigned int runCount;
+	unsigned int flags;
+	/*Bins below statsFirst or past statsFirst + statsCount are all zero, so they arent written*/
+	unsigned int statsFirst;
+	unsigned int statsCount;
+}partialRecordHeader;
+
+/*The summary of one window of the windowed mode (-w)*/
+typedef struct{
+	unsigned long index;
+	/*Position of the first value of the window in the stream*/
+	unsigned long first;
+	unsigned long count;
+	unsigned short int min;
+	unsigned short int max;
+	double mean;
+}windowStats;
+
+/*Formats values straight into a big buffer & writes it out in one go, instead of an fprintf per value*/
+typedef struct{
+	FILE * file;
+	/*Set once any write fails. Checked (and returned) by outputFlush*/
+	int failed;
+	size_t used;
+	char buffer[OutputBufferSize];
+}outputWriter;
+
+
+/* ###################
+   Function Prototypes
+   ################### */
+
+/*Get a writer ready to write to file*/
+void outputInit(outputWriter * writer, FILE * file);
+
+/*Append a string*/
+void outputString(outputWriter * writer, const char * string);
+
+/*Append an unsigned number in decimal, exactly like %lu would*/
+void outputUnsigned(outputWriter * writer, unsigned long value);
+
+/*Append each of the values in decimal, one per line, exactly like "%hu\n" would*/
+void outputValues(outputWriter * writer, const unsigned short int * values, int count);
+
+/*Append raw bytes*/
+void outputBytes(outputWriter * writer, const void * bytes, size_t length);
+
+/*Write out whatever is buffered & fflush the file. Returns -1 if anything failed since outputInit*/
+int outputFlush(outputWriter * writer);
+
+/*Append an unsigned number as size little endian bytes*/
+void outputLittleEndian(outputWriter * writer, unsigned long value, int size);
+
+/*Append each of the values as a little endian uint16*/
+void outputValuesLittleEndian(outputWriter * writer, const unsigned short int * values, int count);
+
+/*Look up a format by its name (text, raw, binary, csv, json). Returns -1 for unknown names*/
+int outputFormatByName(const char * name);
+
+/*Write the snapshot in the given format*/
+void outputSnapshot(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format);
+
+/*Write only some sections of the snapshot. Text leaves the others out completely, the other formats write them empty*/
+void outputSnapshotSections(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, int sections);
+
+/*Write whatever a batch output starts with (the csv header)*/
+void outputBatchStart(outputWriter * writer, outputFormat format);
+
+/*Write the results of one input of a batch, tagged with its name (text, csv & json), or just back to back (raw & binary)*/
+void outputSnapshotNamed(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, const char * name);
+
+/*Write whatever the results of an interleaved stream start with (the csv header)*/
+void outputChannelsStart(outputWriter * writer, outputFormat format);
+
+/*Write the results of one channel, tagged with its number (text, csv & json), or just back to back (raw & binary)*/
+void outputSnapshotChannel(outputWriter * writer, const parserSnapshot * snapshot, outputFormat format, int channel);
+
+/*File name extension that goes with the format, e.g. ".txt"*/
+const char * outputFormatExtension(outputFormat format);
+
+/*Write the stats & the largest values of one window. Only text, csv & json (one object per line) make sense here*/
+void outputWindow(outputWriter * writer, const windowStats * stats, const parserSnapshot * snapshot, outputFormat format);
+
+/*Write the snapshot as text: the sorted max values, then the last values*/
+void outputSnapshotText(outputWriter * writer, const parserSnapshot * snapshot);
+
+/*Write the snapshot as two raw little endian uint16 arrays: the max values, then the last values*/
+void outputSnapshotRaw(outputWriter * writer, const parserSnapshot * snapshot);
+
+/*Write the snapshot as a framed binary record (see binaryRecordHeader)*/
+void outputSnapshotBinary(outputWriter * writer, const parserSnapshot * snapshot);
+
+/*Write the snapshot as CSV, one kind,value row per value*/
+void outputSnapshotCsv(outputWriter * writer, const parserSnapshot * snapshot);
+
+/*Write the snapshot as a JSON object*/
+void outputSnapshotJson(outputWriter * writer, const parserSnapshot * snapshot);
+
+/*Write a partial result (see partialRecordHeader). Snapshots dont know where in the stream they came from, so this is the only way to get one*/
+void outputPartial(outputWriter * writer, const parserPartial * partial);
@@ -0,0 +1,1011 @@
+/*getauxval isnt part of C89*/
+#define _GNU_SOURCE
+#include <string.h>
+#include "unpack12.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UnpackHaveX86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__linux__))
+#define UnpackHaveNeon
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__aarch64__) && defined(__GNUC__) && defined(HWCAP_CRC32)
+#define UnpackHaveArmCrc
+#include <arm_acle.h>
+#endif
+#endif
+
+
+
+/***********************************************************************************************************************************
+ Notes on the unpack kernels:
+
+ Every 3 bytes b0 b1 b2 hold two values, v0 = b0:b1(upper nibble) and v1 = b1(lower nibble):b2.
+ If we read b0 b1 as a big endian 16 bit word, v0 is that word shifted right by 4.
+ If we read b1 b2 as a big endian 16 bit word, v1 is that word masked with 0xFFF.
+
+ 1) SSSE3 - One pshufb builds both of those 16 bit words for 4 pairs (12 bytes) at once, byte swapping them on the way.
+    A shift on the even lanes and a mask on the odd lanes then gives 8 values.
+    pshufb wants a full 16 byte load, so the last few pairs are left to the scalar loop to avoid reading past the block.
+
+ 2) AVX2 - Same trick, but the two 128 bit lanes each get their own 12 bytes, so 24 bytes turn into 16 values
+    per iteration. vpshufb only shuffles within a lane, which is exactly what we want here.
+
+ 3) NEON - vld3 de-interleaves 8 pairs into b0, b1 & b2 vectors for us, so the values are just widening shifts & ors,
+    and vst2 interleaves them back in order. No over-read, so it runs right up to the end of the block.
+
+ 4) Filters - Once the max list is full almost every value is <= the smallest value in it, so the filter kernels compare
+    16 values at a time against that threshold and only stop when one of them is bigger.
+    Values are at most 14 bits (-b 14), so they still fit a signed 16 bit compare on x86.
+
+ 5) Pack - The other way around. Every pair v0 v1 is the 24 bit word v0 << 12 | v1, and on x86 one pmaddwd
+    (v0 * 4096 + v1 * 1) builds that word in each 32 bit lane. A pshufb then takes the 3 low bytes of each lane in
+    big endian order & packs them together, so 8 values turn into 12 bytes (16 values into 24 for AVX2).
+    The stores are 16 bytes wide, so like the unpack kernels the last few pairs are left to the scalar loop.
+    NEON does it with narrowing shifts on the de-interleaved values & vst3.
+    Values bigger than 12 bits just lose their upper bits.
+
+ 6) Count - The sorted array engine needs to know how many of its values are smaller than a new one. That's one
+    compare per 8 (16) values, and the compare results (-1 or 0) get subtracted from a running count, so there are
+    no branches at all. A horizontal add at the end gives the total.
+
+ 7) Other widths - 10 & 14 bit sensors pack 4 values into 5 & 7 bytes, big endian, same as us otherwise.
+    DefineUnpackWidth turns out one kernel per width, with the group unrolled & every shift & mask a constant,
+    so it ends up as the handwritten scalar kernel would. Value k starts at bit k * bits of the group, and the
+    3 bytes from its first byte on always hold all of it (bits + 7 <= 24), so every value is one 24 bit word
+    shifted & masked. Bytes past the end of the group are never touched.
+    12 bits gets the SIMD kernels above instead.
+
+ 8) Split - Interleaved channels (X Y Z X Y Z ...) get pulled apart after the unpack, while the values are still in
+    L1. 2 channels is one pshufb per 8 values (evens to the bottom, odds to the top) & an unpack of the 64 bit
+    halves. 3 channels takes 3 vectors (8 frames) at a time, and every channel is 3 pshufbs (one per vector, with
+    the lanes that arent ours zeroed) ored together. AVX2 uses the SSSE3 kernel, since vpshufb cant cross lanes &
+    the stores are the bottleneck anyway. NEON has vld2 & vld3, which do exactly this. Any other channel count
+    goes through the scalar loop.
+
+ 9) CRC32C - Framed input (-e framed) checks every block. x86 has had crc32 since SSE4.2 and ARMv8 has crc32c*, 8
+    bytes per instruction. On x86 each one waits 3 cycles for the last one, so one stream of them only gets about
+    half of what memory can deliver. Instead 3 stripes (8 KiB, 256 bytes at the end) go through side by side and
+    get stitched back together with tables of what that many zero bytes do to a crc (crc(a b) = crc(a) moved past
+    len(b) zeros ^ crc(b)), which takes it to about 3 times that. The tables are worked out once, at unpackSelect.
+    ARM is one stream for now. Without either instruction it's a 16 entry table, one lookup per nibble: slow, but
+    tiny & the same answer. SSSE3 doesnt imply SSE4.2, so the crc kernel gets its own cpu check.
+
+ The kernel is picked once at startup from cpuid (x86) or the auxiliary vector (32 bit ARM, aarch64 always has NEON).
+ Every kernel produces exactly the same output as the scalar one.
+
+ ***********************************************************************************************************************************/
+
+
+
+static void unpackScalar(const unsigned char * in, int pairCount, unsigned short int * out);
+static void packScalar(const unsigned short int * in, int pairCount, unsigned char * out);
+static int filterScalar(const unsigned short int * values, int count, unsigned short int threshold);
+static int countScalar(const unsigned short int * values, int count, unsigned short int value);
+static void splitScalar(const unsigned short int * in, int frameCount, int channels, unsigned short int * const * out);
+static void splitFrames(const unsigned short int * in, int first, int frameCount, int channels, unsigned short int * const * out);
+static unsigned int crcScalar(unsigned int crc, const unsigned char * data, size_t length);
+
+unpackKernel unpack12Pairs = unpackScalar;
+
+packKernel pack12Pairs = packScalar;
+
+filterKernel firstAboveThreshold = filterScalar;
+
+countKernel countBelow = countScalar;
+
+splitKernel splitChannels = splitScalar;
+
+crcKernel crc32c = crcScalar;
+
+/*CRC32C of every nibble (reflected, polynomial 0x82F63B78)*/
+static const unsigned int crcNibbles[16] = {
+	0x00000000, 0x105EC76F, 0x20BD8EDE, 0x30E349B1, 0x417B1DBC, 0x5125DAD3, 0x61C69362, 0x7198540D,
+	0x82F63B78, 0x92A8FC17, 0xA24BB5A6, 0xB21572C9, 0xC38D26C4, 0xD3D3E1AB, 0xE330A81A, 0xF36E6F75
+};
+
+static unpackKernelId currentKernel = UnpackScalar;
+
+static const char * kernelNames[UnpackKernelCount] = {"auto", "scalar", "ssse3", "avx2", "neon"};
+
+
+/*Plain C version. Also used by the other kernels to finish off their blocks*/
+static void unpackScalar(const unsigned char * in, int pairCount, unsigned short int * out){
+
+	unsigned int word;
+	int i;
+
+	for(i = 0; i < pairCount; i++){
+
+		/*Assemble the big endian 24 bits straight from the bytes*/
+		word = ((unsigned int)in[0] << 16) | ((unsigned int)in[1] << 8) | in[2];
+
+		out[0] = (word >> 12) & 0xFFF;
+		out[1] = word & 0xFFF;
+
+		in += 3;
+		out += 2;
+	}
+
+}
+
+
+/*Plain C version. Also used by the other pack kernels to finish off their blocks*/
+static void packScalar(const unsigned short int * in, int pairCount, unsigned char * out){
+
+	unsigned int word;
+	int i;
+
+	for(i = 0; i < pairCount; i++){
+
+		word = ((unsigned int)(in[0] & 0xFFF) << 12) | (in[1] & 0xFFF);
+
+		/*Big endian, like the rest of the file*/
+		out[0] = (unsigned char)(word >> 16);
+		out[1] = (unsigned char)(word >> 8);
+		out[2] = (unsigned char)word;
+
+		in += 2;
+		out += 3;
+	}
+
+}
+
+
+/*Plain C version. Also used by the other filters to pin down the exact value & handle the last few*/
+static int filterScalar(const unsigned short int * values, int count, unsigned short int threshold){
+
+	int i;
+
+	for(i = 0; i < count; i++){
+		if(values[i] > threshold){
+			break;
+		}
+	}
+
+	return i;
+
+}
+
+
+/*Plain C version. The compare is 0 or 1, so adding it up doesnt need a branch*/
+static int countScalar(const unsigned short int * values, int count, unsigned short int value){
+
+	int below, i;
+
+	below = 0;
+	for(i = 0; i < count; i++){
+		below += (values[i] < value);
+	}
+
+	return below;
+
+}
+
+
+/*Plain C version*/
+static void splitScalar(const unsigned short int * in, int frameCount, int channels, unsigned short int * const * out){
+
+	splitFrames(in, 0, frameCount, channels, out);
+
+}
+
+
+/*Frames first to frameCount - 1. Also used by the other split kernels for channel counts they dont handle & the last few frames*/
+static void splitFrames(const unsigned short int * in, int first, int frameCount, int channels, unsigned short int * const * out){
+
+	int i, c;
+
+	in += first * channels;
+	for(i = first; i < frameCount; i++){
+		for(c = 0; c < channels; c++){
+			out[c][i] = in[c];
+		}
+		in += channels;
+	}
+
+}
+
+
+/*Plain C version, a nibble at a time*/
+static unsigned int crcScalar(unsigned int crc, const unsigned char * data, size_t length){
+
+	size_t i;
+
+	crc = ~crc;
+	for(i = 0; i < length; i++){
+		crc ^= data[i];
+		crc = (crc >> 4) ^ crcNibbles[crc & 0x0F];
+		crc = (crc >> 4) ^ crcNibbles[crc & 0x0F];
+	}
+
+	return ~crc;
+
+}
+
+
+#ifdef UnpackHaveX86
+
+/*This function multiplies vec by a 32 x 32 bit matrix over GF(2), one column per bit of vec*/
+static unsigned int crcMatrixTimes(const unsigned int * matrix, unsigned int vec){
+
+	unsigned int sum;
+
+	sum = 0;
+	while(vec != 0){
+		if(vec & 1){
+			sum ^= *matrix;
+		}
+		vec >>= 1;
+		matrix++;
+	}
+
+	return sum;
+
+}
+
+
+/*This function squares the matrix, i.e. the operator for twice as many zero bits*/
+static void crcMatrixSquare(unsigned int * square, const unsigned int * matrix){
+
+	int i;
+
+	for(i = 0; i < 32; i++){
+		square[i] = crcMatrixTimes(matrix, matrix[i]);
+	}
+
+}
+
+
+/*This function builds shift[4][256]: what running length (a power of two) zero bytes through the crc does to it, a byte at a time*/
+static void crcShiftTable(unsigned int shift[][256], unsigned long length){
+
+	unsigned int odd[32], even[32];
+	unsigned int row, i;
+
+	/*One zero bit*/
+	odd[0] = 0x82F63B78;
+	row = 1;
+	for(i = 1; i < 32; i++){
+		odd[i] = row;
+		row <<= 1;
+	}
+	/*2 bits, then 4, then squaring on up from a byte until length is used up*/
+	crcMatrixSquare(even, odd);
+	crcMatrixSquare(odd, even);
+	for(;;){
+		crcMatrixSquare(even, odd);
+		length >>= 1;
+		if(length == 0){
+			break;
+		}
+		crcMatrixSquare(odd, even);
+		length >>= 1;
+		if(length == 0){
+			memcpy(even, odd, sizeof(even));
+			break;
+		}
+	}
+
+	for(i = 0; i < 256; i++){
+		shift[0][i] = crcMatrixTimes(even, i);
+		shift[1][i] = crcMatrixTimes(even, i << 8);
+		shift[2][i] = crcMatrixTimes(even, i << 16);
+		shift[3][i] = crcMatrixTimes(even, i << 24);
+	}
+
+}
+
+
+/*What CrcLongStripe & CrcShortStripe zero bytes do to a crc, for putting the 3 stripes back together*/
+#define CrcLongStripe 8192
+#define CrcShortStripe 256
+static unsigned int crcLongShift[4][256];
+static unsigned int crcShortShift[4][256];
+static int crcShiftReady = 0;
+
+#define CrcShift(Table, Crc) \
+	(Table[0][(Crc) & 0xFF] ^ Table[1][((Crc) >> 8) & 0xFF] ^ Table[2][((Crc) >> 16) & 0xFF] ^ Table[3][(Crc) >> 24])
+
+/*
+ * CRC32C with the SSE4.2 instruction, 8 bytes at a time (4 on 32 bit). One crc32 has to wait for the last one, so
+ * three stripes of the input go through at once & get combined with the shift tables: the crc of a then b is the
+ * crc of a shifted past len(b) zero bytes, xored with the crc of b on its own.
+ */
+#ifdef __x86_64__
+#define CrcWord unsigned long
+#define CrcStep(Crc, Bytes) ((unsigned int)_mm_crc32_u64((Crc), crcLoad(Bytes)))
+#else
+#define CrcWord unsigned int
+#define CrcStep(Crc, Bytes) (_mm_crc32_u32((Crc), crcLoad(Bytes)))
+#endif
+
+static CrcWord crcLoad(const unsigned char * bytes){
+
+	CrcWord word;
+
+	memcpy(&word, bytes, sizeof(word));
+
+	return word;
+
+}
+
+__attribute__((target("sse4.2")))
+static unsigned int crcSse42(unsigned int crc, const unsigned char * data, size_t length){
+
+	unsigned int crc1, crc2;
+	const unsigned char * end;
+
+	crc = ~crc;
+
+	while(length >= 3 * CrcLongStripe){
+		crc1 = 0;
+		crc2 = 0;
+		for(end = data + CrcLongStripe; data < end; data += sizeof(CrcWord)){
+			crc = CrcStep(crc, data);
+			crc1 = CrcStep(crc1, data + CrcLongStripe);
+			crc2 = CrcStep(crc2, data + 2 * CrcLongStripe);
+		}
+		crc = CrcShift(crcLongShift, crc) ^ crc1;
+		crc = CrcShift(crcLongShift, crc) ^ crc2;
+		data += 2 * CrcLongStripe;
+		length -= 3 * CrcLongStripe;
+	}
+
+	while(length >= 3 * CrcShortStripe){
+		crc1 = 0;
+		crc2 = 0;
+		for(end = data + CrcShortStripe; data < end; data += sizeof(CrcWord)){
+			crc = CrcStep(crc, data);
+			crc1 = CrcStep(crc1, data + CrcShortStripe);
+			crc2 = CrcStep(crc2, data + 2 * CrcShortStripe);
+		}
+		crc = CrcShift(crcShortShift, crc) ^ crc1;
+		crc = CrcShift(crcShortShift, crc) ^ crc2;
+		data += 2 * CrcShortStripe;
+		length -= 3 * CrcShortStripe;
+	}
+
+	while(length >= sizeof(CrcWord)){
+		crc = CrcStep(crc, data);
+		data += sizeof(CrcWord);
+		length -= sizeof(CrcWord);
+	}
+	while(length > 0){
+		crc = _mm_crc32_u8(crc, *data);
+		data++;
+		length--;
+	}
+
+	return ~crc;
+
+}
+
+
+/*Simple helper function to keep the code clean. Only has to be done once, before any thread can get at crc32c*/
+static crcKernel crcSse42Kernel(void){
+
+	if(!__builtin_cpu_supports("sse4.2")){
+		return crcScalar;
+	}
+	if(!crcShiftReady){
+		crcShiftTable(crcLongShift, CrcLongStripe);
+		crcShiftTable(crcShortShift, CrcShortStripe);
+		crcShiftReady = 1;
+	}
+
+	return crcSse42;
+
+}
+
+__attribute__((target("ssse3")))
+static void unpackSsse3(const unsigned char * in, int pairCount, unsigned short int * out){
+
+	__m128i shuffle, evenSelect, oddSelect, words;
+
+	/*Lane 2k gets b1:b0 of pair k, lane 2k+1 gets b2:b1 - i.e. big endian words in little endian lanes*/
+	shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	evenSelect = _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+	oddSelect = _mm_setr_epi16(0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF);
+
+	/*Each iteration eats 12 bytes but loads 16, so stop while there are still at least 16 left*/
+	while(pairCount >= 6){
+
+		words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), shuffle);
+		words = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(words, 4), evenSelect), _mm_and_si128(words, oddSelect));
+		_mm_storeu_si128((__m128i *)out, words);
+
+		in += 12;
+		out += 8;
+		pairCount -= 4;
+	}
+
+	unpackScalar(in, pairCount, out);
+
+}
+
+
+__attribute__((target("avx2")))
+static void unpackAvx2(const unsigned char * in, int pairCount, unsigned short int * out){
+
+	__m256i shuffle, evenSelect, oddSelect, words;
+
+	/*Same shuffle as the SSSE3 kernel, repeated for both lanes*/
+	shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+	                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	evenSelect = _mm256_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0);
+	oddSelect = _mm256_setr_epi16(0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF, 0, 0xFFF);
+
+	/*Each iteration eats 24 bytes, but the upper lane loads 16 bytes starting at byte 12, so we need 28 bytes*/
+	while(pairCount >= 10){
+
+		words = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in));
+		words = _mm256_inserti128_si256(words, _mm_loadu_si128((const __m128i *)(in + 12)), 1);
+		words = _mm256_shuffle_epi8(words, shuffle);
+		words = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(words, 4), evenSelect), _mm256_and_si256(words, oddSelect));
+		_mm256_storeu_si256((__m256i *)out, words);
+
+		in += 24;
+		out += 16;
+		pairCount -= 8;
+	}
+
+	unpackSsse3(in, pairCount, out);
+
+}
+
+
+__attribute__((target("ssse3")))
+static void packSsse3(const unsigned short int * in, int pairCount, unsigned char * out){
+
+	__m128i valueMask, weights, shuffle, words;
+
+	valueMask = _mm_set1_epi16(0xFFF);
+	/*Even lanes (v0) get multiplied by 4096, odd lanes (v1) by 1*/
+	weights = _mm_setr_epi16(4096, 1, 4096, 1, 4096, 1, 4096, 1);
+	/*Bytes 2 1 0 of each 32 bit word, i.e. big endian, then 4 bytes of zeros*/
+	shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	/*Each iteration writes 16 bytes but only 12 are ours, so stop while there are still at least 16 left*/
+	while(pairCount >= 6){
+
+		words = _mm_madd_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i *)in), valueMask), weights);
+		_mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(words, shuffle));
+
+		in += 8;
+		out += 12;
+		pairCount -= 4;
+	}
+
+	packScalar(in, pairCount, out);
+
+}
+
+
+__attribute__((target("avx2")))
+static void packAvx2(const unsigned short int * in, int pairCount, unsigned char * out){
+
+	__m256i valueMask, weights, shuffle, words;
+
+	valueMask = _mm256_set1_epi16(0xFFF);
+	weights = _mm256_setr_epi16(4096, 1, 4096, 1, 4096, 1, 4096, 1, 4096, 1, 4096, 1, 4096, 1, 4096, 1);
+	shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	/*Each lane packs 12 bytes. The upper lane gets stored at byte 12, over the zeros of the lower one, so we need 28 bytes*/
+	while(pairCount >= 10){
+
+		words = _mm256_madd_epi16(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)in), valueMask), weights);
+		words = _mm256_shuffle_epi8(words, shuffle);
+		_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(words));
+		_mm_storeu_si128((__m128i *)(out + 12), _mm256_extracti128_si256(words, 1));
+
+		in += 16;
+		out += 24;
+		pairCount -= 8;
+	}
+
+	packSsse3(in, pairCount, out);
+
+}
+
+
+/*The compares are plain SSE2, but it goes with the SSSE3 unpack kernel*/
+__attribute__((target("ssse3")))
+static int filterSsse3(const unsigned short int * values, int count, unsigned short int threshold){
+
+	__m128i limit, above;
+	int i;
+
+	limit = _mm_set1_epi16((short)threshold);
+
+	/*Skip 16 values at a time while none of them are above the threshold*/
+	for(i = 0; i + 16 <= count; i += 16){
+		above = _mm_or_si128(_mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)&values[i]), limit),
+		                     _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)&values[i + 8]), limit));
+		if(_mm_movemask_epi8(above) != 0){
+			break;
+		}
+	}
+
+	/*The scalar loop finds exactly which one it was (or handles the last few values)*/
+	return i + filterScalar(&values[i], count - i, threshold);
+
+}
+
+
+__attribute__((target("avx2")))
+static int filterAvx2(const unsigned short int * values, int count, unsigned short int threshold){
+
+	__m256i limit, above;
+	int mask, i;
+
+	limit = _mm256_set1_epi16((short)threshold);
+
+	/*One compare per 16 values*/
+	for(i = 0; i + 16 <= count; i += 16){
+		above = _mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i *)&values[i]), limit);
+		mask = _mm256_movemask_epi8(above);
+		if(mask != 0){
+			/*2 mask bits per value*/
+			return i + (__builtin_ctz(mask) >> 1);
+		}
+	}
+
+	return i + filterScalar(&values[i], count - i, threshold);
+
+}
+
+
+/*Plain SSE2 again, but it goes with the SSSE3 kernels*/
+__attribute__((target("ssse3")))
+static int countSsse3(const unsigned short int * values, int count, unsigned short int value){
+
+	__m128i limit, below;
+	int i;
+
+	limit = _mm_set1_epi16((short)value);
+	below = _mm_setzero_si128();
+
+	/*Every lane where value > the array is -1, so subtracting counts it. Each lane counts at most count / 8*/
+	for(i = 0; i + 8 <= count; i += 8){
+		below = _mm_sub_epi16(below, _mm_cmpgt_epi16(limit, _mm_loadu_si128((const __m128i *)&values[i])));
+	}
+
+	/*Add up the 8 lanes: pairs into 32 bits, then fold the halves*/
+	below = _mm_madd_epi16(below, _mm_set1_epi16(1));
+	below = _mm_add_epi32(below, _mm_shuffle_epi32(below, _MM_SHUFFLE(1, 0, 3, 2)));
+	below = _mm_add_epi32(below, _mm_shuffle_epi32(below, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return _mm_cvtsi128_si32(below) + countScalar(&values[i], count - i, value);
+
+}
+
+
+__attribute__((target("avx2")))
+static int countAvx2(const unsigned short int * values, int count, unsigned short int value){
+
+	__m256i limit, below;
+	__m128i sum;
+	int i;
+
+	limit = _mm256_set1_epi16((short)value);
+	below = _mm256_setzero_si256();
+
+	for(i = 0; i + 16 <= count; i += 16){
+		below = _mm256_sub_epi16(below, _mm256_cmpgt_epi16(limit, _mm256_loadu_si256((const __m256i *)&values[i])));
+	}
+
+	/*Pairs into 32 bits, both lanes into one, then fold the halves*/
+	below = _mm256_madd_epi16(below, _mm256_set1_epi16(1));
+	sum = _mm_add_epi32(_mm256_castsi256_si128(below), _mm256_extracti128_si256(below, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	/*The SSSE3 version does the last 0-15*/
+	return _mm_cvtsi128_si32(sum) + countSsse3(&values[i], count - i, value);
+
+}
+
+
+/*pshufb masks for 3 channels: channel c out of vector v is splitMasks[c * 3 + v]. -128 zeroes the lane*/
+static const signed char splitMasks[9][16] = {
+	{0, 1, 6, 7, 12, 13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+	{-128, -128, -128, -128, -128, -128, 2, 3, 8, 9, 14, 15, -128, -128, -128, -128},
+	{-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 4, 5, 10, 11},
+	{2, 3, 8, 9, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+	{-128, -128, -128, -128, -128, -128, 4, 5, 10, 11, -128, -128, -128, -128, -128, -128},
+	{-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 1, 6, 7, 12, 13},
+	{4, 5, 10, 11, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+	{-128, -128, -128, -128, 0, 1, 6, 7, 12, 13, -128, -128, -128, -128, -128, -128},
+	{-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 2, 3, 8, 9, 14, 15}
+};
+
+__attribute__((target("ssse3")))
+static void splitSsse3(const unsigned short int * in, int frameCount, int channels, unsigned short int * const * out){
+
+	__m128i masks[9], evenOdd, first, second, third;
+	int i, c;
+
+	i = 0;
+	if(channels == 2){
+
+		/*Even lanes to the bottom half, odd lanes to the top half*/
+		evenOdd = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+		for(; i + 8 <= frameCount; i += 8){
+			first = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&in[i * 2]), evenOdd);
+			second = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&in[i * 2 + 8]), evenOdd);
+			_mm_storeu_si128((__m128i *)&out[0][i], _mm_unpacklo_epi64(first, second));
+			_mm_storeu_si128((__m128i *)&out[1][i], _mm_unpackhi_epi64(first, second));
+		}
+
+	}
+	else if(channels == 3){
+
+		for(c = 0; c < 9; c++){
+			masks[c] = _mm_loadu_si128((const __m128i *)&splitMasks[c][0]);
+		}
+		for(; i + 8 <= frameCount; i += 8){
+			first = _mm_loadu_si128((const __m128i *)&in[i * 3]);
+			second = _mm_loadu_si128((const __m128i *)&in[i * 3 + 8]);
+			third = _mm_loadu_si128((const __m128i *)&in[i * 3 + 16]);
+			for(c = 0; c < 3; c++){
+				_mm_storeu_si128((__m128i *)&out[c][i], _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(first, masks[c * 3]),
+				                                                                   _mm_shuffle_epi8(second, masks[c * 3 + 1])),
+				                                                      _mm_shuffle_epi8(third, masks[c * 3 + 2])));
+			}
+		}
+
+	}
+
+	/*Whatever is left (or every frame, for other channel counts)*/
+	splitFrames(in, i, frameCount, channels, out);
+
+}
+
+#endif
+
+
+#ifdef UnpackHaveArmCrc
+
+/*CRC32C with the ARMv8 CRC instructions, same as the SSE4.2 one*/
+__attribute__((target("+crc")))
+static unsigned int crcArm(unsigned int crc, const unsigned char * data, size_t length){
+
+	uint64_t word;
+
+	crc = ~crc;
+	while(length >= sizeof(word)){
+		memcpy(&word, data, sizeof(word));
+		crc = __crc32cd(crc, word);
+		data += sizeof(word);
+		length -= sizeof(word);
+	}
+	while(length > 0){
+		crc = __crc32cb(crc, *data);
+		data++;
+		length--;
+	}
+
+	return ~crc;
+
+}
+
+#endif
+
+
+#ifdef UnpackHaveNeon
+
+static void unpackNeon(const unsigned char * in, int pairCount, unsigned short int * out){
+
+	uint8x8x3_t bytes;
+	uint16x8x2_t values;
+	uint8x8_t lowNibble;
+
+	lowNibble = vdup_n_u8(0x0F);
+
+	while(pairCount >= 8){
+
+		/*bytes.val[0] = all the b0s, val[1] = all the b1s, val[2] = all the b2s*/
+		bytes = vld3_u8(in);
+
+		/*v0 = b0 << 4 | b1 >> 4, v1 = (b1 & 0xF) << 8 | b2*/
+		values.val[0] = vorrq_u16(vshll_n_u8(bytes.val[0], 4), vmovl_u8(vshr_n_u8(bytes.val[1], 4)));
+		values.val[1] = vorrq_u16(vshll_n_u8(vand_u8(bytes.val[1], lowNibble), 8), vmovl_u8(bytes.val[2]));
+
+		/*Interleave them back so the values come out in file order*/
+		vst2q_u16(out, values);
+
+		in += 24;
+		out += 16;
+		pairCount -= 8;
+	}
+
+	unpackScalar(in, pairCount, out);
+
+}
+
+
+static void packNeon(const unsigned short int * in, int pairCount, unsigned char * out){
+
+	uint16x8x2_t values;
+	uint8x8x3_t bytes;
+	uint16x8_t valueMask;
+
+	valueMask = vdupq_n_u16(0xFFF);
+
+	while(pairCount >= 8){
+
+		/*values.val[0] = all the v0s, val[1] = all the v1s*/
+		values = vld2q_u16(in);
+		values.val[0] = vandq_u16(values.val[0], valueMask);
+		values.val[1] = vandq_u16(values.val[1], valueMask);
+
+		/*b0 = v0 >> 4, b1 = (v0 & 0xF) << 4 | v1 >> 8, b2 = v1 & 0xFF*/
+		bytes.val[0] = vshrn_n_u16(values.val[0], 4);
+		bytes.val[1] = vorr_u8(vshl_n_u8(vmovn_u16(values.val[0]), 4), vshrn_n_u16(values.val[1], 8));
+		bytes.val[2] = vmovn_u16(values.val[1]);
+
+		vst3_u8(out, bytes);
+
+		in += 16;
+		out += 24;
+		pairCount -= 8;
+	}
+
+	packScalar(in, pairCount, out);
+
+}
+
+
+static int filterNeon(const unsigned short int * values, int count, unsigned short int threshold){
+
+	uint16x8_t limit;
+	uint64x2_t above;
+	int i;
+
+	limit = vdupq_n_u16(threshold);
+
+	for(i = 0; i + 16 <= count; i += 16){
+		above = vreinterpretq_u64_u16(vorrq_u16(vcgtq_u16(vld1q_u16(&values[i]), limit),
+		                                        vcgtq_u16(vld1q_u16(&values[i + 8]), limit)));
+		if((vgetq_lane_u64(above, 0) | vgetq_lane_u64(above, 1)) != 0){
+			break;
+		}
+	}
+
+	return i + filterScalar(&values[i], count - i, threshold);
+
+}
+
+
+static int countNeon(const unsigned short int * values, int count, unsigned short int value){
+
+	uint16x8_t limit, below;
+	uint64x2_t sum;
+	int i;
+
+	limit = vdupq_n_u16(value);
+	below = vdupq_n_u16(0);
+
+	/*The compare gives all ones (-1) for every value below, so subtracting counts it*/
+	for(i = 0; i + 8 <= count; i += 8){
+		below = vsubq_u16(below, vcltq_u16(vld1q_u16(&values[i]), limit));
+	}
+
+	/*Pairwise adds all the way down. vaddvq would do it in one, but only on aarch64*/
+	sum = vpaddlq_u32(vpaddlq_u16(below));
+
+	return (int)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1)) + countScalar(&values[i], count - i, value);
+
+}
+
+
+static void splitNeon(const unsigned short int * in, int frameCount, int channels, unsigned short int * const * out){
+
+	uint16x8x2_t pairs;
+	uint16x8x3_t triples;
+	int i;
+
+	/*vld2 & vld3 hand us the channels already split*/
+	i = 0;
+	if(channels == 2){
+		for(; i + 8 <= frameCount; i += 8){
+			pairs = vld2q_u16(&in[i * 2]);
+			vst1q_u16(&out[0][i], pairs.val[0]);
+			vst1q_u16(&out[1][i], pairs.val[1]);
+		}
+	}
+	else if(channels == 3){
+		for(; i + 8 <= frameCount; i += 8){
+			triples = vld3q_u16(&in[i * 3]);
+			vst1q_u16(&out[0][i], triples.val[0]);
+			vst1q_u16(&out[1][i], triples.val[1]);
+			vst1q_u16(&out[2][i], triples.val[2]);
+		}
+	}
+
+	splitFrames(in, i, frameCount, channels, out);
+
+}
+
+#endif
+
+
+/*Value k of a group of bits wide values, out of the 24 bits starting at its first byte*/
+#define SampleByte(in, Bits, GroupBytes, k, extra) \
+	((unsigned long)((((k) * (Bits)) / 8 + (extra) < (GroupBytes)) ? (in)[((k) * (Bits)) / 8 + (extra)] : 0))
+#define SampleAt(in, Bits, GroupBytes, k) \
+	(unsigned short int)((((SampleByte(in, Bits, GroupBytes, k, 0) << 16) | (SampleByte(in, Bits, GroupBytes, k, 1) << 8) \
+	                       | SampleByte(in, Bits, GroupBytes, k, 2)) >> (24 - (Bits) - ((k) * (Bits)) % 8)) & ((1UL << (Bits)) - 1))
+
+/*One unrolled kernel for a width. GroupValues is 2 or 4, and the other 2 are thrown away when they arent needed*/
+#define DefineUnpackWidth(Bits, GroupValues, GroupBytes) \
+static void unpack##Bits##Bit(const unsigned char * in, int groupCount, unsigned short int * out){ \
+	int i; \
+	for(i = 0; i < groupCount; i++){ \
+		out[0] = SampleAt(in, Bits, GroupBytes, 0); \
+		out[1] = SampleAt(in, Bits, GroupBytes, 1); \
+		if((GroupValues) > 2){ \
+			out[2] = SampleAt(in, Bits, GroupBytes, 2); \
+			out[3] = SampleAt(in, Bits, GroupBytes, 3); \
+		} \
+		in += (GroupBytes); \
+		out += (GroupValues); \
+	} \
+}
+
+DefineUnpackWidth(10, 4, 5)
+DefineUnpackWidth(14, 4, 7)
+
+
+/*Returns 1 if the cpu we are running on can run the kernel*/
+static int kernelSupported(unpackKernelId kernel){
+
+	switch(kernel){
+		case UnpackScalar:
+			return 1;
+#ifdef UnpackHaveX86
+		case UnpackSsse3:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("ssse3");
+		case UnpackAvx2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+#ifdef UnpackHaveNeon
+		case UnpackNeon:
+#ifdef __aarch64__
+			/*NEON is mandatory on aarch64*/
+			return 1;
+#else
+			return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+#endif
+		default:
+			return 0;
+	}
+
+}
+
+
+/*Point unpack12Pairs, pack12Pairs, firstAboveThreshold, countBelow, splitChannels & crc32c at the requested kernel (or the best one we have)*/
+int unpackSelect(unpackKernelId kernel){
+
+	if(kernel == UnpackAuto){
+		/*Try them from fastest to slowest. Scalar always works*/
+		if(kernelSupported(UnpackAvx2)){
+			kernel = UnpackAvx2;
+		}
+		else if(kernelSupported(UnpackSsse3)){
+			kernel = UnpackSsse3;
+		}
+		else if(kernelSupported(UnpackNeon)){
+			kernel = UnpackNeon;
+		}
+		else{
+			kernel = UnpackScalar;
+		}
+	}
+
+	if(!kernelSupported(kernel)){
+		return -1;
+	}
+
+	switch(kernel){
+#ifdef UnpackHaveX86
+		case UnpackSsse3:
+			unpack12Pairs = unpackSsse3;
+			pack12Pairs = packSsse3;
+			firstAboveThreshold = filterSsse3;
+			countBelow = countSsse3;
+			splitChannels = splitSsse3;
+			crc32c = crcSse42Kernel();
+			break;
+		case UnpackAvx2:
+			unpack12Pairs = unpackAvx2;
+			pack12Pairs = packAvx2;
+			firstAboveThreshold = filterAvx2;
+			countBelow = countAvx2;
+			splitChannels = splitSsse3;
+			crc32c = crcSse42Kernel();
+			break;
+#endif
+#ifdef UnpackHaveNeon
+		case UnpackNeon:
+			unpack12Pairs = unpackNeon;
+			pack12Pairs = packNeon;
+			firstAboveThreshold = filterNeon;
+			countBelow = countNeon;
+			splitChannels = splitNeon;
+#ifdef UnpackHaveArmCrc
+			crc32c = ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0) ? crcArm : crcScalar;
+#else
+			crc32c = crcScalar;
+#endif
+			break;
+#endif
+		default:
+			unpack12Pairs = unpackScalar;
+			pack12Pairs = packScalar;
+			firstAboveThreshold = filterScalar;
+			countBelow = countScalar;
+			splitChannels = splitScalar;
+			crc32c = crcScalar;
+			break;
+	}
+
+	currentKernel = kernel;
+
+	return 0;
+
+}
+
+
+/*Simple lookup so the kernel can be picked from the cmd line*/
+int unpackKernelByName(const char * name){
+
+	int i;
+
+	for(i = 0; i < UnpackKernelCount; i++){
+		if(strcmp(name, kernelNames[i]) == 0){
+			return i;
+		}
+	}
+
+	return -1;
+
+}
+
+
+/*Simple helper function to keep the code clean*/
+const char * unpackKernelName(void){
+	return kernelNames[currentKernel];
+}
+
+
+/*Simple lookup for the parser. 12 bits has the SIMD kernels, but this is the scalar one like the others*/
+unpackKernel unpackWidthKernel(int bits, int * groupValues, int * groupBytes){
+
+	switch(bits){
+		case 10:
+			*groupValues = 4;
+			*groupBytes = 5;
+			return unpack10Bit;
+		case 12:
+			*groupValues = 2;
+			*groupBytes = 3;
+			return unpackScalar;
+		case 14:
+			*groupValues = 4;
+			*groupBytes = 7;
+			return unpack14Bit;
+		default:
+			return NULL;
+	}
+
+}
@@ -0,0 +1,72 @@
+/* ####################################
+   12 Bit Unpack, Pack & Filter Kernels
+   #################################### */
+
+/*size_t*/
+#include <stddef.h>
+
+/*Each kernel turns pairCount big endian 24 bit pairs into 2 * pairCount values*/
+/*The first value of a pair is the upper 12 bits, the second is the lower 12 bits*/
+typedef void (*unpackKernel)(const unsigned char * in, int pairCount, unsigned short int * out);
+
+/*Each pack kernel does the opposite: pairCount pairs of values (only their lower 12 bits) into 3 big endian bytes each*/
+typedef void (*packKernel)(const unsigned short int * in, int pairCount, unsigned char * out);
+
+/*Each filter kernel returns the index of the first value greater than threshold, or count if there isnt one*/
+typedef int (*filterKernel)(const unsigned short int * values, int count, unsigned short int threshold);
+
+/*Each count kernel returns how many of the values are less than value*/
+typedef int (*countKernel)(const unsigned short int * values, int count, unsigned short int value);
+
+/*Each split kernel de-interleaves frameCount frames of channels values: value c of frame i goes to out[c][i]*/
+typedef void (*splitKernel)(const unsigned short int * in, int frameCount, int channels, unsigned short int * const * out);
+
+/*Each crc kernel carries the CRC32C (Castagnoli) of everything before on over length more bytes. Start with 0*/
+typedef unsigned int (*crcKernel)(unsigned int crc, const unsigned char * data, size_t length);
+
+/*Every kernel we know about. Which ones actually work depends on the build & the cpu*/
+typedef enum{
+	UnpackAuto = 0,
+	UnpackScalar,
+	UnpackSsse3,
+	UnpackAvx2,
+	UnpackNeon,
+	UnpackKernelCount
+}unpackKernelId;
+
+/*The kernel everybody should call. Points at the scalar kernel until unpackSelect() is called*/
+extern unpackKernel unpack12Pairs;
+
+/*The pack kernel for this cpu. Always produces exactly the same bytes as the scalar version*/
+extern packKernel pack12Pairs;
+
+/*The matching filter kernel. Always uses the same instruction set as unpack12Pairs*/
+extern filterKernel firstAboveThreshold;
+
+/*The matching count kernel. Used to find where a value goes in a sorted array*/
+extern countKernel countBelow;
+
+/*The matching split kernel. Used to pull interleaved channels apart*/
+extern splitKernel splitChannels;
+
+/*The crc kernel. The crc instruction (SSE4.2, ARMv8 CRC) if the kernel's instruction set has it, a table otherwise*/
+extern crcKernel crc32c;
+
+
+/* ###################
+   Function Prototypes
+   ################### */
+
+/*Point unpack12Pairs, pack12Pairs, firstAboveThreshold, countBelow, splitChannels & crc32c at the requested kernel. UnpackAuto picks the fastest one this cpu supports*/
+/*Returns -1 (and leaves the current kernel alone) if the kernel isnt available*/
+int unpackSelect(unpackKernelId kernel);
+
+/*Look up a kernel by its name (scalar, ssse3, avx2, neon, auto). Returns -1 for unknown names*/
+int unpackKernelByName(const char * name);
+
+/*Name of the kernel currently in use*/
+const char * unpackKernelName(void);
+
+/*Look up the unrolled scalar kernel for bits wide samples (10, 12 or 14). pairCount then counts whole groups:*/
+/*groupValues values in groupBytes bytes, e.g. 4 values in 5 bytes for 10 bits. Returns NULL for other widths*/
+unpackKernel unpackWidthKernel(int bits, int * groupValues, int * groupBytes);